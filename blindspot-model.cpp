@@ -0,0 +1,117 @@
+/*******************************************************
+---------------- Analytic Blindspot Model ----------------
+The car sits at ( 0, 0, CarDistance ) looking down -Z. The bike road
+is the car road rotated by AngleIntersection about Y, so the bike is at
+( BikeDistance * sin( a ), 0, BikeDistance * cos( a ) ).
+
+The blindspot is the wedge between the rays leaving the car at
+LeadingAngle and TrailingAngle from -Z towards +X.
+*******************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "blindspot-model.h"
+#include "dual-number.h"
+
+
+//Index of the field with this name, -1 if there is none
+int FindScenarioField( const char *name )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		if (strcmp(name, SCENARIO_NAMES[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+float GetScenarioField( const Scenario &scn, int field )
+{
+	switch (field)
+	{
+	case SCN_AOI:		return scn.AngleIntersection;
+	case SCN_LA:		return scn.LeadingAngle;
+	case SCN_TA:		return scn.TrailingAngle;
+	case SCN_CSTART:	return scn.CarStart;
+	case SCN_CSPEED:	return scn.CarSpeed;
+	case SCN_BSTART:	return scn.BikeStart;
+	case SCN_BSPEED:	return scn.BikeSpeed;
+	}
+	return 0.f;
+}
+
+void SetScenarioField( Scenario *scn, int field, float value )
+{
+	switch (field)
+	{
+	case SCN_AOI:		scn->AngleIntersection = value;	break;
+	case SCN_LA:		scn->LeadingAngle = value;		break;
+	case SCN_TA:		scn->TrailingAngle = value;		break;
+	case SCN_CSTART:	scn->CarStart = value;			break;
+	case SCN_CSPEED:	scn->CarSpeed = value;			break;
+	case SCN_BSTART:	scn->BikeStart = value;			break;
+	case SCN_BSPEED:	scn->BikeSpeed = value;			break;
+	}
+}
+
+bool SameScenario( const Scenario &a, const Scenario &b )
+{
+	return a.AngleIntersection == b.AngleIntersection && a.LeadingAngle == b.LeadingAngle &&
+		   a.TrailingAngle == b.TrailingAngle && a.CarStart == b.CarStart && a.CarSpeed == b.CarSpeed &&
+		   a.BikeStart == b.BikeStart && a.BikeSpeed == b.BikeSpeed;
+}
+
+//Seconds from t until the two are COLLISION_DISTANCE apart if both keep going
+float TimeToCollision( const Scenario &scn, float t )
+{
+	float r0, r1, f0, f1;
+	RelativeMotion(scn, &r0, &r1, &f0, &f1);
+
+	//Solve | p + v * s | = COLLISION_DISTANCE for the first s >= 0
+	float px = r0 + r1 * t;
+	float py = f0 + f1 * t;
+	float a = r1 * r1 + f1 * f1;
+	float b = px * r1 + py * f1;
+	float c = px * px + py * py - COLLISION_DISTANCE * COLLISION_DISTANCE;
+	if (c <= 0.f)
+		return 0.f; //Already touching
+	if (a == 0.f || b >= 0.f)
+		return TTC_NEVER; //Standing still relative to each other, or moving apart
+
+	float disc = b * b - a * c;
+	if (disc < 0.f)
+		return TTC_NEVER; //Closest approach is wider than COLLISION_DISTANCE
+	return (-b - sqrtf(disc)) / a;
+}
+
+//One forward mode pass through ComputeTrajectoryMetrics( ) with every field as a variable
+void ComputeTrajectoryGradient( const Scenario &scn, TrajectoryGradient *grad )
+{
+	typedef Dual<SCN_FIELDS> D;
+
+	BasicScenario<D> dscn;
+	dscn.AngleIntersection = D::Variable(scn.AngleIntersection, SCN_AOI);
+	dscn.LeadingAngle = D::Variable(scn.LeadingAngle, SCN_LA);
+	dscn.TrailingAngle = D::Variable(scn.TrailingAngle, SCN_TA);
+	dscn.CarStart = D::Variable(scn.CarStart, SCN_CSTART);
+	dscn.CarSpeed = D::Variable(scn.CarSpeed, SCN_CSPEED);
+	dscn.BikeStart = D::Variable(scn.BikeStart, SCN_BSTART);
+	dscn.BikeSpeed = D::Variable(scn.BikeSpeed, SCN_BSPEED);
+
+	BasicTrajectoryMetrics<D> m;
+	ComputeTrajectoryMetrics(dscn, &m);
+
+	grad->Metrics.Duration = m.Duration.Value;
+	grad->Metrics.HiddenStart = m.HiddenStart.Value;
+	grad->Metrics.HiddenEnd = m.HiddenEnd.Value;
+	grad->Metrics.HiddenTime = m.HiddenTime.Value;
+	grad->Metrics.MinSeparation = m.MinSeparation.Value;
+	grad->Metrics.MinSeparationTime = m.MinSeparationTime.Value;
+	grad->Metrics.Collision = m.Collision;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		grad->HiddenTime[i] = m.HiddenTime.Deriv[i];
+		grad->MinSeparation[i] = m.MinSeparation.Deriv[i];
+	}
+}
@@ -0,0 +1,315 @@
+/*******************************************************
+---------------- Analytic Blindspot Model ----------------
+The geometry behind DrawShadow( ), kept free of OpenGL so the
+same numbers can drive the shadow, per-frame metrics and any
+code that evaluates scenarios without a window.
+
+Angles are in degrees, distances in meters, measured the same
+way as the globals in cyclist-collider.cpp.
+
+The geometry and kinematics are templates over the scalar type.
+Everyday code uses float; instantiating with Dual ( dual-number.h )
+carries derivatives with respect to every slider through the same
+code, so one evaluation gives a value and its whole gradient.
+*******************************************************/
+
+#ifndef BLINDSPOT_MODEL_H
+#define BLINDSPOT_MODEL_H
+
+#include <cmath>
+
+//How long a run keeps going after the last of the car and bike reaches the intersection
+const float RUN_MARGIN = 2.f;
+
+//Center to center distance under which the car and bike count as colliding
+const float COLLISION_DISTANCE = 1.5f;
+
+//Time to collision when the two never come that close on their current course
+const float TTC_NEVER = -1.f;
+
+//Fixed distance on the trailing edge of the shadow when it never meets the bike's road
+const float SHADOW_TRAIL_MAX = 100000.f;
+
+const float MODEL_PI = 3.14159265358979f;
+const float MODEL_DEG_TO_RAD = MODEL_PI / 180.f;
+
+//Distances from the car to where the blindspot edges cross the bike's road
+//Returns false when there is no shadow (car past the intersection or leading edge misses the road)
+template <typename T>
+bool	ShadowEdges( T angleIntersection, T leadingAngle, T trailingAngle, T carDistance, T *leadDistance, T *trailDistance );
+
+//True if the bike is inside the blindspot wedge of the right hand blinder
+template <typename T>
+bool	BikeInShadow( T angleIntersection, T leadingAngle, T trailingAngle, T carDistance, T bikeDistance );
+
+//The slider values that decide how a single car / bike run plays out
+template <typename T>
+struct BasicScenario
+{
+	T	AngleIntersection;
+	T	LeadingAngle;
+	T	TrailingAngle;
+	T	CarStart;
+	T	CarSpeed;
+	T	BikeStart;
+	T	BikeSpeed;
+};
+
+typedef BasicScenario<float>	Scenario;
+
+//Scenario fields by index, in the order they are declared
+enum ScenarioField
+{
+	SCN_AOI,
+	SCN_LA,
+	SCN_TA,
+	SCN_CSTART,
+	SCN_CSPEED,
+	SCN_BSTART,
+	SCN_BSPEED,
+	SCN_FIELDS
+};
+
+//Names of the fields as they appear in files and on command lines
+const char * const SCENARIO_NAMES[SCN_FIELDS] = { "AngleIntersection", "LeadingAngle", "TrailingAngle",
+												  "CarStart", "CarSpeed", "BikeStart", "BikeSpeed" };
+
+//Range of each field on its GUI slider
+const float SCENARIO_MIN[SCN_FIELDS] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+const float SCENARIO_MAX[SCN_FIELDS] = { 180.f, 45.f, 45.f, 1000.f, 100.f, 1000.f, 100.f };
+
+//Index of the field with this name, -1 if there is none
+int				FindScenarioField( const char * );
+float			GetScenarioField( const Scenario &, int );
+void			SetScenarioField( Scenario *, int, float );
+
+//Where the car and bike are at a point in time
+template <typename T>
+struct BasicScenarioState
+{
+	T	Time;
+	T	CarDistance;
+	T	BikeDistance;
+};
+
+typedef BasicScenarioState<float>	ScenarioState;
+
+//Keeps an argument out of template deduction, so the scenario alone picks the scalar type
+template <typename T>
+struct ModelScalar
+{
+	typedef T	Type;
+};
+
+//Closed form state at time t (both move at constant speed from their start)
+template <typename T>
+BasicScenarioState<T>	StateAtTime( const BasicScenario<T> &, typename ModelScalar<T>::Type );
+
+//Length of a run: until both have passed the intersection, plus RUN_MARGIN
+template <typename T>
+T						RunDuration( const BasicScenario<T> & );
+
+//True if both describe exactly the same run
+bool			SameScenario( const Scenario &, const Scenario & );
+
+//Summary of a whole run, from t = 0 to RunDuration( )
+template <typename T>
+struct BasicTrajectoryMetrics
+{
+	T		Duration;
+	T		HiddenStart;		//first and last moment the bike is in the blindspot
+	T		HiddenEnd;
+	T		HiddenTime;			//seconds in the blindspot, 0 if never hidden
+	T		MinSeparation;		//closest the bike comes to the car, in meters
+	T		MinSeparationTime;
+	bool	Collision;			//MinSeparation < COLLISION_DISTANCE
+};
+
+typedef BasicTrajectoryMetrics<float>	TrajectoryMetrics;
+
+//Closed form metrics of a run; the hidden interval matches BikeInShadow( ) at every t
+template <typename T>
+void			ComputeTrajectoryMetrics( const BasicScenario<T> &, BasicTrajectoryMetrics<T> * );
+
+//Seconds from t until the two are COLLISION_DISTANCE apart if both keep going, TTC_NEVER if they never are
+float			TimeToCollision( const Scenario &, float );
+
+//Metrics of a run together with their derivatives with respect to each field, indexed by ScenarioField
+//Units follow the fields: seconds per degree, seconds per meter and so on
+struct TrajectoryGradient
+{
+	TrajectoryMetrics	Metrics;
+	float				HiddenTime[SCN_FIELDS];
+	float				MinSeparation[SCN_FIELDS];
+};
+
+//One forward mode pass through ComputeTrajectoryMetrics( ) with every field as a variable
+void			ComputeTrajectoryGradient( const Scenario &, TrajectoryGradient * );
+
+
+/*******************************************************
+Template definitions. Branches decide on the value alone, so the
+derivatives are those of whichever piece of the model applies.
+*******************************************************/
+
+template <typename T>
+bool ShadowEdges( T angleIntersection, T leadingAngle, T trailingAngle, T carDistance, T *leadDistance, T *trailDistance )
+{
+	using std::sin;
+
+	T angle_difference = 180.f - angleIntersection;
+	//If the car has passed the intersection or the leading edge never interesects with the road, there is no shadow
+	if (carDistance < 0.f || angle_difference < leadingAngle)
+	{
+		return false;
+	}
+	//Issues occur when leading angle or trailing angle are equal to 180 - AngleIntersection
+	//At this point, the distance values become unpredictable and large
+	T lAngle = leadingAngle * MODEL_DEG_TO_RAD;
+	T tAngle = trailingAngle * MODEL_DEG_TO_RAD;
+	T iAngle = angleIntersection * MODEL_DEG_TO_RAD;
+
+	//CSED = Car Shadow Edge Distance
+	T CSED_Numerator = (carDistance * sin(iAngle));
+	*trailDistance = CSED_Numerator / sin((MODEL_PI - (tAngle + iAngle)));
+	*leadDistance = CSED_Numerator / sin((MODEL_PI - (lAngle + iAngle)));
+
+	if (angle_difference < trailingAngle)
+	{
+		*trailDistance = SHADOW_TRAIL_MAX; //No intersection between the road and the trailing edge
+	}
+	return true;
+}
+
+template <typename T>
+bool BikeInShadow( T angleIntersection, T leadingAngle, T trailingAngle, T carDistance, T bikeDistance )
+{
+	using std::sin;
+	using std::cos;
+
+	//No shadow once the car has passed the intersection (same rule as DrawShadow( ))
+	if (carDistance < 0.f)
+		return false;
+
+	T iAngle = angleIntersection * MODEL_DEG_TO_RAD;
+	T lAngle = leadingAngle * MODEL_DEG_TO_RAD;
+	T tAngle = trailingAngle * MODEL_DEG_TO_RAD;
+
+	//Bike position relative to the car: right of the car and ahead of the car
+	T right = bikeDistance * sin(iAngle);
+	T ahead = carDistance - bikeDistance * cos(iAngle);
+
+	//Inside both half planes bounding the wedge
+	return (right * cos(lAngle) - ahead * sin(lAngle) >= 0.f) &&
+		   (right * cos(tAngle) - ahead * sin(tAngle) <= 0.f);
+}
+
+template <typename T>
+BasicScenarioState<T> StateAtTime( const BasicScenario<T> &scn, typename ModelScalar<T>::Type t )
+{
+	BasicScenarioState<T> state;
+	state.Time = t;
+	state.CarDistance = scn.CarStart - t * scn.CarSpeed;
+	state.BikeDistance = scn.BikeStart - t * scn.BikeSpeed;
+	return state;
+}
+
+template <typename T>
+T RunDuration( const BasicScenario<T> &scn )
+{
+	T car = scn.CarSpeed > 0.f ? scn.CarStart / scn.CarSpeed : T(0.f);
+	T bike = scn.BikeSpeed > 0.f ? scn.BikeStart / scn.BikeSpeed : T(0.f);
+	T t = car > bike ? car : bike;
+	return (t > 0.f ? t : T(0.f)) + RUN_MARGIN;
+}
+
+//Bike position relative to the car as right = r0 + r1 * t, ahead = f0 + f1 * t
+template <typename T>
+void RelativeMotion( const BasicScenario<T> &scn, T *r0, T *r1, T *f0, T *f1 )
+{
+	using std::sin;
+	using std::cos;
+
+	T iAngle = scn.AngleIntersection * MODEL_DEG_TO_RAD;
+	T s = sin(iAngle);
+	T c = cos(iAngle);
+
+	*r0 = scn.BikeStart * s;
+	*r1 = -scn.BikeSpeed * s;
+	*f0 = scn.CarStart - scn.BikeStart * c;
+	*f1 = -scn.CarSpeed + scn.BikeSpeed * c;
+}
+
+//Narrow [ *lo, *hi ] to the times where g0 + g1 * t >= 0
+template <typename T>
+void ClipToHalfLine( T g0, T g1, T *lo, T *hi )
+{
+	if (g1 > 0.f)
+	{
+		T t = -g0 / g1;
+		if (t > *lo)
+			*lo = t;
+	}
+	else if (g1 < 0.f)
+	{
+		T t = -g0 / g1;
+		if (t < *hi)
+			*hi = t;
+	}
+	else if (g0 < 0.f)
+	{
+		*hi = *lo - 1.f; //Never true
+	}
+}
+
+//Every condition in BikeInShadow( ) is linear in t, so the bike is hidden over a single interval
+template <typename T>
+void ComputeTrajectoryMetrics( const BasicScenario<T> &scn, BasicTrajectoryMetrics<T> *m )
+{
+	using std::sin;
+	using std::cos;
+	using std::sqrt;
+
+	T r0, r1, f0, f1;
+	RelativeMotion(scn, &r0, &r1, &f0, &f1);
+
+	T lAngle = scn.LeadingAngle * MODEL_DEG_TO_RAD;
+	T tAngle = scn.TrailingAngle * MODEL_DEG_TO_RAD;
+	T cl = cos(lAngle), sl = sin(lAngle);
+	T ct = cos(tAngle), st = sin(tAngle);
+
+	m->Duration = RunDuration(scn);
+
+	//Car before the intersection, right of the leading edge, left of the trailing edge
+	T lo = 0.f;
+	T hi = m->Duration;
+	ClipToHalfLine(scn.CarStart, -scn.CarSpeed, &lo, &hi);
+	ClipToHalfLine(r0 * cl - f0 * sl, r1 * cl - f1 * sl, &lo, &hi);
+	ClipToHalfLine(f0 * st - r0 * ct, f1 * st - r1 * ct, &lo, &hi);
+	if (hi >= lo)
+	{
+		m->HiddenStart = lo;
+		m->HiddenEnd = hi;
+		m->HiddenTime = hi - lo;
+	}
+	else
+	{
+		m->HiddenStart = m->HiddenEnd = -1.f;
+		m->HiddenTime = 0.f;
+	}
+
+	//Separation squared is a quadratic in t with its minimum where the derivative is zero
+	T vv = r1 * r1 + f1 * f1;
+	T t = vv > 0.f ? -(r0 * r1 + f0 * f1) / vv : T(0.f);
+	if (t < 0.f)
+		t = 0.f;
+	if (t > m->Duration)
+		t = m->Duration;
+	T right = r0 + r1 * t;
+	T ahead = f0 + f1 * t;
+	m->MinSeparationTime = t;
+	m->MinSeparation = sqrt(right * right + ahead * ahead);
+	m->Collision = m->MinSeparation < COLLISION_DISTANCE;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*******************************************************
+--------------------- Collision Risk ---------------------
+With everything but BikeStart fixed, the bike's path relative to
+the car is a line whose distance from the driver is
+	sin( AngleIntersection ) * ( CarStart * BikeSpeed - BikeStart * CarSpeed ) / |V|
+with V the relative velocity. It is zero at the constant bearing
+start BikeStart = CarStart * BikeSpeed / CarSpeed and within
+COLLISION_DISTANCE over a window around it.
+
+The proposal for BikeStart is a defensive mixture: the nominal
+uniform with probability RISK_NOMINAL_SHARE, otherwise uniform
+over that window widened by RISK_WINDOW_MARGIN. The nominal share
+keeps every weight below 1 / RISK_NOMINAL_SHARE, so runs that
+collide outside the window (the run starts or ends mid approach)
+are still counted correctly.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "blindspot-model.h"
+#include "collision-risk.h"
+#include "job-system.h"
+#include "qmc.h"
+
+//Runs evaluated by one job
+const int RISK_GRAIN = 1024;
+
+//Share of the proposal that is the nominal distribution, and how much wider
+//than the collision window the rest of it is
+const float RISK_NOMINAL_SHARE = 0.1f;
+const float RISK_WINDOW_MARGIN = 2.f;
+
+//Unit cube dimensions: angle, car speed, bike speed, mixture choice, bike start
+const int RISK_DIMENSIONS = 5;
+
+//Sums over a chunk of runs
+struct RiskPartial
+{
+	double	Weight, Weight2;			//all runs
+	double	Hit, Hit2;					//weight of runs that collide
+	double	Hidden;						//weighted hidden time of runs that collide
+	int		Hits;
+};
+
+struct RiskBatch
+{
+	RiskDistribution			Dist;
+	QmcSequence					Sequence;
+	bool						Importance;
+	std::vector<RiskPartial>	Partial;
+};
+
+
+void RiskDistributionDefault( RiskDistribution *dist )
+{
+	dist->AngleMin = 30.f;
+	dist->AngleMax = 150.f;
+	dist->CarSpeedMin = 8.f;
+	dist->CarSpeedMax = 25.f;
+	dist->BikeSpeedMin = 3.f;
+	dist->BikeSpeedMax = 10.f;
+	dist->CarStart = 100.f;
+	dist->BikeStartMin = 0.f;
+	dist->BikeStartMax = 1000.f;
+	dist->LeadingAngle = 19.4f;
+	dist->TrailingAngle = 27.1f;
+}
+
+//BikeStart for u in [ 0, 1 ) and its weight, nominal density over proposal density
+static float DrawBikeStart( const RiskDistribution &dist, const Scenario &scn, bool importance,
+							float choice, float u, float *weight )
+{
+	float lo = dist.BikeStartMin, hi = dist.BikeStartMax;
+	*weight = 1.f;
+	if (!importance || hi <= lo || scn.CarSpeed <= 0.f)
+		return lo + u * (hi - lo);
+
+	//Window of constant bearing starts, clipped to the nominal range
+	float r0, r1, f0, f1;
+	RelativeMotion(scn, &r0, &r1, &f0, &f1);
+	float sinAngle = fabsf(sinf(scn.AngleIntersection * MODEL_DEG_TO_RAD));
+	float center = scn.CarStart * scn.BikeSpeed / scn.CarSpeed;
+	float half = sinAngle > 0.f ? RISK_WINDOW_MARGIN * COLLISION_DISTANCE * sqrtf(r1 * r1 + f1 * f1) / (sinAngle * scn.CarSpeed) : hi - lo;
+	float wlo = center - half > lo ? center - half : lo;
+	float whi = center + half < hi ? center + half : hi;
+	if (whi <= wlo || whi - wlo >= hi - lo)
+		return lo + u * (hi - lo);
+
+	float start = choice < RISK_NOMINAL_SHARE ? lo + u * (hi - lo) : wlo + u * (whi - wlo);
+	float nominal = 1.f / (hi - lo);
+	float proposal = RISK_NOMINAL_SHARE * nominal;
+	if (start >= wlo && start <= whi)
+		proposal += (1.f - RISK_NOMINAL_SHARE) / (whi - wlo);
+	*weight = nominal / proposal;
+	return start;
+}
+
+static void RiskChunk( void *data, int begin, int end )
+{
+	RiskBatch *batch = (RiskBatch *)data;
+	const RiskDistribution &dist = batch->Dist;
+	std::vector<float> points((end - begin) * RISK_DIMENSIONS);
+	QmcGenerate(batch->Sequence, begin, end - begin, &points[0]);
+
+	RiskPartial sum = { 0., 0., 0., 0., 0., 0 };
+	for (int n = 0; n < end - begin; n++)
+	{
+		const float *u = &points[n * RISK_DIMENSIONS];
+		Scenario scn;
+		scn.AngleIntersection = dist.AngleMin + u[0] * (dist.AngleMax - dist.AngleMin);
+		scn.LeadingAngle = dist.LeadingAngle;
+		scn.TrailingAngle = dist.TrailingAngle;
+		scn.CarStart = dist.CarStart;
+		scn.CarSpeed = dist.CarSpeedMin + u[1] * (dist.CarSpeedMax - dist.CarSpeedMin);
+		scn.BikeSpeed = dist.BikeSpeedMin + u[2] * (dist.BikeSpeedMax - dist.BikeSpeedMin);
+
+		float w;
+		scn.BikeStart = DrawBikeStart(dist, scn, batch->Importance, u[3], u[4], &w);
+
+		TrajectoryMetrics m;
+		ComputeTrajectoryMetrics(scn, &m);
+		sum.Weight += w;
+		sum.Weight2 += (double)w * w;
+		if (m.Collision)
+		{
+			sum.Hit += w;
+			sum.Hit2 += (double)w * w;
+			sum.Hidden += (double)w * m.HiddenTime;
+			sum.Hits++;
+		}
+	}
+	batch->Partial[begin / RISK_GRAIN] = sum;
+}
+
+
+bool EstimateCollisionRisk( const RiskDistribution &dist, int sampler, int samples, bool importance, RiskEstimate *est )
+{
+	if (samples < 2)
+	{
+		fprintf(stderr, "A collision risk needs at least 2 samples\n");
+		return false;
+	}
+
+	RiskBatch batch;
+	batch.Dist = dist;
+	batch.Importance = importance;
+	if (!QmcInit(&batch.Sequence, sampler, RISK_DIMENSIONS, true, 0))
+		return false;
+	batch.Partial.resize((samples + RISK_GRAIN - 1) / RISK_GRAIN);
+	ParallelFor(0, samples, RISK_GRAIN, RiskChunk, &batch);
+
+	RiskPartial total = { 0., 0., 0., 0., 0., 0 };
+	for (size_t i = 0; i < batch.Partial.size(); i++)
+	{
+		const RiskPartial &p = batch.Partial[i];
+		total.Weight += p.Weight;
+		total.Weight2 += p.Weight2;
+		total.Hit += p.Hit;
+		total.Hit2 += p.Hit2;
+		total.Hidden += p.Hidden;
+		total.Hits += p.Hits;
+	}
+
+	//Weighted indicator: mean and the standard error of the mean
+	double p = total.Hit / samples;
+	double var = (total.Hit2 / samples - p * p) * samples / (samples - 1);
+	est->Probability = p;
+	est->StdError = sqrt((var > 0. ? var : 0.) / samples);
+	est->EffectiveSamples = total.Weight2 > 0. ? total.Weight * total.Weight / total.Weight2 : 0.;
+	est->NaiveEquivalent = est->StdError > 0. ? p * (1. - p) / (est->StdError * est->StdError) : 0.;
+	est->CollisionHidden = total.Hit > 0. ? total.Hidden / total.Hit : 0.;
+	est->Samples = samples;
+	est->Hits = total.Hits;
+	return true;
+}
@@ -0,0 +1,50 @@
+/*******************************************************
+--------------------- Collision Risk ---------------------
+Probability that a run ends in a collision when the junction and
+both road users are drawn at random.
+
+Collisions only happen on a constant bearing: the bike has to
+reach the intersection at nearly the same moment as the car, which
+is also what keeps it parked in the blinder's shadow. Under any
+realistic spread of start distances that is a thin sliver of the
+space, so plain sampling almost never lands in it. Importance
+sampling draws BikeStart mostly from the sliver instead and
+weights every run by how much more often it was drawn than it
+would have been, which keeps the estimate unbiased.
+*******************************************************/
+
+#ifndef COLLISION_RISK_H
+#define COLLISION_RISK_H
+
+//Default runs in one estimate
+const int RISK_DEFAULT_SAMPLES = 1 << 20;
+
+//Junctions, speeds and starts to draw from, each uniform over its range
+struct RiskDistribution
+{
+	float	AngleMin, AngleMax;				//AngleIntersection, degrees
+	float	CarSpeedMin, CarSpeedMax;		//meters per second
+	float	BikeSpeedMin, BikeSpeedMax;
+	float	CarStart;						//meters
+	float	BikeStartMin, BikeStartMax;
+	float	LeadingAngle, TrailingAngle;	//the blinder, for the hidden time of colliding runs
+};
+
+struct RiskEstimate
+{
+	double	Probability;			//of a collision
+	double	StdError;
+	double	EffectiveSamples;		//Kish effective sample size of the weights
+	double	NaiveEquivalent;		//plain samples that would give the same StdError
+	double	CollisionHidden;		//mean hidden time of the runs that collide, seconds
+	int		Samples;
+	int		Hits;					//runs that collided
+};
+
+void	RiskDistributionDefault( RiskDistribution * );
+
+//importance false samples the distribution as it is
+//Points come from a scrambled sequence of QmcKind sampler
+bool	EstimateCollisionRisk( const RiskDistribution &, int sampler, int samples, bool importance, RiskEstimate * );
+
+#endif
@@ -0,0 +1,895 @@
+/*******************************************************
+--------------------- Cyclist Batch ---------------------
+Command line companion to the simulation for work that needs no
+window: building lookup tables and evaluating scenarios in bulk.
+
+Usage: cyclist-batch <command> [arguments]
+
+	table <file> [points] [Field=min:max ...]
+		Build or extend a lookup table. points grid points along
+		each slider range; Field=min:max widens one axis on the same
+		grid, and only the blocks that are new get computed.
+
+	lookup <file> <AngleIntersection> <LeadingAngle> <TrailingAngle>
+			<CarStart> <CarSpeed> <BikeStart> <BikeSpeed>
+		Compare the table at one scenario with the exact solution.
+
+	gradient <AngleIntersection> ... <BikeSpeed>
+		Derivatives of hidden time and minimum separation with
+		respect to every field, by automatic differentiation, next
+		to central finite differences as a check.
+
+	pillars [Name=value ...]
+		Find the blinder angles with the least expected hidden time
+		over a spread of junctions. Names are the fields of
+		DesignDistribution and PillarConstraints, plus Samples,
+		LeadingAngle and TrailingAngle for the starting design.
+		Sampler=<random|halton|sobol> picks how the junctions are
+		drawn.
+
+	sobol [samples] [resamples] [Field=min:max ...]
+		First and total order Sobol indices of the hidden time for
+		every field, with bootstrap confidence intervals. Fields are
+		drawn from the slider ranges unless given one; min == max
+		holds a field still. Sampler=<name> as for pillars.
+
+	risk [samples] [Name=value ...] [Method=<naive|importance>]
+		Probability of a collision when the junction, speeds and
+		starts are drawn at random. Names are the fields of
+		RiskDistribution. Without a Method both are run, so the
+		spread of each can be compared; Sampler=<name> as above.
+
+	surrogate <file> [cells] [Field=min:max ...]
+		Fit the surrogate the risk meter can use ( Risk Surrogate ) and show
+		its errors, how often it falls back to the exact model and
+		how long a prediction takes.
+
+	sweep <file> [resume] [Checkpoint=seconds] [Shard=i/n] [Events=<file>]
+			[Field=value | Field=min:max:steps ...]
+		Evaluate a grid of scenarios into a columnar result file.
+		Fields not given stay at the simulation's starting values.
+		Progress is checkpointed to <file>.ckpt every Checkpoint
+		seconds; with resume a sweep that was stopped carries on
+		from its last checkpoint. Shard=i/n runs only shard i of n,
+		into <file>.shard-i-of-n. Events=<file> writes each run's
+		events (hidden, car at the intersection, collision or near
+		miss) to an event log. Prints how small each column was
+		encoded.
+
+		Scenarios=<file> Scenario=<name> starts the grid from a
+		scenario of a scenario file; Field= options then change it.
+
+	merge <file> <shards>
+		Combine the finished shards of a sweep into <file>.
+
+	scenarios <file> [name ...]
+		Check every scenario of a scenario file and list them, or
+		the ones named, with their number of runs and the hidden
+		time and closest approach of their first run.
+
+	sampling [samples] [replicates]
+		Estimate the mean hidden time over the slider ranges with
+		each sampler, replicates times with different scrambles,
+		and show how far apart the estimates are.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <vector>
+
+#include "blindspot-model.h"
+#include "collision-risk.h"
+#include "event-log.h"
+#include "job-system.h"
+#include "lookup-table.h"
+#include "pillar-design.h"
+#include "qmc.h"
+#include "result-store.h"
+#include "scenario-file.h"
+#include "sensitivity.h"
+#include "surrogate.h"
+#include "sweep.h"
+
+//Relative step of the finite differences "gradient" prints for comparison
+const float FD_RELATIVE_STEP = 1e-3f;
+
+//Default points and replicates of each estimate "sampling" compares
+const int SAMPLING_SAMPLES = 4096;
+const int SAMPLING_REPLICATES = 32;
+
+//Scenarios "scenarios" evaluates in one job
+const int SCENARIOS_GRAIN = 256;
+
+//Names of the lookup table metrics for printing, in LookupMetric order
+const char *LUT_METRIC_NAMES[LUT_METRICS] = { "HiddenTime", "MinSeparation", "MinSeparationTime" };
+
+void	Usage( );
+int		TableCommand( int, char *[ ] );
+int		LookupCommand( int, char *[ ] );
+int		GradientCommand( int, char *[ ] );
+int		PillarsCommand( int, char *[ ] );
+int		SobolCommand( int, char *[ ] );
+int		SamplingCommand( int, char *[ ] );
+int		RiskCommand( int, char *[ ] );
+int		SurrogateCommand( int, char *[ ] );
+int		SweepCommand( int, char *[ ] );
+int		MergeCommand( int, char *[ ] );
+int		ScenariosCommand( int, char *[ ] );
+bool	ParseSampler( const char *, int *, bool * );
+
+//A Name=value option of a command
+struct NamedValue
+{
+	const char *	Name;
+	float *			Value;
+};
+
+bool	ParseNamedValues( int, char *[ ], const NamedValue *, int, int * );
+bool	ParseScenario( char *[ ], Scenario * );
+bool	PrintResultFile( const char *, double, const SweepSummary & );
+
+
+int main( int argc, char *argv[ ] )
+{
+	if (argc < 2)
+	{
+		Usage();
+		return 1;
+	}
+
+	JobSystemStart(0, false);
+
+	int result;
+	if (strcmp(argv[1], "table") == 0)
+		result = TableCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "lookup") == 0)
+		result = LookupCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "gradient") == 0)
+		result = GradientCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "pillars") == 0)
+		result = PillarsCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "sobol") == 0)
+		result = SobolCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "risk") == 0)
+		result = RiskCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "surrogate") == 0)
+		result = SurrogateCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "sweep") == 0)
+		result = SweepCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "merge") == 0)
+		result = MergeCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "scenarios") == 0)
+		result = ScenariosCommand(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "sampling") == 0)
+		result = SamplingCommand(argc - 2, argv + 2);
+	else
+	{
+		fprintf(stderr, "Unknown command '%s'\n", argv[1]);
+		Usage();
+		result = 1;
+	}
+
+	JobSystemStop();
+	return result;
+}
+
+void Usage( )
+{
+	fprintf(stderr, "Usage: cyclist-batch <command> [arguments]\n\n");
+	fprintf(stderr, "  table <file> [points] [Field=min:max ...]\n");
+	fprintf(stderr, "      build or extend a lookup table (default %d points per axis)\n", LUT_DEFAULT_POINTS);
+	fprintf(stderr, "  lookup <file> <AngleIntersection> <LeadingAngle> <TrailingAngle> <CarStart> <CarSpeed> <BikeStart> <BikeSpeed>\n");
+	fprintf(stderr, "      compare the table at one scenario with the exact solution\n");
+	fprintf(stderr, "  gradient <AngleIntersection> ... <BikeSpeed>\n");
+	fprintf(stderr, "      derivatives of hidden time and minimum separation with respect to every field\n");
+	fprintf(stderr, "  pillars [Name=value ...]\n");
+	fprintf(stderr, "      blinder angles with the least expected hidden time over a spread of junctions\n");
+	fprintf(stderr, "  sobol [samples] [resamples] [Field=min:max ...]\n");
+	fprintf(stderr, "      Sobol sensitivity indices of the hidden time (default %d samples, %d resamples)\n",
+			SOBOL_DEFAULT_SAMPLES, SOBOL_DEFAULT_RESAMPLES);
+	fprintf(stderr, "  risk [samples] [Name=value ...] [Method=<naive|importance>]\n");
+	fprintf(stderr, "      collision probability over random junctions (default %d samples)\n", RISK_DEFAULT_SAMPLES);
+	fprintf(stderr, "  surrogate <file> [cells] [Field=min:max ...]\n");
+	fprintf(stderr, "      fit the surrogate the risk meter can use (default at most %d cells)\n", SURROGATE_DEFAULT_LEAVES);
+	fprintf(stderr, "  sweep <file> [resume] [Checkpoint=seconds] [Shard=i/n] [Events=<file>] [Scenarios=<file> Scenario=<name>]\n");
+	fprintf(stderr, "        [Field=value | Field=min:max:steps ...]\n");
+	fprintf(stderr, "      evaluate a grid of scenarios into a columnar result file (checkpoint every %d s)\n", SWEEP_CHECKPOINT_SECONDS);
+	fprintf(stderr, "  merge <file> <shards>\n");
+	fprintf(stderr, "      combine the finished shards of a sweep\n");
+	fprintf(stderr, "  scenarios <file> [name ...]\n");
+	fprintf(stderr, "      check a scenario file and list its scenarios\n");
+	fprintf(stderr, "  sampling [samples] [replicates]\n");
+	fprintf(stderr, "      spread of the mean hidden time estimated with each sampler\n");
+	fprintf(stderr, "\n  pillars, sobol and risk take Sampler=<random|halton|sobol>, sobol by default\n");
+}
+
+//table <file> [points] [Field=min:max ...]
+int TableCommand( int argc, char *argv[ ] )
+{
+	if (argc < 1)
+	{
+		Usage();
+		return 1;
+	}
+
+	int arg = 1;
+	int points = LUT_DEFAULT_POINTS;
+	if (arg < argc && strchr(argv[arg], '=') == NULL)
+		points = atoi(argv[arg++]);
+
+	LookupGrid grid;
+	LookupGridDefault(points, &grid);
+
+	//Wider ranges keep the grid points where they are and add more of them
+	for (; arg < argc; arg++)
+	{
+		char name[64];
+		float lo, hi;
+		if (sscanf(argv[arg], "%63[^=]=%f:%f", name, &lo, &hi) != 3 || lo > hi)
+		{
+			fprintf(stderr, "Expected Field=min:max, not '%s'\n", argv[arg]);
+			return 1;
+		}
+		int field = FindScenarioField(name);
+		if (field < 0)
+		{
+			fprintf(stderr, "Unknown scenario field '%s'\n", name);
+			return 1;
+		}
+		grid.Lo[field] = (int)floorf((lo - grid.Origin[field]) / grid.Step[field]);
+		grid.Hi[field] = (int)ceilf((hi - grid.Origin[field]) / grid.Step[field]);
+	}
+
+	if (!LookupTableBuild(argv[0], grid))
+		return 1;
+
+	LookupTable table;
+	if (!LookupTableOpen(argv[0], &table))
+		return 1;
+	fprintf(stderr, "Error against the exact solution over %d random scenarios:\n", LUT_ERROR_SAMPLES);
+	for (int m = 0; m < LUT_METRICS; m++)
+		fprintf(stderr, "  %-18s max %10.4f  mean %10.4f\n", LUT_METRIC_NAMES[m], table.Header->MaxError[m], table.Header->MeanError[m]);
+	LookupTableClose(&table);
+	return 0;
+}
+
+//lookup <file> <seven scenario fields>
+int LookupCommand( int argc, char *argv[ ] )
+{
+	if (argc != 1 + SCN_FIELDS)
+	{
+		Usage();
+		return 1;
+	}
+
+	Scenario scn;
+	if (!ParseScenario(argv + 1, &scn))
+		return 1;
+
+	LookupTable table;
+	if (!LookupTableOpen(argv[0], &table))
+		return 1;
+
+	float interpolated[LUT_METRICS], exact[LUT_METRICS];
+	bool inside = LookupTableEval(table, scn, interpolated);
+	LookupExact(scn, exact);
+
+	if (!inside)
+		printf("Scenario is outside the table, the nearest edge was used\n");
+	printf("%-18s %10s %10s %10s %10s\n", "Metric", "Table", "Exact", "Error", "MaxError");
+	for (int m = 0; m < LUT_METRICS; m++)
+		printf("%-18s %10.4f %10.4f %10.4f %10.4f\n", LUT_METRIC_NAMES[m], interpolated[m], exact[m],
+			   fabsf(interpolated[m] - exact[m]), table.Header->MaxError[m]);
+
+	LookupTableClose(&table);
+	return 0;
+}
+
+//gradient <seven scenario fields>
+int GradientCommand( int argc, char *argv[ ] )
+{
+	if (argc != SCN_FIELDS)
+	{
+		Usage();
+		return 1;
+	}
+
+	Scenario scn;
+	if (!ParseScenario(argv, &scn))
+		return 1;
+
+	TrajectoryGradient grad;
+	ComputeTrajectoryGradient(scn, &grad);
+	printf("HiddenTime %.4f s, MinSeparation %.4f m\n\n", grad.Metrics.HiddenTime, grad.Metrics.MinSeparation);
+
+	printf("%-18s %12s %12s %12s %12s\n", "Field", "dHidden", "(finite)", "dSeparation", "(finite)");
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		float value = GetScenarioField(scn, i);
+		float h = FD_RELATIVE_STEP * (fabsf(value) > 1.f ? fabsf(value) : 1.f);
+		Scenario lo = scn, hi = scn;
+		SetScenarioField(&lo, i, value - h);
+		SetScenarioField(&hi, i, value + h);
+		TrajectoryMetrics mlo, mhi;
+		ComputeTrajectoryMetrics(lo, &mlo);
+		ComputeTrajectoryMetrics(hi, &mhi);
+
+		printf("%-18s %12.5f %12.5f %12.5f %12.5f\n", SCENARIO_NAMES[i],
+			   grad.HiddenTime[i], (mhi.HiddenTime - mlo.HiddenTime) / (2.f * h),
+			   grad.MinSeparation[i], (mhi.MinSeparation - mlo.MinSeparation) / (2.f * h));
+	}
+	return 0;
+}
+
+//pillars [Name=value ...]
+int PillarsCommand( int argc, char *argv[ ] )
+{
+	DesignDistribution dist;
+	PillarConstraints cons;
+	DesignDistributionDefault(&dist);
+	PillarConstraintsDefault(&cons);
+	float samples = (float)PILLAR_DEFAULT_SAMPLES;
+	float leading = 19.4f, trailing = 27.1f;	//the GUI's starting design
+	int sampler = QMC_SOBOL;
+
+	NamedValue options[] =
+	{
+		{ "AngleMin", &dist.AngleMin },				{ "AngleMax", &dist.AngleMax },
+		{ "CarSpeedMin", &dist.CarSpeedMin },		{ "CarSpeedMax", &dist.CarSpeedMax },
+		{ "BikeSpeedMin", &dist.BikeSpeedMin },		{ "BikeSpeedMax", &dist.BikeSpeedMax },
+		{ "ArrivalSpread", &dist.ArrivalSpread },	{ "CarStart", &dist.CarStart },
+		{ "MinWidth", &cons.MinWidth },				{ "LeadingMin", &cons.LeadingMin },
+		{ "TrailingMax", &cons.TrailingMax },		{ "Samples", &samples },
+		{ "LeadingAngle", &leading },				{ "TrailingAngle", &trailing }
+	};
+	if (!ParseNamedValues(argc, argv, options, sizeof(options) / sizeof(options[0]), &sampler))
+		return 1;
+
+	PillarDesign design;
+	if (!OptimizePillars(dist, cons, sampler, (int)samples, leading, trailing, &design))
+		return 1;
+
+	printf("Start:  leading %7.3f, trailing %7.3f, width %.3f m, expected hidden %.4f s\n",
+		   leading, trailing, PillarWidth(leading, trailing), design.StartHidden);
+	printf("Design: leading %7.3f, trailing %7.3f, width %.3f m, expected hidden %.4f s\n",
+		   design.LeadingAngle, design.TrailingAngle, PillarWidth(design.LeadingAngle, design.TrailingAngle), design.ExpectedHidden);
+	const char *outcome = design.Converged ? "Converged" : design.Stalled ? "Stopped, the line search stalled," : "Stopped";
+	printf("%s after %d iterations, %d evaluations of %d junctions\n", outcome, design.Iterations, design.Evaluations, (int)samples);
+	return 0;
+}
+
+//sobol [samples] [resamples] [Field=min:max ...]
+int SobolCommand( int argc, char *argv[ ] )
+{
+	int arg = 0;
+	int samples = SOBOL_DEFAULT_SAMPLES, resamples = SOBOL_DEFAULT_RESAMPLES;
+	if (arg < argc && strchr(argv[arg], '=') == NULL)
+		samples = atoi(argv[arg++]);
+	if (arg < argc && strchr(argv[arg], '=') == NULL)
+		resamples = atoi(argv[arg++]);
+
+	int sampler = QMC_SOBOL;
+	SensitivityRange range;
+	SensitivityRangeDefault(&range);
+	for (; arg < argc; arg++)
+	{
+		bool known;
+		if (ParseSampler(argv[arg], &sampler, &known))
+		{
+			if (!known)
+				return 1;
+			continue;
+		}
+
+		char name[64];
+		float lo, hi;
+		if (sscanf(argv[arg], "%63[^=]=%f:%f", name, &lo, &hi) != 3 || lo > hi)
+		{
+			fprintf(stderr, "Expected Field=min:max, not '%s'\n", argv[arg]);
+			return 1;
+		}
+		int field = FindScenarioField(name);
+		if (field < 0)
+		{
+			fprintf(stderr, "Unknown scenario field '%s'\n", name);
+			return 1;
+		}
+		range.Lo[field] = lo;
+		range.Hi[field] = hi;
+	}
+
+	SensitivityIndices indices;
+	if (!SobolIndices(range, sampler, samples, resamples, &indices))
+		return 1;
+
+	printf("HiddenTime mean %.4f s, variance %.4f, %d evaluations\n\n", indices.Mean, indices.Variance, indices.Evaluations);
+	printf("%-18s %8s %20s %8s %20s\n", "Field", "First", "(interval)", "Total", "(interval)");
+	for (int i = 0; i < SCN_FIELDS; i++)
+		printf("%-18s %8.4f   [%7.4f, %7.4f] %8.4f   [%7.4f, %7.4f]\n", SCENARIO_NAMES[i],
+			   indices.First[i], indices.FirstLo[i], indices.FirstHi[i],
+			   indices.Total[i], indices.TotalLo[i], indices.TotalHi[i]);
+	printf("\nIntervals are %.0f%% over %d bootstrap resamples\n", 100.f * SOBOL_CONFIDENCE, resamples);
+	return 0;
+}
+
+//risk [samples] [Name=value ...] [Method=<naive|importance>], options in any order
+int RiskCommand( int argc, char *argv[ ] )
+{
+	int arg = 0;
+	int samples = RISK_DEFAULT_SAMPLES;
+	if (arg < argc && strchr(argv[arg], '=') == NULL)
+		samples = atoi(argv[arg++]);
+
+	bool runNaive = true, runImportance = true;
+	RiskDistribution dist;
+	RiskDistributionDefault(&dist);
+	int sampler = QMC_SOBOL;
+	NamedValue options[] =
+	{
+		{ "AngleMin", &dist.AngleMin },				{ "AngleMax", &dist.AngleMax },
+		{ "CarSpeedMin", &dist.CarSpeedMin },		{ "CarSpeedMax", &dist.CarSpeedMax },
+		{ "BikeSpeedMin", &dist.BikeSpeedMin },		{ "BikeSpeedMax", &dist.BikeSpeedMax },
+		{ "CarStart", &dist.CarStart },
+		{ "BikeStartMin", &dist.BikeStartMin },		{ "BikeStartMax", &dist.BikeStartMax },
+		{ "LeadingAngle", &dist.LeadingAngle },		{ "TrailingAngle", &dist.TrailingAngle }
+	};
+	//Method is not a number, so it is picked out here and everything else is left to ParseNamedValues( )
+	for (; arg < argc; arg++)
+	{
+		if (strncmp(argv[arg], "Method=", 7) == 0)
+		{
+			const char *method = argv[arg] + 7;
+			runNaive = strcmp(method, "naive") == 0;
+			runImportance = strcmp(method, "importance") == 0;
+			if (!runNaive && !runImportance)
+			{
+				fprintf(stderr, "Unknown method '%s'\n", method);
+				return 1;
+			}
+			continue;
+		}
+		if (!ParseNamedValues(1, argv + arg, options, sizeof(options) / sizeof(options[0]), &sampler))
+			return 1;
+	}
+
+	printf("%-11s %12s %12s %8s %12s %14s %10s\n", "Method", "Probability", "StdError", "Hits", "ESS", "Naive equiv.", "Hidden");
+	for (int importance = 0; importance < 2; importance++)
+	{
+		if (!(importance ? runImportance : runNaive))
+			continue;
+
+		RiskEstimate est;
+		if (!EstimateCollisionRisk(dist, sampler, samples, importance != 0, &est))
+			return 1;
+		printf("%-11s %12.4e %12.4e %8d %12.0f %14.4g %10.3f\n", importance ? "importance" : "naive",
+			   est.Probability, est.StdError, est.Hits, est.EffectiveSamples, est.NaiveEquivalent, est.CollisionHidden);
+	}
+	printf("\n%d samples each. ESS is the Kish effective sample size of the weights; Naive equiv. is how many\n"
+		   "plain samples give the same StdError; Hidden is the mean hidden time of runs that collide, seconds\n", samples);
+	return 0;
+}
+
+//surrogate <file> [cells] [Field=min:max ...]
+int SurrogateCommand( int argc, char *argv[ ] )
+{
+	if (argc < 1)
+	{
+		Usage();
+		return 1;
+	}
+
+	int arg = 1;
+	int cells = SURROGATE_DEFAULT_LEAVES;
+	if (arg < argc && strchr(argv[arg], '=') == NULL)
+		cells = atoi(argv[arg++]);
+
+	float lo[SCN_FIELDS], hi[SCN_FIELDS];
+	SurrogateRangeDefault(lo, hi);
+	for (; arg < argc; arg++)
+	{
+		char name[64];
+		float a, b;
+		if (sscanf(argv[arg], "%63[^=]=%f:%f", name, &a, &b) != 3 || a > b)
+		{
+			fprintf(stderr, "Expected Field=min:max, not '%s'\n", argv[arg]);
+			return 1;
+		}
+		int field = FindScenarioField(name);
+		if (field < 0)
+		{
+			fprintf(stderr, "Unknown scenario field '%s'\n", name);
+			return 1;
+		}
+		lo[field] = a;
+		hi[field] = b;
+	}
+
+	if (!SurrogateBuild(argv[0], lo, hi, cells))
+		return 1;
+	Surrogate model;
+	if (!SurrogateLoad(argv[0], &model))
+		return 1;
+
+	//Time per prediction against the exact model, over fresh random scenarios
+	const int checks = SURROGATE_VALIDATION_SAMPLES;
+	QmcSequence seq;
+	QmcInit(&seq, QMC_RANDOM, SCN_FIELDS, true, 2);
+	std::vector<Scenario> scns(checks);
+	for (int n = 0; n < checks; n++)
+	{
+		float u[SCN_FIELDS];
+		QmcGenerate(seq, n, 1, u);
+		for (int i = 0; i < SCN_FIELDS; i++)
+			SetScenarioField(&scns[n], i, lo[i] + u[i] * (hi[i] - lo[i]));
+	}
+
+	float sink = 0.f;
+	clock_t start = clock();
+	for (int n = 0; n < checks; n++)
+	{
+		SurrogatePrediction p;
+		SurrogatePredict(model, scns[n], &p);
+		sink += p.Value[SUR_HIDDEN_TIME];
+	}
+	double predictTime = (double)(clock() - start) / CLOCKS_PER_SEC / checks;
+	start = clock();
+	for (int n = 0; n < checks; n++)
+	{
+		float values[SUR_OUTPUTS];
+		SurrogateExact(scns[n], values);
+		sink += values[SUR_HIDDEN_TIME];
+	}
+	double exactTime = (double)(clock() - start) / CLOCKS_PER_SEC / checks;
+
+	//Of the answers the surrogate gives itself, how many are inside the tolerance
+	int answered = 0, inside = 0;
+	for (int n = 0; n < checks; n++)
+	{
+		SurrogatePrediction p;
+		if (SurrogateEval(model, scns[n], SURROGATE_TOLERANCE, &p))
+			continue;
+		float exact[SUR_OUTPUTS];
+		SurrogateExact(scns[n], exact);
+		answered++;
+		if (fabsf(p.Value[SUR_HIDDEN_TIME] - exact[SUR_HIDDEN_TIME]) <= SURROGATE_TOLERANCE[SUR_HIDDEN_TIME] &&
+			fabsf(p.Value[SUR_MARGIN] - exact[SUR_MARGIN]) <= SURROGATE_TOLERANCE[SUR_MARGIN])
+			inside++;
+	}
+
+	const SurrogateHeader &h = model.Header;
+	const char *names[SUR_OUTPUTS] = { "HiddenTime", "Margin" };
+	printf("%u cells, %u nodes\n\n", h.Leaves, h.Nodes);
+	printf("%-12s %10s %10s %10s %10s\n", "Output", "RmsError", "MaxError", "Coverage", "Tolerance");
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+		printf("%-12s %10.4f %10.4f %10.3f %10.4f\n", names[o], h.RmsError[o], h.MaxError[o], h.Coverage[o], SURROGATE_TOLERANCE[o]);
+	printf("\n%.1f%% of held back scenarios fall back to the exact model\n", 100.f * h.Fallback);
+	printf("%.1f%% of the answers it gives itself are inside the tolerance\n", answered > 0 ? 100.f * inside / answered : 0.f);
+	printf("Prediction %.0f ns, exact model %.0f ns (checksum %g)\n", predictTime * 1e9, exactTime * 1e9, sink);
+	return 0;
+}
+
+//sweep <file> [resume] [Checkpoint=seconds] [Shard=i/n] [Events=<file>] [Field=value | Field=min:max:steps ...]
+int SweepCommand( int argc, char *argv[ ] )
+{
+	if (argc < 1)
+	{
+		Usage();
+		return 1;
+	}
+
+	SweepSpec spec;
+	SweepSpecDefault(&spec);
+	SweepOptions options;
+	SweepOptionsDefault(&options);
+	const char *events = NULL;
+
+	//A scenario is the starting point whatever order the options come in
+	const char *scenarios = NULL, *scenario = NULL;
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (strncmp(argv[arg], "Scenarios=", 10) == 0)
+			scenarios = argv[arg] + 10;
+		else if (strncmp(argv[arg], "Scenario=", 9) == 0)
+			scenario = argv[arg] + 9;
+	}
+	if ((scenarios == NULL) != (scenario == NULL))
+	{
+		fprintf(stderr, "Scenarios=<file> and Scenario=<name> go together\n");
+		return 1;
+	}
+	if (scenarios != NULL)
+	{
+		ScenarioFile file;
+		if (!ScenarioFileOpen(scenarios, &file))
+			return 1;
+		int index = ScenarioFind(file, scenario);
+		if (index >= 0)
+			spec = file.Entries[index].Spec;
+		ScenarioFileClose(&file);
+		if (index < 0)
+		{
+			fprintf(stderr, "No scenario '%s' in %s\n", scenario, scenarios);
+			return 1;
+		}
+	}
+
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (strncmp(argv[arg], "Events=", 7) == 0)
+		{
+			events = argv[arg] + 7;
+			continue;
+		}
+		if (strncmp(argv[arg], "Scenarios=", 10) == 0 || strncmp(argv[arg], "Scenario=", 9) == 0)
+			continue;
+		if (strcmp(argv[arg], "resume") == 0)
+		{
+			options.Resume = true;
+			continue;
+		}
+		if (sscanf(argv[arg], "Checkpoint=%d", &options.CheckpointSeconds) == 1 ||
+			sscanf(argv[arg], "Shard=%d/%d", &options.Shard, &options.Shards) == 2)
+			continue;
+
+		char name[64];
+		float lo, hi;
+		int steps = 1;
+		int n = sscanf(argv[arg], "%63[^=]=%f:%f:%d", name, &lo, &hi, &steps);
+		if (n == 2)
+			hi = lo;
+		else if (n != 4 || lo > hi || steps < 1)
+		{
+			fprintf(stderr, "Expected Field=value or Field=min:max:steps, not '%s'\n", argv[arg]);
+			return 1;
+		}
+		int field = FindScenarioField(name);
+		if (field < 0)
+		{
+			fprintf(stderr, "Unknown scenario field '%s'\n", name);
+			return 1;
+		}
+		spec.Lo[field] = lo;
+		spec.Hi[field] = hi;
+		spec.Steps[field] = steps;
+	}
+
+	if (events != NULL && !EventLogOpen(events, true))
+		return 1;
+
+	//Wall time: clock( ) would add up the CPU time of every worker
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SweepSummary summary;
+	bool ok = RunSweep(spec, argv[0], options, &summary);
+	EventLogClose();
+	if (!ok)
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return PrintResultFile(SweepOutputPath(argv[0], options).c_str(), seconds, summary) ? 0 : 1;
+}
+
+//merge <file> <shards>
+int MergeCommand( int argc, char *argv[ ] )
+{
+	if (argc < 2)
+	{
+		Usage();
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SweepSummary summary;
+	if (!MergeSweep(argv[0], atoi(argv[1]), &summary))
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return PrintResultFile(argv[0], seconds, summary) ? 0 : 1;
+}
+
+//The first run of each scenario, on the job system
+struct ScenarioBatch
+{
+	const ScenarioFile *			File;
+	std::vector<int>				Indices;
+	std::vector<TrajectoryMetrics>	Metrics;
+};
+
+static void EvaluateScenarios( void *data, int begin, int end )
+{
+	ScenarioBatch *batch = (ScenarioBatch *)data;
+	for (int i = begin; i < end; i++)
+	{
+		Scenario scn;
+		SweepScenario(batch->File->Entries[batch->Indices[i]].Spec, 0, &scn);
+		ComputeTrajectoryMetrics(scn, &batch->Metrics[i]);
+	}
+}
+
+//scenarios <file> [name ...]
+int ScenariosCommand( int argc, char *argv[ ] )
+{
+	if (argc < 1)
+	{
+		Usage();
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ScenarioFile file;
+	if (!ScenarioFileOpen(argv[0], &file))
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	ScenarioBatch batch;
+	batch.File = &file;
+	for (int arg = 1; arg < argc; arg++)
+	{
+		int index = ScenarioFind(file, argv[arg]);
+		if (index < 0)
+		{
+			fprintf(stderr, "No scenario '%s' in %s\n", argv[arg], argv[0]);
+			ScenarioFileClose(&file);
+			return 1;
+		}
+		batch.Indices.push_back(index);
+	}
+	if (argc == 1)
+	{
+		for (int i = 0; i < (int)file.Entries.size(); i++)
+			batch.Indices.push_back(i);
+	}
+
+	int count = (int)batch.Indices.size();
+	batch.Metrics.resize(count);
+	ParallelFor(0, count, SCENARIOS_GRAIN, EvaluateScenarios, &batch);
+
+	unsigned long long rows = 0;
+	printf("%-32s %14s %10s %10s %9s\n", "Scenario", "Runs", "Hidden", "MinSep", "Collision");
+	for (int i = 0; i < count; i++)
+	{
+		const ScenarioEntry &e = file.Entries[batch.Indices[i]];
+		const TrajectoryMetrics &m = batch.Metrics[i];
+		unsigned long long runs = SweepRows(e.Spec);
+		rows += runs;
+		printf("%-32s %14llu %10.4f %10.4f %9s\n", ScenarioName(e).c_str(), runs, m.HiddenTime, m.MinSeparation,
+			   m.Collision ? "yes" : "no");
+	}
+	printf("\n%d of %d scenarios, %llu runs; file checked in %.4f s\n", count, (int)file.Entries.size(), rows, seconds);
+	ScenarioFileClose(&file);
+	return 0;
+}
+
+//sampling [samples] [replicates]
+int SamplingCommand( int argc, char *argv[ ] )
+{
+	int samples = argc > 0 ? atoi(argv[0]) : SAMPLING_SAMPLES;
+	int replicates = argc > 1 ? atoi(argv[1]) : SAMPLING_REPLICATES;
+	if (samples < 1 || replicates < 2)
+	{
+		Usage();
+		return 1;
+	}
+
+	SensitivityRange range;
+	SensitivityRangeDefault(&range);
+
+	double spread[QMC_KINDS];
+	printf("%-8s %12s %12s %16s\n", "Sampler", "Mean", "StdError", "Samples for same");
+	for (int kind = 0; kind < QMC_KINDS; kind++)
+	{
+		double sum = 0., sum2 = 0.;
+		for (int r = 0; r < replicates; r++)
+		{
+			QmcSequence seq;
+			QmcInit(&seq, kind, SCN_FIELDS, true, (unsigned int)r);
+			double mean = MeanHiddenTime(range, seq, samples);
+			sum += mean;
+			sum2 += mean * mean;
+		}
+		double mean = sum / replicates;
+		double var = (sum2 - replicates * mean * mean) / (replicates - 1);
+		spread[kind] = sqrt(var > 0. ? var : 0.);
+
+		//Random sampling needs this many points for the same standard error
+		double equivalent = spread[kind] > 0. ? samples * (spread[QMC_RANDOM] / spread[kind]) * (spread[QMC_RANDOM] / spread[kind]) : 0.;
+		printf("%-8s %12.5f %12.5f %16.0f\n", QMC_NAMES[kind], mean, spread[kind], equivalent);
+	}
+	printf("\n%d samples, %d scrambles each; the last column is what random sampling would need\n", samples, replicates);
+	return 0;
+}
+
+//Sampler=<name>; false if arg is not a sampler option at all
+//*known is false, with the name reported, if it is not a sampler there is
+bool ParseSampler( const char *arg, int *sampler, bool *known )
+{
+	if (strncmp(arg, "Sampler=", 8) != 0)
+		return false;
+
+	int kind = QmcFindKind(arg + 8);
+	*known = kind >= 0;
+	if (kind < 0)
+		fprintf(stderr, "Unknown sampler '%s'; expected random, halton or sobol\n", arg + 8);
+	else
+		*sampler = kind;
+	return true;
+}
+
+//Name=value options into their variables, and Sampler=<name> into sampler
+bool ParseNamedValues( int argc, char *argv[ ], const NamedValue *options, int numOptions, int *sampler )
+{
+	for (int arg = 0; arg < argc; arg++)
+	{
+		bool known;
+		if (ParseSampler(argv[arg], sampler, &known))
+		{
+			if (!known)
+				return false;
+			continue;
+		}
+
+		char name[64];
+		float value;
+		int o = numOptions;
+		if (sscanf(argv[arg], "%63[^=]=%f", name, &value) == 2)
+		{
+			for (o = 0; o < numOptions && strcmp(name, options[o].Name) != 0; o++)
+				;
+		}
+		if (o == numOptions)
+		{
+			fprintf(stderr, "Expected Name=value with a known name, not '%s'\n", argv[arg]);
+			return false;
+		}
+		*options[o].Value = value;
+	}
+	return true;
+}
+
+//Seven numbers in ScenarioField order
+bool ParseScenario( char *argv[ ], Scenario *scn )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		char *end;
+		float value = (float)strtod(argv[i], &end);
+		if (end == argv[i] || *end != '\0')
+		{
+			fprintf(stderr, "Expected a number for %s, not '%s'\n", SCENARIO_NAMES[i], argv[i]);
+			return false;
+		}
+		SetScenarioField(scn, i, value);
+	}
+	return true;
+}
+
+//Rows, encoded size of each column against plain floats and how often each encoding won, and the sweep's totals
+bool PrintResultFile( const char *path, double seconds, const SweepSummary &summary )
+{
+	ResultFile rf;
+	if (!ResultFileOpen(path, &rf))
+		return false;
+
+	const char *encodings[4] = { "raw", "const", "dict", "delta" };
+	printf("%llu rows in %u chunks, %.1f s\n\n", rf.Rows, (unsigned int)rf.Chunks.size(), seconds);
+	printf("%-18s %12s %8s %6s %6s %6s %6s\n", "Column", "Bytes", "Ratio", encodings[0], encodings[1], encodings[2], encodings[3]);
+	for (int col = 0; col < RESULT_COLUMNS; col++)
+	{
+		unsigned long long bytes = 0;
+		int used[4] = { 0, 0, 0, 0 };
+		for (size_t c = 0; c < rf.Chunks.size(); c++)
+		{
+			bytes += rf.Chunks[c]->Column[col].Bytes;
+			used[rf.Chunks[c]->Column[col].Encoding]++;
+		}
+		printf("%-18s %12llu %8.2f %6d %6d %6d %6d\n", RESULT_COLUMN_NAMES[col], bytes,
+			   bytes > 0 ? (double)(rf.Rows * sizeof(float)) / bytes : 0., used[0], used[1], used[2], used[3]);
+	}
+	printf("\n%llu bytes on disk, %llu as plain floats\n", (unsigned long long)rf.File.Size, rf.Rows * RESULT_COLUMNS * sizeof(float));
+	printf("%llu collisions, mean hidden time %.6f s, longest %.4f s\n", summary.Collisions,
+		   summary.Rows > 0 ? summary.HiddenSum / summary.Rows : 0., summary.HiddenMax);
+	ResultFileClose(&rf);
+	return true;
+}
@@ -25,6 +25,7 @@ Bike: 39m (128 ft)
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 #define _USE_MATH_DEFINES
@@ -34,6 +35,8 @@ Bike: 39m (128 ft)
 #include <windows.h>
 #pragma warning(disable:4996)
 #include "Dependencies/glew.h"
+#else
+#define GL_GLEXT_PROTOTYPES
 #endif
 
 #include <GL/gl.h>
@@ -41,6 +44,22 @@ Bike: 39m (128 ft)
 #include "Dependencies/freeglut.h"
 #include "Dependencies/glui.h"
 
+#include "blindspot-model.h"
+#include "event-log.h"
+#include "job-system.h"
+#include "log.h"
+#include "lookup-table.h"
+#include "metrics-cache.h"
+#include "metrics-log.h"
+#include "metrics-precompute.h"
+#include "scenario-file.h"
+#include "scenario-watch.h"
+#include "sim-thread.h"
+#include "startup.h"
+#include "surrogate.h"
+#include "trajectory-recorder.h"
+#include "visibility-raster.h"
+
 // title of these windows:
 const char *WINDOWTITLE = { "Cyclist Collision Visual - Jonathan Jones" };
 const char *GLUITITLE   = { "User Interface Window" };
@@ -96,6 +115,17 @@ enum ButtonVals
 	QUIT
 };
 
+// which checkbox:
+enum CheckboxVals
+{
+	METRICS_LOG,
+	EVENT_LOG,
+	RECORD,
+	PLAYBACK,
+	LOOKUP,
+	RISK_SURROGATE
+};
+
 // window background color (rgba):
 const GLfloat BACKCOLOR[ ] = { .258, .525, .956, 1. };
 
@@ -103,6 +133,41 @@ const GLfloat BACKCOLOR[ ] = { .258, .525, .956, 1. };
 // line width for the axes:
 const GLfloat AXES_WIDTH   = { 3. };
 
+//GPU occlusion queries kept in flight so results never stall the pipeline
+const int OCCLUSION_QUERIES = 4;
+
+//Per-frame metrics log file
+const char *METRICS_LOG_FILE = { "metrics.csv" };
+
+//Events of the simulated runs, written while "Event Log" is checked
+const char *EVENT_LOG_FILE = { "events.bin" };
+
+//Trajectory recording written by "Record" and read by "Play Recording"
+const char *TRAJECTORY_FILE = { "trajectory.bin" };
+
+//Metrics of runs worked out in earlier sessions
+const char *METRICS_CACHE_FILE = { "metrics-cache.bin" };
+
+//Table of metrics built with "cyclist-batch table", for instant what-if numbers
+const char *LOOKUP_TABLE_FILE = { "metrics-table.bin" };
+
+//Surrogate built with "cyclist-batch surrogate", behind the risk meter when "Risk Surrogate" is checked
+const char *SURROGATE_FILE = { "metrics-surrogate.bin" };
+
+//Collision margin at which the risk meter reads empty, in meters
+const float RISK_METER_RANGE = 10.f;
+
+//Worker threads for background work (0 = one per core, less one for the GUI)
+const int  JOB_WORKERS = 0;
+const bool JOB_PIN_WORKERS = false;
+
+//Longest time to collision the overlay graph shows, in seconds
+const float TTC_GRAPH_MAX = 10.f;
+
+//Playback speed range
+const float TIMESCALE_MIN = 0.01f;
+const float TIMESCALE_MAX = 1000.f;
+
 //Fog parameters
 const GLfloat FOGCOLOR[4] = { .0, .0, .0, 1. };
 const GLenum  FOGMODE     = { GL_LINEAR };
@@ -116,7 +181,7 @@ int		ActiveButton;			// current button that is down
 GLuint	AxesList;				// list to hold the axes
 int		AxesOn;					// != 0 means to draw the axes
 int		ViewType = 0;			// 0 = Car view, 1 = Intersection view
-int		DebugOn;				// != 0 means to print debugging info
+int		DebugOn;				// != 0 means to log debugging info
 int		MainWindow;				// window id for main graphics window
 float	Scale, Scale2;			// scaling factors
 int		Xmouse, Ymouse;			// mouse values
@@ -131,6 +196,46 @@ GLuint	GroundList;
 GLuint	RoadList;
 GLuint	BikeList;
 
+//Software rasterized visibility of the bike from the driver's eye
+int		RasterOn;				// != 0 means to measure visible bike pixels each frame
+RasterTarget		Raster;
+RasterVisibility	RasterResult;
+
+//GPU occlusion query of the bike in the car interior view
+int		OcclusionOn;			// != 0 means to query visible bike samples each frame
+bool	OcclusionSupported;		//needs OpenGL 1.5 or ARB_occlusion_query
+GLuint	OcclusionQueries[OCCLUSION_QUERIES];
+int		OcclusionFrame[OCCLUSION_QUERIES];	//frame that issued each query, -1 if idle
+int		OcclusionSamples = METRICS_NONE;	//latest result that came back
+
+int		MetricsLogOn;			// != 0 means to write a row per frame to METRICS_LOG_FILE
+int		FrameNumber;			//frames drawn since startup
+int		EventLogOn;				// != 0 means the simulation's events go to EVENT_LOG_FILE
+
+//Metrics of the whole run, worked out in the background whenever it changes
+int					TrajectoryMetricsOn;	// != 0 means to show them in the overlay
+bool				MetricsRequested;		//a request for MetricsParams and MetricsFov has gone out
+Scenario			MetricsParams;
+float				MetricsFov;
+PrecomputedMetrics	Precomputed;			//newest result that has come back
+bool				PrecomputedValid;
+
+//Interpolated metrics from LOOKUP_TABLE_FILE
+int			LookupOn;				// != 0 means the table is open and shown in the overlay
+LookupTable	Lookup;
+
+//Hidden time and collision margin, redrawn every frame
+//The closed form model is quicker than the surrogate, so the surrogate is only asked when checked
+int			RiskMeterOn;			// != 0 means the meter is shown
+int			RiskSurrogateOn;		// != 0 means SURROGATE_FILE is loaded and answers where it is sure enough
+Surrogate	RiskModel;
+
+//Binary trajectory recording and replay
+int			RecordOn;			// != 0 means every simulation step is written to TRAJECTORY_FILE
+int			PlaybackOn;			// != 0 means the scene is driven from TRAJECTORY_FILE
+Trajectory	Playback;
+int			RecordCommand;		//command that started the current recording
+
 //Blind spot angles (With respect to the Z axis in the negative direction)
 float	AngleIntersection;
 float	LeadingAngle;
@@ -148,9 +253,25 @@ GLfloat	BikeSpeed;
 GLfloat CarDistanceTravelled;
 GLfloat BikeDistanceTravelled;
 
-//Animation times
-int animate_start_time; //Log the time in which animation starts so simulation time is essentially starting at t=0
-int time_frozen;
+//Playback speed
+float		TimeScale;			//simulated seconds per wall clock second
+float		TimeScaleLog;		//log10( TimeScale ), set by the time scale slider
+float		AppliedTimeScaleLog;	//TimeScaleLog the current TimeScale came from
+
+//How the program was started
+StartupOptions	Options;
+GLuint			OffscreenFramebuffer;		//0 unless offscreen frames are drawn into it
+GLuint			OffscreenBuffers[2];		//color and depth
+int				StartMilliseconds;	//GLUT_ELAPSED_TIME when the window was up
+
+//Scenario opened at startup, which Reset( ) goes back to
+Scenario	StartScenario;
+bool		StartScenarioOn = false;
+
+//What the simulation thread has been told so far
+Scenario	SentParams;
+float		SentTimeScale;
+int			SeekCommand;		//last command that moved the simulation clock
 
 //GLUI globals
 GLUI *	Glui;				// instance of glui window
@@ -176,15 +297,22 @@ enum SliderVals {
 	CSTART,
 	CSPEED,
 	BSTART,
-	BSPEED
+	BSPEED,
+	TIMELINE,
+	TIMESCALE,
+	NUM_SLIDERS
 };
 
-struct GLUI_SliderPackage sliders[8];
+struct GLUI_SliderPackage sliders[NUM_SLIDERS];
+
+//Simulation time shown on the timeline slider
+float	TimelineValue;
 
 
 // function prototypes:
 void	Animate( );
 void	Buttons( int );
+void	Checkboxes( int );
 void	Display( );
 void	InitGlui();
 void	InitGraphics( );
@@ -198,6 +326,7 @@ void	Resize( int, int );
 void	Visibility( int );
 
 void	Axes( float );
+void	DoRasterString( float, float, float, char * );
 
 //Draw car and shadow
 void	DrawShadow();
@@ -205,10 +334,49 @@ void	DrawCar(float);
 
 void	UpdateGLUI(int);
 
+//Trajectory recording
+void	PlaybackStep( );
+
+//Background metrics of the whole run
+void	RequestMetrics( );
+void	DrawTrajectoryMetrics( );
+void	DrawRiskMeter( );
+
+//Simulation thread
+void	InitSimulation( );
+void	SendChanges( );
+
+//Scenario files
+void	SetScenarioSliders( const Scenario & );
+void	ReloadScenario( );
+
+//Timeline
+Scenario	CurrentScenario( );
+void	Seek( float );
+void	UpdateTimeline( );
+
+//GPU occlusion queries
+void	InitOcclusionQueries( );
+
+//Offscreen drawing
+void	InitOffscreen( );
+int		BeginOcclusionQuery( int );
+void	CollectOcclusionQueries( );
+
 // main program:
 
 int main( int argc, char *argv[ ] )
 {
+	// take out our own command line options,
+	// and answer straight away if no window is wanted:
+
+	StartupOptionsDefault( &Options );
+	if( !ParseStartupOptions( &argc, argv, &Options ) )
+		return 1;
+	if( Options.Mode == MODE_HEADLESS )
+		return RunHeadless( Options );
+
+
 	// turn on the glut package:
 	// (do this before checking argc and argv since it might
 	// pull some command line arguments out)
@@ -216,6 +384,26 @@ int main( int argc, char *argv[ ] )
 	glutInit( &argc, argv );
 
 
+	// a scenario named on the command line is where the simulation starts,
+	// and in the window it follows edits to its file;
+	// one that cannot be loaded has already been reported:
+
+	if( Options.ScenarioName != NULL )
+	{
+		if( !LoadStartupScenario( Options, &StartScenario ) )
+			return 1;
+		StartScenarioOn = true;
+		if( Options.Mode == MODE_GUI )
+			ScenarioWatchStart( Options.ScenarioPath, Options.ScenarioName );
+	}
+
+
+	// debugging messages go through a background writer
+	// so the callbacks that print them do not wait on stderr:
+
+	LogStart( NULL );
+
+
 	// setup all the graphics stuff:
 
 	InitGraphics( );
@@ -230,12 +418,29 @@ int main( int argc, char *argv[ ] )
 	// this will also post a redisplay
 
 	Reset( );
+	ViewType = Options.View == VIEW_INTERSECTION ? 1 : 0;
+
+
+	// start the simulation on its own thread,
+	// and the worker threads everything else shares:
+
+	InitSimulation( );
+	JobSystemStart( JOB_WORKERS, JOB_PIN_WORKERS );
+	MetricsCacheOpen( METRICS_CACHE_FILE );
+	RequestMetrics( );
+	if( Options.Play || Options.RunSeconds >= 0.f )
+		Buttons( PLAY );
 
 
 	// setup all the user interface stuff:
+	// (offscreen there is no panel, so the idle function is set here)
 
 	//InitMenus( );
-	InitGlui();
+	if( Options.Mode == MODE_GUI )
+		InitGlui();
+	else
+		glutIdleFunc( Animate );
+	StartMilliseconds = glutGet( GLUT_ELAPSED_TIME );
 
 
 	// draw the scene once and wait for some interaction:
@@ -254,21 +459,65 @@ int main( int argc, char *argv[ ] )
 //Update distance information with respect to speed for the Car and Bike in the scene
 void Animate( )
 {
-	if (play)
+	//Follow the time scale slider
+	if (TimeScaleLog != AppliedTimeScaleLog)
 	{
-		float seconds = ((float)(glutGet(GLUT_ELAPSED_TIME) - animate_start_time) / 1000.f);
-		float dt = seconds - Time;
-		Time = seconds;
+		TimeScale = powf(10.f, TimeScaleLog);
+		AppliedTimeScaleLog = TimeScaleLog;
+	}
+
+	//An edited scenario file takes effect between frames
+	ReloadScenario();
+
+	//Hand any GUI edits to the simulation thread
+	SendChanges();
+
+	//Have the metrics of the run worked out again if it changed, and pick up any that are done
+	RequestMetrics();
+	if (PrecomputeLatest(&Precomputed))
+		PrecomputedValid = true;
 
-		//Distance += DeltaTime * Speed
-		CarDistanceTravelled += (dt * CarSpeed);
-		BikeDistanceTravelled += (dt * BikeSpeed);
+	//Take the newest state the simulation has published, unless it is from before a seek
+	const SimSnapshot &snap = SimLatest();
+	if (snap.LastCommand >= SeekCommand)
+	{
+		Time = snap.Time;
+		CarDistance = snap.CarDistance;
+		BikeDistance = snap.BikeDistance;
+		CarDistanceTravelled = snap.CarTravelled;
+		BikeDistanceTravelled = snap.BikeTravelled;
+	}
+
+	//The recording could not be started
+	if (RecordOn && !snap.Recording && snap.LastCommand >= RecordCommand)
+		RecordOn = GLUIFALSE;
+
+	//A loaded recording decides the state instead of the sliders
+	if (PlaybackOn)
+	{
+		PlaybackStep();
+	}
+
+	//Keep the timeline slider following the animation
+	TimelineValue = Time;
+
+	//--run: print the run and quit once it has played that long
+	if (Options.RunSeconds >= 0.f && Time >= Options.RunSeconds)
+	{
+		PrintRun(stdout, CurrentScenario(), Time);
+		printf("Frames=%d Seconds=%.3f\n", FrameNumber, (glutGet(GLUT_ELAPSED_TIME) - StartMilliseconds) / 1000.f);
+		Buttons(QUIT);
 	}
 
 	// force a call to Display( ) next time it is convenient:
-	Glui->sync_live();
+	// (a hidden window gets no display callbacks, so offscreen frames are drawn from here)
+	if (Glui != NULL)
+		Glui->sync_live();
 	glutSetWindow( MainWindow );
-	glutPostRedisplay( );
+	if (Options.Mode == MODE_OFFSCREEN)
+		Display( );
+	else
+		glutPostRedisplay( );
 }
 
 void Buttons(int id)
@@ -278,14 +527,7 @@ void Buttons(int id)
 	case PLAY:
 		play = !play;
 		Frozen = !Frozen;
-		if (Frozen)
-		{
-			time_frozen = glutGet(GLUT_ELAPSED_TIME) - animate_start_time;
-		}
-		else
-		{
-			animate_start_time = glutGet(GLUT_ELAPSED_TIME) - time_frozen;
-		}
+		SimSend(play ? SIM_PLAY : SIM_PAUSE);
 		break;
 
 	case RESET:
@@ -308,7 +550,18 @@ void Buttons(int id)
 		// gracefully close the graphics window:
 		// gracefully exit the program:
 
-		Glui->close();
+		if (Glui != NULL)
+			Glui->close();
+		ScenarioWatchStop();
+		MetricsLogClose();
+		SimThreadStop();
+		EventLogClose();
+		PrecomputeStop();
+		MetricsCacheClose();
+		JobSystemStop();
+		TrajectoryClose(&Playback);
+		LookupTableClose(&Lookup);
+		LogStop();
 		glutSetWindow(MainWindow);
 		glFinish();
 		glutDestroyWindow(MainWindow);
@@ -321,6 +574,85 @@ void Buttons(int id)
 
 }
 
+void Checkboxes(int id)
+{
+	switch (id)
+	{
+	case METRICS_LOG:
+		if (MetricsLogOn)
+		{
+			if (!MetricsLogOpen(METRICS_LOG_FILE))
+				MetricsLogOn = GLUIFALSE;
+		}
+		else
+		{
+			MetricsLogClose();
+		}
+		Glui->sync_live();
+		break;
+
+	case EVENT_LOG:
+		//Any thread may emit, so the log is opened and closed from here
+		if (EventLogOn)
+		{
+			if (!EventLogOpen(EVENT_LOG_FILE, false))
+				EventLogOn = GLUIFALSE;
+		}
+		else
+		{
+			EventLogClose();
+		}
+		Glui->sync_live();
+		break;
+
+	case RECORD:
+		//The simulation thread owns the recorder
+		if (RecordOn)
+			RecordCommand = SimSend(SIM_RECORD_START, 0, 0.f, TRAJECTORY_FILE);
+		else
+			SimSend(SIM_RECORD_STOP);
+		break;
+
+	case PLAYBACK:
+		//Start the recording from the beginning, paused
+		TrajectoryClose(&Playback);
+		Replay();
+		if (PlaybackOn)
+		{
+			if (!TrajectoryOpen(TRAJECTORY_FILE, &Playback) || Playback.Count == 0)
+			{
+				TrajectoryClose(&Playback);
+				PlaybackOn = GLUIFALSE;
+			}
+			else
+			{
+				PlaybackStep();
+			}
+		}
+		SimSend(SIM_PLAYBACK, 0, PlaybackOn ? 1.f : 0.f);
+		UpdateGLUI(-1);
+		glutSetWindow(MainWindow);
+		glutPostRedisplay();
+		break;
+
+	case LOOKUP:
+		LookupTableClose(&Lookup);
+		if (LookupOn && !LookupTableOpen(LOOKUP_TABLE_FILE, &Lookup))
+			LookupOn = GLUIFALSE;
+		Glui->sync_live();
+		break;
+
+	case RISK_SURROGATE:
+		if (RiskSurrogateOn && !SurrogateLoad(SURROGATE_FILE, &RiskModel))
+			RiskSurrogateOn = GLUIFALSE;
+		Glui->sync_live();
+		break;
+
+	default:
+		fprintf(stderr, "Don't know what to do with Checkbox ID %d\n", id);
+	}
+}
+
 
 /*************************************************
  * Function: 
@@ -331,22 +663,20 @@ void Buttons(int id)
 //Draw the scene
 void Display( )
 {
-	CarDistance = CarStart - CarDistanceTravelled;
-	BikeDistance = BikeStart - BikeDistanceTravelled;
-
 	GLfloat scale2;
 
-	if( DebugOn != 0 )
-	{
-		fprintf( stderr, "Display\n" );
-	}
+	LOG_DEBUG( "Display\n" );
 
 
 	//Set window in which to draw graphics
 	glutSetWindow( MainWindow );
 
 	//Flush the background contents
-	glDrawBuffer( GL_BACK );
+	//Offscreen, the framebuffer object has no back buffer, only its color attachment
+	if( OffscreenFramebuffer != 0 )
+		glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	else
+		glDrawBuffer( GL_BACK );
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
 	glEnable( GL_DEPTH_TEST );
@@ -355,9 +685,10 @@ void Display( )
 	glShadeModel( GL_FLAT );
 
 
-	// set the viewport to a square centered in the window:
-	GLsizei vx = glutGet( GLUT_WINDOW_WIDTH );
-	GLsizei vy = glutGet( GLUT_WINDOW_HEIGHT );
+	// set the viewport to a square centered in the window,
+	// or to the whole framebuffer object, which is the size the window started at:
+	GLsizei vx = OffscreenFramebuffer != 0 ? INIT_WINDOW_SIZE : glutGet( GLUT_WINDOW_WIDTH );
+	GLsizei vy = OffscreenFramebuffer != 0 ? INIT_WINDOW_SIZE : glutGet( GLUT_WINDOW_HEIGHT );
 	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
 	GLint xl = ( vx - v ) / 2;
 	GLint yb = ( vy - v ) / 2;
@@ -380,7 +711,7 @@ void Display( )
 	//Check view type
 	if (!ViewType) //Car interior
 	{
-		gluLookAt(0., 1.6, CarDistance, 0., 1.6, -CarDistanceTravelled, 0., 1., 0.); //Eye is positioned at the car looking out the front
+		gluLookAt(0., EYE_HEIGHT, CarDistance, 0., EYE_HEIGHT, -CarDistanceTravelled, 0., 1., 0.); //Eye is positioned at the car looking out the front
 	}
 	else //Intersection
 	{
@@ -423,19 +754,32 @@ void Display( )
 	//Draw the Car
 	glPushMatrix();
 	glTranslatef(0, 0, CarDistance); //Move the car and shadow
-	DrawCar(2.195f);
+	DrawCar(CAR_BLINDER_DISTANCE);
 	glPopMatrix();
 
-	//Draw bike
+	//Pick up any occlusion results that have come back without waiting on the rest
+	CollectOcclusionQueries();
+
+	//Draw bike, counting the samples that survive the depth test against the car
+	int query = (OcclusionOn && !ViewType) ? BeginOcclusionQuery(FrameNumber) : -1;
 	glPushMatrix();
 	glRotatef(AngleIntersection, 0.f, 1.f, 0.f);
 	glTranslatef(0, 0, BikeDistance);
 	glCallList(BikeList);
 	glPopMatrix();
+	if (query >= 0)
+		glEndQuery(GL_SAMPLES_PASSED);
 
 	//Draw blind spot shadow
 	DrawShadow();
 
+	//Measure the bike's visibility from the driver's eye on the CPU
+	if (RasterOn)
+	{
+		DriverView view = { Fov, AngleIntersection, LeadingAngle, TrailingAngle, CarDistance, BikeDistance };
+		RasterizeDriverView(view, &Raster, &RasterResult);
+	}
+
 	//Reset projection matrix and set world coordinates 0-100
 	glDisable( GL_DEPTH_TEST );
 	glMatrixMode( GL_PROJECTION );
@@ -446,6 +790,62 @@ void Display( )
 	glMatrixMode( GL_MODELVIEW );
 	glLoadIdentity( );
 
+	if (RasterOn)
+	{
+		char str[64];
+		sprintf(str, "Visible bike pixels: %d / %d", RasterResult.VisiblePixels, RasterResult.BikePixels);
+		glColor3f(1.f, 1.f, 1.f);
+		DoRasterString(2.f, 2.f, 0.f, str);
+	}
+
+	if (OcclusionOn && OcclusionSupported)
+	{
+		char str[64];
+		sprintf(str, "Visible bike samples: %d", OcclusionSamples);
+		glColor3f(1.f, 1.f, 1.f);
+		DoRasterString(2.f, 6.f, 0.f, str);
+	}
+
+	if (TrajectoryMetricsOn && PrecomputedValid)
+	{
+		DrawTrajectoryMetrics();
+	}
+
+	if (LookupOn)
+	{
+		float values[LUT_METRICS];
+		bool inside = LookupTableEval(Lookup, CurrentScenario(), values);
+		const float *error = Lookup.Header->MaxError;
+
+		char str[128];
+		sprintf(str, "Table: hidden %.2f s (+/- %.2f), closest %.2f m (+/- %.2f)%s", values[LUT_HIDDEN_TIME], error[LUT_HIDDEN_TIME],
+				values[LUT_MIN_SEPARATION], error[LUT_MIN_SEPARATION], inside ? "" : ", outside the table");
+		glColor3f(1.f, 1.f, 1.f);
+		DoRasterString(2.f, 83.f, 0.f, str);
+	}
+
+	if (RiskMeterOn)
+	{
+		DrawRiskMeter();
+	}
+
+	//One row per frame in the metrics log
+	if (MetricsLogIsOpen())
+	{
+		FrameMetrics m;
+		m.Frame = FrameNumber;
+		m.Time = Time;
+		m.CarDistance = CarDistance;
+		m.BikeDistance = BikeDistance;
+		m.BikeHidden = BikeInShadow(AngleIntersection, LeadingAngle, TrailingAngle, CarDistance, BikeDistance);
+		m.RasterVisible = RasterOn ? RasterResult.VisiblePixels : METRICS_NONE;
+		m.RasterTotal = RasterOn ? RasterResult.BikePixels : METRICS_NONE;
+		m.GpuSamples = METRICS_NONE;
+		m.GpuPending = query >= 0;
+		MetricsLogFrame(m);
+	}
+	FrameNumber++;
+
 	// swap the double-buffered framebuffers:
 	glutSwapBuffers( );
 
@@ -476,6 +876,19 @@ void InitGlui(void)
 	//View
 	Glui->add_checkbox("Exterior View", &ViewType);
 
+	//Visibility measurement
+	Glui->add_checkbox("Raster Visibility", &RasterOn);
+	if (OcclusionSupported)
+		Glui->add_checkbox("GPU Occlusion Query", &OcclusionOn);
+	Glui->add_checkbox("Metrics Log", &MetricsLogOn, METRICS_LOG, (GLUI_Update_CB)Checkboxes);
+	Glui->add_checkbox("Event Log", &EventLogOn, EVENT_LOG, (GLUI_Update_CB)Checkboxes);
+	Glui->add_checkbox("Record", &RecordOn, RECORD, (GLUI_Update_CB)Checkboxes);
+	Glui->add_checkbox("Play Recording", &PlaybackOn, PLAYBACK, (GLUI_Update_CB)Checkboxes);
+	Glui->add_checkbox("Trajectory Metrics", &TrajectoryMetricsOn);
+	Glui->add_checkbox("Lookup Table", &LookupOn, LOOKUP, (GLUI_Update_CB)Checkboxes);
+	Glui->add_checkbox("Risk Meter", &RiskMeterOn);
+	Glui->add_checkbox("Risk Surrogate", &RiskSurrogateOn, RISK_SURROGATE, (GLUI_Update_CB)Checkboxes);
+
 	Glui->add_statictext("Field of View");
 	sliders[FOV].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &Fov);
 	sliders[FOV].slider->set_float_limits(0.f, 180.f);
@@ -487,7 +900,7 @@ void InitGlui(void)
 	//Angle of intersection
 	Glui->add_statictext("Angle of Intersection");
 	sliders[AOI].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &AngleIntersection);
-	sliders[AOI].slider->set_float_limits(0.f, 180.f);
+	sliders[AOI].slider->set_float_limits(SCENARIO_MIN[SCN_AOI], SCENARIO_MAX[SCN_AOI]);
 	sliders[AOI].slider->set_w(500);
 	sliders[AOI].slider->set_slider_val(AngleIntersection);
 	sliders[AOI].edit_text = Glui->add_edittext("Degrees [0 - 180]: ", GLUI_EDITTEXT_FLOAT, &AngleIntersection, AOI, (GLUI_Update_CB)UpdateGLUI);
@@ -496,7 +909,7 @@ void InitGlui(void)
 	//Leading Angle
 	Glui->add_statictext("Blindspot Leading Angle");
 	sliders[LA].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &LeadingAngle);
-	sliders[LA].slider->set_float_limits(0.f, 45.f);
+	sliders[LA].slider->set_float_limits(SCENARIO_MIN[SCN_LA], SCENARIO_MAX[SCN_LA]);
 	sliders[LA].slider->set_w(500);
 	sliders[LA].slider->set_slider_val(LeadingAngle);
 	sliders[LA].edit_text = Glui->add_edittext("Degrees [0 - 45]: ", GLUI_EDITTEXT_FLOAT, &LeadingAngle, LA, (GLUI_Update_CB)UpdateGLUI);
@@ -505,7 +918,7 @@ void InitGlui(void)
 	//Trailing Angle
 	Glui->add_statictext("Blindspot Trailing Angle");
 	sliders[TA].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &TrailingAngle);
-	sliders[TA].slider->set_float_limits(0.f, 45.f);
+	sliders[TA].slider->set_float_limits(SCENARIO_MIN[SCN_TA], SCENARIO_MAX[SCN_TA]);
 	sliders[TA].slider->set_w(500);
 	sliders[TA].slider->set_slider_val(TrailingAngle);
 	sliders[TA].edit_text = Glui->add_edittext("Degrees [0 - 45]: ", GLUI_EDITTEXT_FLOAT, &TrailingAngle, TA, (GLUI_Update_CB)UpdateGLUI);
@@ -514,7 +927,7 @@ void InitGlui(void)
 	//Car start
 	Glui->add_statictext("Car Starting Distance");
 	sliders[CSTART].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &CarStart);
-	sliders[CSTART].slider->set_float_limits(0.f, 1000.f);
+	sliders[CSTART].slider->set_float_limits(SCENARIO_MIN[SCN_CSTART], SCENARIO_MAX[SCN_CSTART]);
 	sliders[CSTART].slider->set_w(500);
 	sliders[CSTART].slider->set_slider_val(CarStart);
 	sliders[CSTART].edit_text = Glui->add_edittext("Meters [0. - 1000.]: ", GLUI_EDITTEXT_FLOAT, &CarStart, CSTART, (GLUI_Update_CB)UpdateGLUI);
@@ -523,7 +936,7 @@ void InitGlui(void)
 	//Car speed
 	Glui->add_statictext("Car Speed");
 	sliders[CSPEED].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &CarSpeed);
-	sliders[CSPEED].slider->set_float_limits(0.f, 100.f);
+	sliders[CSPEED].slider->set_float_limits(SCENARIO_MIN[SCN_CSPEED], SCENARIO_MAX[SCN_CSPEED]);
 	sliders[CSPEED].slider->set_w(500);
 	sliders[CSPEED].slider->set_slider_val(CarSpeed);
 	sliders[CSPEED].edit_text = Glui->add_edittext("Meters/Second [0 - 100]: ", GLUI_EDITTEXT_FLOAT, &CarSpeed, CSPEED, (GLUI_Update_CB)UpdateGLUI);
@@ -532,7 +945,7 @@ void InitGlui(void)
 	//Bike Start
 	Glui->add_statictext("Bike Starting Distance");
 	sliders[BSTART].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &BikeStart);
-	sliders[BSTART].slider->set_float_limits(0.f, 1000.f);
+	sliders[BSTART].slider->set_float_limits(SCENARIO_MIN[SCN_BSTART], SCENARIO_MAX[SCN_BSTART]);
 	sliders[BSTART].slider->set_w(500);
 	sliders[BSTART].slider->set_slider_val(BikeStart);
 	sliders[BSTART].edit_text = Glui->add_edittext("Meters [0 - 1000]: ", GLUI_EDITTEXT_FLOAT, &BikeStart, BSTART, (GLUI_Update_CB)UpdateGLUI);
@@ -541,12 +954,28 @@ void InitGlui(void)
 	//Bike Speed
 	Glui->add_statictext("Bike Speed");
 	sliders[BSPEED].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &BikeSpeed);
-	sliders[BSPEED].slider->set_float_limits(0.f, 100.f);
+	sliders[BSPEED].slider->set_float_limits(SCENARIO_MIN[SCN_BSPEED], SCENARIO_MAX[SCN_BSPEED]);
 	sliders[BSPEED].slider->set_w(500);
 	sliders[BSPEED].slider->set_slider_val(BikeSpeed);
 	sliders[BSPEED].edit_text = Glui->add_edittext("Meters/Second [0 - 100]: ", GLUI_EDITTEXT_FLOAT, &BikeSpeed, BSPEED, (GLUI_Update_CB)UpdateGLUI);
 	Glui->add_separator();
 
+	//Timeline
+	Glui->add_statictext("Timeline");
+	sliders[TIMELINE].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &TimelineValue, TIMELINE, (GLUI_Update_CB)UpdateGLUI);
+	sliders[TIMELINE].slider->set_w(500);
+	sliders[TIMELINE].edit_text = Glui->add_edittext("Seconds: ", GLUI_EDITTEXT_FLOAT, &TimelineValue, TIMELINE, (GLUI_Update_CB)UpdateGLUI);
+	UpdateTimeline();
+
+	//Playback speed, the slider moves in powers of ten
+	sliders[TIMESCALE].slider = Glui->add_slider(false, GLUI_HSLIDER_FLOAT, &TimeScaleLog);
+	sliders[TIMESCALE].slider->set_float_limits(log10f(TIMESCALE_MIN), log10f(TIMESCALE_MAX));
+	sliders[TIMESCALE].slider->set_w(500);
+	sliders[TIMESCALE].slider->set_slider_val(TimeScaleLog);
+	sliders[TIMESCALE].edit_text = Glui->add_edittext("Time Scale [0.01 - 1000]: ", GLUI_EDITTEXT_FLOAT, &TimeScale, TIMESCALE, (GLUI_Update_CB)UpdateGLUI);
+	sliders[TIMESCALE].edit_text->set_float_limits(TIMESCALE_MIN, TIMESCALE_MAX);
+	Glui->add_separator();
+
 	panel = Glui->add_panel("Scene Transformation");
 
 	rot = Glui->add_rotation_to_panel(panel, "Rotation", (float *)RotMatrix);
@@ -695,6 +1124,49 @@ void InitGraphics( )
 		fprintf( stderr, "Status: Using GLEW %s\n", glewGetString(GLEW_VERSION));
 	#endif
 
+	InitOcclusionQueries( );
+
+
+	// offscreen, the window stays hidden and frames go to a framebuffer object:
+
+	if( Options.Mode == MODE_OFFSCREEN )
+		InitOffscreen( );
+}
+
+//Hide the window and draw into a framebuffer object the size it would have been
+//Without framebuffer objects the frames are drawn into the hidden window instead
+void InitOffscreen( )
+{
+	glutHideWindow( );
+
+	int major = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if (version != NULL)
+		sscanf(version, "%d", &major);
+	if (major < 3)
+	{
+		fprintf(stderr, "OpenGL %s has no framebuffer objects, drawing into the hidden window\n", version != NULL ? version : "?");
+		return;
+	}
+
+	glGenRenderbuffers(2, OffscreenBuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, OffscreenBuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, INIT_WINDOW_SIZE, INIT_WINDOW_SIZE);
+	glBindRenderbuffer(GL_RENDERBUFFER, OffscreenBuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, INIT_WINDOW_SIZE, INIT_WINDOW_SIZE);
+
+	glGenFramebuffers(1, &OffscreenFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, OffscreenFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, OffscreenBuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, OffscreenBuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "Offscreen framebuffer is incomplete, drawing into the hidden window\n");
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &OffscreenFramebuffer);
+		glDeleteRenderbuffers(2, OffscreenBuffers);
+		OffscreenFramebuffer = 0;
+	}
 }
 
 
@@ -763,14 +1235,19 @@ void InitLists( )
 			Axes( 20.0 );
 		glLineWidth( 1. );
 	glEndList( );
+
+	//Software visibility raster
+	if (!RasterTargetInit(&Raster, RASTER_DEFAULT_RES))
+	{
+		fprintf(stderr, "Unable to allocate the %dx%d visibility raster\n", RASTER_DEFAULT_RES, RASTER_DEFAULT_RES);
+	}
 }
 
 
 // the keyboard callback:
 void Keyboard( unsigned char c, int x, int y )
 {
-	if( DebugOn != 0 )
-		fprintf( stderr, "Keyboard: '%c' (0x%0x)\n", c, c );
+	LOG_DEBUG( "Keyboard: '%c' (0x%0x)\n", c, c );
 
 	switch( c )
 	{
@@ -806,8 +1283,7 @@ void MouseButton( int button, int state, int x, int y )
 {
 	int b = 0;			// LEFT, MIDDLE, or RIGHT
 
-	if( DebugOn != 0 )
-		fprintf( stderr, "MouseButton: %d, %d, %d, %d\n", button, state, x, y );
+	LOG_DEBUG( "MouseButton: %d, %d, %d, %d\n", button, state, x, y );
 
 	
 	// get the proper button bit mask:
@@ -845,8 +1321,7 @@ void MouseButton( int button, int state, int x, int y )
 // called when the mouse moves while a button is down:
 void MouseMotion( int x, int y )
 {
-	if( DebugOn != 0 )
-		fprintf( stderr, "MouseMotion: %d, %d\n", x, y );
+	LOG_DEBUG( "MouseMotion: %d, %d\n", x, y );
 
 
 	int dx = x - Xmouse;		// change in mouse coords
@@ -881,7 +1356,11 @@ void Reset( )
 {
 	ActiveButton = 0;
 	AxesOn = GLUIFALSE;
+	RasterOn = GLUIFALSE;
+	OcclusionOn = GLUIFALSE;
+	TrajectoryMetricsOn = GLUITRUE;
 	DebugOn = GLUIFALSE;
+	LogSetLevel( DebugOn != 0 ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO );
 	Scale  = 1.0;
 	Xrot = Yrot = 0.;
 	Fov = 90.f;
@@ -904,7 +1383,39 @@ void Reset( )
 	BikeStart = 39.0f;
 	BikeSpeed = 7.0f;
 
+	if (StartScenarioOn)
+		SetScenarioSliders(StartScenario);
+
+	TimeScale = 1.f;
+	TimeScaleLog = AppliedTimeScaleLog = 0.f;
+
+	Replay();
+}
+
+//Put a scenario on the sliders
+void SetScenarioSliders( const Scenario &scn )
+{
+	AngleIntersection = scn.AngleIntersection;
+	LeadingAngle = scn.LeadingAngle;
+	TrailingAngle = scn.TrailingAngle;
+	CarStart = scn.CarStart;
+	CarSpeed = scn.CarSpeed;
+	BikeStart = scn.BikeStart;
+	BikeSpeed = scn.BikeSpeed;
+}
+
+//Take the startup scenario again if its file was edited: the same as the Reset button,
+//but the camera, view and display options stay as they are
+void ReloadScenario( )
+{
+	Scenario scn;
+	if (!ScenarioWatchTake(&scn))
+		return;
+
+	StartScenario = scn;
+	SetScenarioSliders(scn);
 	Replay();
+	UpdateGLUI(-1);
 }
 
 void Replay()
@@ -918,18 +1429,22 @@ void Replay()
 	BikeDistanceTravelled = 0;
 
 	play = false;
-
-	animate_start_time = glutGet(GLUT_ELAPSED_TIME);
-	time_frozen = 0;
 	Frozen = true;
+
+	//A recording holds a single run from t = 0
+	if (RecordOn)
+	{
+		RecordOn = GLUIFALSE;
+		SimSend(SIM_RECORD_STOP);
+	}
+	SeekCommand = SimSend(SIM_RESTART);
 }
 
 
 // called when user resizes the window:
 void Resize( int width, int height )
 {
-	if( DebugOn != 0 )
-		fprintf( stderr, "ReSize: %d, %d\n", width, height );
+	LOG_DEBUG( "ReSize: %d, %d\n", width, height );
 
 	// don't really need to do anything since window size is
 	// checked each time in Display( ):
@@ -941,8 +1456,7 @@ void Resize( int width, int height )
 // handle a change to the window's visibility:
 void Visibility ( int state )
 {
-	if( DebugOn != 0 )
-		fprintf( stderr, "Visibility: %d\n", state );
+	LOG_DEBUG( "Visibility: %d\n", state );
 
 	if( state == GLUT_VISIBLE )
 	{
@@ -1006,6 +1520,18 @@ const float LENFRAC = 0.10f;
 // fraction of length to use as start location of the characters:
 const float BASEFRAC = 1.10f;
 
+// use glut to display a string of characters using a raster font:
+void DoRasterString( float x, float y, float z, char *s )
+{
+	glRasterPos3f( (GLfloat)x, (GLfloat)y, (GLfloat)z );
+
+	char c;			// one character to print
+	for( ; ( c = *s ) != '\0'; s++ )
+	{
+		glutBitmapCharacter( GLUT_BITMAP_TIMES_ROMAN_24, c );
+	}
+}
+
 //	Draw a set of 3D axes:
 //	(length is the axis length in world coordinates)
 void Axes( float length )
@@ -1076,27 +1602,14 @@ void Axes( float length )
 //Draw shadow triangle
 void DrawShadow()
 {
-	float angle_difference = 180.f - AngleIntersection;
-	//If the car has passed the intersection or the leading edge never interesects with the road, do not draw shadow
-	if (CarDistance < 0 || angle_difference < LeadingAngle)
+	//CSED = Car Shadow Edge Distance
+	float CSED_Lead, CSED_Trail; //Distance from leading and trailing edge of blindspot shadow to car
+	if (!ShadowEdges(AngleIntersection, LeadingAngle, TrailingAngle, CarDistance, &CSED_Lead, &CSED_Trail))
 	{
 		return; //Don't draw the shadow
 	}
-	//Issues occur when leading angle or trailing angle are equal to 180 - AngleIntersection
-	//At this point, the distance values become unpredictable and large
 	float lAngle = LeadingAngle * DEG_TO_RAD;
 	float tAngle = TrailingAngle * DEG_TO_RAD;
-	float iAngle = AngleIntersection * DEG_TO_RAD;
-
-	//CSED = Car Shadow Edge Distance
-	float CSED_Numerator = (CarDistance * sin(iAngle));
-	float CSED_Trail =  CSED_Numerator / sin((M_PI - (tAngle + iAngle))); //Distance from trailing edge of blindspot shadow to car
-	float CSED_Lead = CSED_Numerator / sin((M_PI - (lAngle + iAngle))); //Distance from leading edge blindspot shadow to car
-
-	if (angle_difference < TrailingAngle)
-	{
-		CSED_Trail = 100000.f; //Fixed distance on trailing edge of shadow to prevent visual issues when there is no intersection between the road and the trailing edge
-	}
 
 	//Cleaning things up so its easier to read the next set of operations
 	float Opp_Lead = sin(lAngle);
@@ -1122,8 +1635,8 @@ void DrawCar(float scaleFactor)
 	float leadX = sin(lAngle) * scaleFactor, leadZ = (-cos(lAngle) * scaleFactor);
 	float trailX = sin(tAngle) * scaleFactor, trailZ = (-cos(tAngle) * scaleFactor);
 
-	float length = 4.f;
-	float height = 2.f;
+	float length = CAR_LENGTH;
+	float height = CAR_HEIGHT;
 	float dash_height = height / 2.f;
 
 	//Draw the blinders
@@ -1220,6 +1733,14 @@ void UpdateGLUI(int id)
 		case BSPEED:
 			sliders[BSPEED].slider->set_slider_val(BikeSpeed);
 			break;
+		case TIMELINE:
+			Seek(TimelineValue);
+			sliders[TIMELINE].slider->set_slider_val(TimelineValue);
+			break;
+		case TIMESCALE:
+			TimeScaleLog = AppliedTimeScaleLog = log10f(TimeScale);
+			sliders[TIMESCALE].slider->set_slider_val(TimeScaleLog);
+			break;
 		default:
 			sliders[FOV].slider->set_slider_val(Fov);
 			sliders[AOI].slider->set_slider_val(AngleIntersection);
@@ -1229,6 +1750,314 @@ void UpdateGLUI(int id)
 			sliders[CSPEED].slider->set_slider_val(CarSpeed);
 			sliders[BSTART].slider->set_slider_val(BikeStart);
 			sliders[BSPEED].slider->set_slider_val(BikeSpeed);
+			sliders[TIMESCALE].slider->set_slider_val(TimeScaleLog);
 	}
+
+	//Any change to the starts or speeds changes how long the run lasts
+	if (id != TIMELINE)
+		UpdateTimeline();
 	Glui->sync_live();
-}
\ No newline at end of file
+}
+
+//Create the occlusion query objects if the OpenGL version has them
+void InitOcclusionQueries( )
+{
+	int major = 0, minor = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if (version != NULL)
+		sscanf(version, "%d.%d", &major, &minor);
+
+	OcclusionSupported = major > 1 || (major == 1 && minor >= 5);
+	if (!OcclusionSupported)
+	{
+		fprintf(stderr, "OpenGL %s has no occlusion queries, GPU visibility is disabled\n", version != NULL ? version : "?");
+		return;
+	}
+
+	glGenQueries(OCCLUSION_QUERIES, OcclusionQueries);
+	for (int i = 0; i < OCCLUSION_QUERIES; i++)
+		OcclusionFrame[i] = -1;
+}
+
+//Start a samples-passed query for this frame
+//Returns the query slot, or -1 if every slot is still waiting on the GPU
+int BeginOcclusionQuery(int frame)
+{
+	if (!OcclusionSupported)
+		return -1;
+
+	int slot = frame % OCCLUSION_QUERIES;
+	if (OcclusionFrame[slot] >= 0)
+		return -1; //Skip a frame rather than stall on an old result
+
+	OcclusionFrame[slot] = frame;
+	glBeginQuery(GL_SAMPLES_PASSED, OcclusionQueries[slot]);
+	return slot;
+}
+
+//Read back every finished query without blocking, oldest first
+void CollectOcclusionQueries( )
+{
+	if (!OcclusionSupported)
+		return;
+
+	for (int n = 0; n < OCCLUSION_QUERIES; n++)
+	{
+		int slot = (FrameNumber + n) % OCCLUSION_QUERIES;
+		if (OcclusionFrame[slot] < 0)
+			continue;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(OcclusionQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break; //Results come back in order, so nothing newer is ready either
+
+		GLuint samples = 0;
+		glGetQueryObjectuiv(OcclusionQueries[slot], GL_QUERY_RESULT, &samples);
+		OcclusionSamples = (int)samples;
+		MetricsLogGpuResult(OcclusionFrame[slot], OcclusionSamples);
+		OcclusionFrame[slot] = -1;
+	}
+}
+
+//Set the scene to the recorded step at the current Time
+void PlaybackStep( )
+{
+	const TrajectoryRecord &r = Playback.Records[TrajectoryFind(Playback, Time)];
+
+	AngleIntersection = r.AngleIntersection;
+	LeadingAngle = r.LeadingAngle;
+	TrailingAngle = r.TrailingAngle;
+
+	CarDistance = r.CarDistance;
+	BikeDistance = r.BikeDistance;
+	CarDistanceTravelled = CarStart - r.CarDistance;
+	BikeDistanceTravelled = BikeStart - r.BikeDistance;
+
+	//Hold on the last step once the recording runs out
+	if (play && Time >= TrajectoryDuration(Playback))
+		Buttons(PLAY);
+}
+
+//The single car / bike run described by the sliders
+Scenario CurrentScenario( )
+{
+	Scenario scn = { AngleIntersection, LeadingAngle, TrailingAngle, CarStart, CarSpeed, BikeStart, BikeSpeed };
+	return scn;
+}
+
+//Jump straight to simulation time t
+//The state comes from the closed form solution or the recording, so this
+//costs the same no matter how far into the run t is
+void Seek( float t )
+{
+	if (t < 0.f)
+		t = 0.f;
+
+	//A recording has to stay in time order
+	if (RecordOn && t < Time)
+	{
+		RecordOn = GLUIFALSE;
+		SimSend(SIM_RECORD_STOP);
+	}
+
+	//Move the simulation, and show the new time right away rather than wait for it
+	SendChanges();
+	SeekCommand = SimSend(SIM_SEEK, 0, t);
+
+	ScenarioState state = StateAtTime(CurrentScenario(), t);
+	Time = t;
+	CarDistance = state.CarDistance;
+	BikeDistance = state.BikeDistance;
+	CarDistanceTravelled = CarStart - state.CarDistance;
+	BikeDistanceTravelled = BikeStart - state.BikeDistance;
+	if (PlaybackOn)
+		PlaybackStep();
+
+	TimelineValue = t;
+	glutSetWindow(MainWindow);
+	glutPostRedisplay();
+}
+
+//Fit the timeline to the current run or recording
+void UpdateTimeline( )
+{
+	if (sliders[TIMELINE].slider == NULL)
+		return;
+
+	float duration = PlaybackOn ? TrajectoryDuration(Playback) : RunDuration(CurrentScenario());
+	sliders[TIMELINE].slider->set_float_limits(0.f, duration);
+	sliders[TIMELINE].edit_text->set_float_limits(0.f, duration);
+	sliders[TIMELINE].slider->set_slider_val(TimelineValue);
+}
+
+//Start the simulation thread from the values Reset( ) chose
+void InitSimulation( )
+{
+	SentParams = CurrentScenario();
+	SentTimeScale = TimeScale;
+	SimThreadStart(SentParams, SentTimeScale);
+}
+
+//Send slider edits to the simulation thread
+void SendChanges( )
+{
+	Scenario scn = CurrentScenario();
+	if (scn.AngleIntersection != SentParams.AngleIntersection)
+		SimSend(SIM_PARAM, SIM_AOI, scn.AngleIntersection);
+	if (scn.LeadingAngle != SentParams.LeadingAngle)
+		SimSend(SIM_PARAM, SIM_LA, scn.LeadingAngle);
+	if (scn.TrailingAngle != SentParams.TrailingAngle)
+		SimSend(SIM_PARAM, SIM_TA, scn.TrailingAngle);
+	if (scn.CarStart != SentParams.CarStart)
+		SimSend(SIM_PARAM, SIM_CSTART, scn.CarStart);
+	if (scn.CarSpeed != SentParams.CarSpeed)
+		SimSend(SIM_PARAM, SIM_CSPEED, scn.CarSpeed);
+	if (scn.BikeStart != SentParams.BikeStart)
+		SimSend(SIM_PARAM, SIM_BSTART, scn.BikeStart);
+	if (scn.BikeSpeed != SentParams.BikeSpeed)
+		SimSend(SIM_PARAM, SIM_BSPEED, scn.BikeSpeed);
+	SentParams = scn;
+
+	if (TimeScale != SentTimeScale)
+	{
+		SimSend(SIM_TIME_SCALE, 0, TimeScale);
+		SentTimeScale = TimeScale;
+	}
+}
+
+//Ask for the metrics of the run on the sliders if they have not been asked for yet
+//Only queues a job, the work happens on the job system
+void RequestMetrics( )
+{
+	if (!TrajectoryMetricsOn)
+	{
+		MetricsRequested = false;
+		return;
+	}
+
+	Scenario scn = CurrentScenario();
+	if (MetricsRequested && SameScenario(scn, MetricsParams) && Fov == MetricsFov)
+		return;
+
+	PrecomputeRequest(scn, Fov);
+	MetricsParams = scn;
+	MetricsFov = Fov;
+	MetricsRequested = true;
+}
+
+//Overlay the precomputed metrics: text at the top left, time to collision graph at the top right
+//Expects the 0-100 orthographic projection Display( ) sets up for text
+void DrawTrajectoryMetrics( )
+{
+	const TrajectoryMetrics &m = Precomputed.Metrics;
+	char str[128];
+
+	glColor3f(1.f, 1.f, 1.f);
+	if (m.HiddenTime > 0.f)
+		sprintf(str, "Hidden %.2f s (%.2f s to %.2f s), raster %.2f s", m.HiddenTime, m.HiddenStart, m.HiddenEnd, Precomputed.RasterHiddenTime);
+	else
+		sprintf(str, "Never hidden, raster %.2f s", Precomputed.RasterHiddenTime);
+	if (Precomputed.FromCache)
+		strcat(str, " (cached)");
+	DoRasterString(2.f, 95.f, 0.f, str);
+
+	sprintf(str, "Closest %.2f m at %.2f s%s", m.MinSeparation, m.MinSeparationTime, m.Collision ? " - COLLISION" : "");
+	if (m.Collision)
+		glColor3f(1.f, .3f, .3f);
+	DoRasterString(2.f, 91.f, 0.f, str);
+
+	//Time to collision at the sample nearest the current time
+	int sample = (int)(Time / Precomputed.SampleStep);
+	if (sample < 0)
+		sample = 0;
+	if (sample >= PRECOMPUTE_SAMPLES)
+		sample = PRECOMPUTE_SAMPLES - 1;
+	float ttc = Precomputed.TimeToCollision[sample];
+	if (ttc == TTC_NEVER)
+		sprintf(str, "Not on a collision course");
+	else
+		sprintf(str, "Time to collision %.2f s", ttc);
+	glColor3f(1.f, 1.f, 1.f);
+	DoRasterString(2.f, 87.f, 0.f, str);
+
+	//Graph box: run time across, time to collision up to TTC_GRAPH_MAX
+	const float x0 = 60.f, x1 = 98.f, y0 = 84.f, y1 = 98.f;
+	glColor3f(.2f, .2f, .2f);
+	glBegin(GL_LINE_LOOP);
+		glVertex2f(x0, y0);
+		glVertex2f(x1, y0);
+		glVertex2f(x1, y1);
+		glVertex2f(x0, y1);
+	glEnd();
+
+	glColor3f(1.f, .8f, 0.f);
+	glBegin(GL_LINE_STRIP);
+	for (int i = 0; i < PRECOMPUTE_SAMPLES; i++)
+	{
+		float v = Precomputed.TimeToCollision[i];
+		if (v == TTC_NEVER || v > TTC_GRAPH_MAX)
+			v = TTC_GRAPH_MAX;
+		glVertex2f(x0 + (x1 - x0) * ((float)i + 0.5f) / (float)PRECOMPUTE_SAMPLES, y0 + (y1 - y0) * v / TTC_GRAPH_MAX);
+	}
+	glEnd();
+
+	//Where the animation is now
+	float duration = (float)PRECOMPUTE_SAMPLES * Precomputed.SampleStep;
+	if (duration > 0.f && Time <= duration)
+	{
+		float x = x0 + (x1 - x0) * Time / duration;
+		glColor3f(1.f, 1.f, 1.f);
+		glBegin(GL_LINES);
+			glVertex2f(x, y0);
+			glVertex2f(x, y1);
+		glEnd();
+	}
+}
+
+//Hidden time and margin, with a bar that fills as the margin shrinks
+void DrawRiskMeter( )
+{
+	SurrogatePrediction p;
+	if (RiskSurrogateOn)
+	{
+		SurrogateEval(RiskModel, CurrentScenario(), SURROGATE_TOLERANCE, &p);
+	}
+	else
+	{
+		SurrogateExact(CurrentScenario(), p.Value);
+		p.Exact = true;
+	}
+
+	char str[128];
+	if (p.Exact)
+		sprintf(str, "Risk: hidden %.2f s, margin %.2f m (exact)", p.Value[SUR_HIDDEN_TIME], p.Value[SUR_MARGIN]);
+	else
+		sprintf(str, "Risk: hidden %.2f s (+/- %.2f), margin %.2f m (+/- %.2f)", p.Value[SUR_HIDDEN_TIME],
+				p.Uncertainty[SUR_HIDDEN_TIME], p.Value[SUR_MARGIN], p.Uncertainty[SUR_MARGIN]);
+	glColor3f(1.f, 1.f, 1.f);
+	DoRasterString(2.f, 79.f, 0.f, str);
+
+	float risk = 1.f - p.Value[SUR_MARGIN] / RISK_METER_RANGE;
+	if (risk < 0.f)
+		risk = 0.f;
+	if (risk > 1.f)
+		risk = 1.f;
+
+	const float x0 = 60.f, x1 = 98.f, y0 = 78.f, y1 = 81.f;
+	glColor3f(risk, 1.f - risk, 0.f);
+	glBegin(GL_QUADS);
+		glVertex2f(x0, y0);
+		glVertex2f(x0 + (x1 - x0) * risk, y0);
+		glVertex2f(x0 + (x1 - x0) * risk, y1);
+		glVertex2f(x0, y1);
+	glEnd();
+
+	glColor3f(.2f, .2f, .2f);
+	glBegin(GL_LINE_LOOP);
+		glVertex2f(x0, y0);
+		glVertex2f(x1, y0);
+		glVertex2f(x1, y1);
+		glVertex2f(x0, y1);
+	glEnd();
+}
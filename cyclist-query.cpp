@@ -0,0 +1,209 @@
+/*******************************************************
+--------------------- Cyclist Query ---------------------
+Filter, group and aggregate a result file written by a sweep,
+however many rows it has, without loading it into memory.
+
+Usage: cyclist-query <file> [term ...]
+
+Terms, in any order:
+	Column<value  Column<=value  Column>value  Column>=value
+	Column==value  Column=min:max
+		Keep only the rows that pass; several filters must all pass.
+
+	by=Column  by=Column:width
+		One output row per distinct value of the column, or per
+		bucket of width starting at a multiple of width.
+
+	count  min(Column)  max(Column)  sum(Column)  mean(Column)
+		What to print for each group. count alone if none is given.
+
+For example, the longest hidden time in each 10 degree band of
+junction angle where the car is faster than 15 m/s:
+	cyclist-query sweep.bin "CarSpeed>15" by=AngleIntersection:10 "max(HiddenTime)"
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "job-system.h"
+#include "result-query.h"
+#include "result-store.h"
+
+void	Usage( );
+bool	ParseTerm( const char *, Query * );
+
+
+int main( int argc, char *argv[ ] )
+{
+	if (argc < 2)
+	{
+		Usage();
+		return 1;
+	}
+
+	Query q;
+	QueryInit(&q);
+	for (int arg = 2; arg < argc; arg++)
+	{
+		if (!ParseTerm(argv[arg], &q))
+		{
+			Usage();
+			return 1;
+		}
+	}
+	if (q.Aggregates.empty())
+	{
+		QueryAggregate count = { QF_COUNT, -1 };
+		q.Aggregates.push_back(count);
+	}
+
+	ResultFile rf;
+	if (!ResultFileOpen(argv[1], &rf))
+		return 1;
+
+	JobSystemStart(0, false);
+	QueryResult result;
+	//Wall time: clock( ) would add up the CPU time of every worker
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = RunQuery(rf, q, &result);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	JobSystemStop();
+	ResultFileClose(&rf);
+	if (!ok)
+		return 1;
+
+	if (q.GroupColumn >= 0)
+		printf("%-18s ", RESULT_COLUMN_NAMES[q.GroupColumn]);
+	for (size_t a = 0; a < q.Aggregates.size(); a++)
+	{
+		char label[64];
+		const QueryAggregate &agg = q.Aggregates[a];
+		if (agg.Func == QF_COUNT)
+			snprintf(label, sizeof(label), "%s", QUERY_FUNC_NAMES[agg.Func]);
+		else
+			snprintf(label, sizeof(label), "%s(%s)", QUERY_FUNC_NAMES[agg.Func], RESULT_COLUMN_NAMES[agg.Column]);
+		printf("%22s", label);
+	}
+	printf("\n");
+
+	for (size_t g = 0; g < result.Keys.size(); g++)
+	{
+		if (q.GroupColumn >= 0)
+			printf("%-18g ", result.Keys[g]);
+		for (size_t a = 0; a < q.Aggregates.size(); a++)
+			printf("%22.6g", result.Values[g * q.Aggregates.size() + a]);
+		printf("\n");
+	}
+
+	fprintf(stderr, "\n%llu of %llu rows matched; %d chunks scanned, %d skipped; %.3f s\n",
+			result.Matched, result.Rows, result.ChunksScanned, result.ChunksSkipped, seconds);
+	return 0;
+}
+
+void Usage( )
+{
+	fprintf(stderr, "Usage: cyclist-query <file> [term ...]\n\n");
+	fprintf(stderr, "  Column<value, Column<=value, Column>value, Column>=value, Column==value, Column=min:max\n");
+	fprintf(stderr, "      keep only rows that pass every filter\n");
+	fprintf(stderr, "  by=Column[:width]\n");
+	fprintf(stderr, "      group by each value of the column, or by buckets of width\n");
+	fprintf(stderr, "  count, min(Column), max(Column), sum(Column), mean(Column)\n");
+	fprintf(stderr, "      aggregates to print for each group\n");
+	fprintf(stderr, "\nColumns:");
+	for (int i = 0; i < RESULT_COLUMNS; i++)
+		fprintf(stderr, " %s", RESULT_COLUMN_NAMES[i]);
+	fprintf(stderr, "\n");
+}
+
+//Column name at the start of term up to any of stop, or -1
+static int ParseColumn( const char *term, const char *stop, const char **rest )
+{
+	size_t len = strcspn(term, stop);
+	char name[64];
+	if (len == 0 || len >= sizeof(name))
+		return -1;
+	memcpy(name, term, len);
+	name[len] = 0;
+	*rest = term + len;
+	return ResultFindColumn(name);
+}
+
+//One command line term into the query
+bool ParseTerm( const char *term, Query *q )
+{
+	const char *rest;
+
+	if (strncmp(term, "by=", 3) == 0)
+	{
+		int column = ParseColumn(term + 3, ":", &rest);
+		float width = 0.f;
+		if (column < 0 || (*rest == ':' && (sscanf(rest + 1, "%f", &width) != 1 || width <= 0.f)))
+		{
+			fprintf(stderr, "Expected by=Column or by=Column:width, not '%s'\n", term);
+			return false;
+		}
+		q->GroupColumn = column;
+		q->GroupWidth = width;
+		return true;
+	}
+
+	if (strcmp(term, "count") == 0)
+	{
+		QueryAggregate agg = { QF_COUNT, -1 };
+		q->Aggregates.push_back(agg);
+		return true;
+	}
+
+	for (int f = QF_MIN; f < QF_FUNCS; f++)
+	{
+		size_t len = strlen(QUERY_FUNC_NAMES[f]);
+		if (strncmp(term, QUERY_FUNC_NAMES[f], len) != 0 || term[len] != '(')
+			continue;
+		QueryAggregate agg = { f, ParseColumn(term + len + 1, ")", &rest) };
+		if (agg.Column < 0 || strcmp(rest, ")") != 0)
+		{
+			fprintf(stderr, "Expected %s(Column), not '%s'\n", QUERY_FUNC_NAMES[f], term);
+			return false;
+		}
+		q->Aggregates.push_back(agg);
+		return true;
+	}
+
+	QueryFilter filter;
+	filter.Column = ParseColumn(term, "<>=", &rest);
+	filter.Lo = -INFINITY;
+	filter.Hi = INFINITY;
+	float a, b;
+	char *end;
+	bool ok = filter.Column >= 0;
+	if (ok && strncmp(rest, "<=", 2) == 0)
+		filter.Hi = strtof(rest + 2, &end);
+	else if (ok && strncmp(rest, ">=", 2) == 0)
+		filter.Lo = strtof(rest + 2, &end);
+	else if (ok && strncmp(rest, "==", 2) == 0)
+		filter.Lo = filter.Hi = strtof(rest + 2, &end);
+	else if (ok && *rest == '<')
+		filter.Hi = nextafterf(strtof(rest + 1, &end), -INFINITY);
+	else if (ok && *rest == '>')
+		filter.Lo = nextafterf(strtof(rest + 1, &end), INFINITY);
+	else if (ok && *rest == '=' && sscanf(rest + 1, "%f:%f", &a, &b) == 2 && a <= b)
+	{
+		filter.Lo = a;
+		filter.Hi = b;
+		end = (char *)"";
+	}
+	else
+		ok = false;
+
+	if (!ok || *end != 0)
+	{
+		fprintf(stderr, "Unknown term '%s'\n", term);
+		return false;
+	}
+	q->Filters.push_back(filter);
+	return true;
+}
@@ -0,0 +1,121 @@
+/*******************************************************
+--------------------- Dual Numbers ---------------------
+Forward mode automatic differentiation. A Dual carries a value
+and its derivatives with respect to N chosen inputs; every
+operation applies the chain rule to all N at once, so running the
+model on Duals gives the full gradient in a single pass instead of
+2 * N finite difference runs.
+
+Comparisons look at the value only, which lets the same template
+code branch exactly as it does on plain floats.
+*******************************************************/
+
+#ifndef DUAL_NUMBER_H
+#define DUAL_NUMBER_H
+
+#include <math.h>
+
+template <int N>
+struct Dual
+{
+	float	Value;
+	float	Deriv[N];
+
+	Dual( )
+	{
+	}
+
+	//A constant: no dependence on any input
+	Dual( float v ) : Value(v)
+	{
+		for (int i = 0; i < N; i++)
+			Deriv[i] = 0.f;
+	}
+
+	//Input number i of the N being differentiated against
+	static Dual Variable( float v, int i )
+	{
+		Dual d(v);
+		d.Deriv[i] = 1.f;
+		return d;
+	}
+
+	friend Dual operator-( const Dual &a )
+	{
+		Dual r;
+		r.Value = -a.Value;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = -a.Deriv[i];
+		return r;
+	}
+
+	friend Dual operator+( const Dual &a, const Dual &b )
+	{
+		Dual r;
+		r.Value = a.Value + b.Value;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = a.Deriv[i] + b.Deriv[i];
+		return r;
+	}
+
+	friend Dual operator-( const Dual &a, const Dual &b )
+	{
+		Dual r;
+		r.Value = a.Value - b.Value;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = a.Deriv[i] - b.Deriv[i];
+		return r;
+	}
+
+	friend Dual operator*( const Dual &a, const Dual &b )
+	{
+		Dual r;
+		r.Value = a.Value * b.Value;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = a.Deriv[i] * b.Value + a.Value * b.Deriv[i];
+		return r;
+	}
+
+	friend Dual operator/( const Dual &a, const Dual &b )
+	{
+		Dual r;
+		r.Value = a.Value / b.Value;
+		float inv = 1.f / b.Value;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = (a.Deriv[i] - r.Value * b.Deriv[i]) * inv;
+		return r;
+	}
+
+	Dual &operator+=( const Dual &b )	{ return *this = *this + b; }
+	Dual &operator-=( const Dual &b )	{ return *this = *this - b; }
+	Dual &operator*=( const Dual &b )	{ return *this = *this * b; }
+	Dual &operator/=( const Dual &b )	{ return *this = *this / b; }
+
+	friend bool operator<( const Dual &a, const Dual &b )	{ return a.Value < b.Value; }
+	friend bool operator>( const Dual &a, const Dual &b )	{ return a.Value > b.Value; }
+	friend bool operator<=( const Dual &a, const Dual &b )	{ return a.Value <= b.Value; }
+	friend bool operator>=( const Dual &a, const Dual &b )	{ return a.Value >= b.Value; }
+	friend bool operator==( const Dual &a, const Dual &b )	{ return a.Value == b.Value; }
+	friend bool operator!=( const Dual &a, const Dual &b )	{ return a.Value != b.Value; }
+
+	//Derivative of f at a.Value is d; the chain rule does the rest
+	static Dual Chain( const Dual &a, float f, float d )
+	{
+		Dual r;
+		r.Value = f;
+		for (int i = 0; i < N; i++)
+			r.Deriv[i] = d * a.Deriv[i];
+		return r;
+	}
+
+	friend Dual sin( const Dual &a )	{ return Chain(a, sinf(a.Value), cosf(a.Value)); }
+	friend Dual cos( const Dual &a )	{ return Chain(a, cosf(a.Value), -sinf(a.Value)); }
+	friend Dual sqrt( const Dual &a )
+	{
+		float s = sqrtf(a.Value);
+		return Chain(a, s, s > 0.f ? 0.5f / s : 0.f);
+	}
+	friend Dual fabs( const Dual &a )	{ return Chain(a, fabsf(a.Value), a.Value < 0.f ? -1.f : 1.f); }
+};
+
+#endif
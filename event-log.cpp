@@ -0,0 +1,180 @@
+/*******************************************************
+--------------------- Event Log ---------------------
+Emitters push onto an MpscQueue; a full queue drops the event
+right there, or for a lossless log yields and tries again.
+
+The writer copies events out of the queue into a batch and writes
+the batch once it is full, or once its oldest event has waited
+EVENT_FLUSH_MS, so a busy log is written EVENT_BATCH events at a
+time and a quiet one still reaches the disk promptly.
+
+Closing waits for emitters already past the open check before it
+stops the writer. Every emitter counts itself in Emitting before
+it looks at LogOpen, and the close clears LogOpen before it looks
+at Emitting, so either the close sees the emitter or the emitter
+sees the log closed. Nothing is pushed after the writer's last
+pass then, and nothing is pushed while the next open resets the
+queue.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "event-log.h"
+#include "mpsc-queue.h"
+
+//How long the writer sleeps when the queue is empty
+const int EVENT_WRITER_SLEEP_MS = 2;
+
+const char *EVENT_NAMES[EV_TYPES] = { "HiddenStart", "HiddenEnd", "CarAtIntersection", "Collision", "NearMiss" };
+
+static MpscQueue<EventRecord, EVENT_QUEUE_SIZE>	Queue;
+static std::atomic<bool>			LogOpen(false);
+static std::atomic<int>				Emitting(0);		//EventEmit( ) calls past the open check
+static bool							Lossless;
+static std::atomic<bool>			WriterStop(false);
+static std::atomic<unsigned int>	Dropped(0);
+static std::thread					Writer;
+static FILE *						EventFile = NULL;
+static EventRecord					Batch[EVENT_BATCH];
+
+
+//Background thread: gather events into batches and write each in one go
+static void WriterLoop( )
+{
+	typedef std::chrono::steady_clock Clock;
+	int count = 0;
+	Clock::time_point oldest = Clock::now();
+	for (;;)
+	{
+		bool stopping = WriterStop.load(std::memory_order_acquire);
+		while (count < EVENT_BATCH && Queue.Pop(&Batch[count]))
+		{
+			if (count == 0)
+				oldest = Clock::now();
+			count++;
+		}
+
+		bool stale = count > 0 && Clock::now() - oldest >= std::chrono::milliseconds(EVENT_FLUSH_MS);
+		if (count == EVENT_BATCH || stale || (stopping && count > 0))
+		{
+			fwrite(Batch, sizeof(EventRecord), count, EventFile);
+			count = 0;
+			continue;
+		}
+
+		//Everything emitted before the stop was asked for has been taken
+		if (stopping)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_WRITER_SLEEP_MS));
+	}
+	fflush(EventFile);
+}
+
+
+bool EventLogOpen( const char *path, bool lossless )
+{
+	EventLogClose();
+
+	EventFile = fopen(path, "wb");
+	if (EventFile == NULL)
+	{
+		fprintf(stderr, "Unable to open event log '%s'\n", path);
+		return false;
+	}
+
+	EventHeader header;
+	memcpy(header.Magic, EVENT_MAGIC, sizeof(header.Magic));
+	header.Version = EVENT_VERSION;
+	header.RecordSize = sizeof(EventRecord);
+	fwrite(&header, sizeof(header), 1, EventFile);
+
+	Queue.Reset();
+	Dropped.store(0);
+	Lossless = lossless;
+	WriterStop.store(false);
+	Writer = std::thread(WriterLoop);
+	LogOpen.store(true, std::memory_order_release);
+	return true;
+}
+
+bool EventLogIsOpen( )
+{
+	return LogOpen.load(std::memory_order_acquire);
+}
+
+bool EventEmit( const EventRecord &e )
+{
+	Emitting.fetch_add(1, std::memory_order_seq_cst);
+	bool pushed = LogOpen.load(std::memory_order_seq_cst);
+	while (pushed && !Queue.Push(e))
+	{
+		if (!Lossless)
+		{
+			Dropped.fetch_add(1, std::memory_order_relaxed);
+			pushed = false;
+			break;
+		}
+		std::this_thread::yield();
+	}
+	Emitting.fetch_sub(1, std::memory_order_release);
+	return pushed;
+}
+
+void EventLogClose( )
+{
+	if (EventFile == NULL)
+		return;
+
+	//The writer keeps running meanwhile, so a lossless emitter waiting on a full queue gets room
+	LogOpen.store(false, std::memory_order_seq_cst);
+	while (Emitting.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+
+	WriterStop.store(true, std::memory_order_release);
+	Writer.join();
+	fclose(EventFile);
+	EventFile = NULL;
+
+	if (Dropped.load() != 0)
+		fprintf(stderr, "Event log dropped %u events\n", Dropped.load());
+}
+
+void EmitRunEvents( unsigned long long run, unsigned int source, const Scenario &scn, const TrajectoryMetrics &m )
+{
+	if (!EventLogIsOpen())
+		return;
+
+	EventRecord e;
+	e.Run = run;
+	e.Source = source;
+	e.Value = 0.f;
+	if (m.HiddenTime > 0.f)
+	{
+		e.Type = EV_HIDDEN_START;
+		e.Time = m.HiddenStart;
+		EventEmit(e);
+		e.Type = EV_HIDDEN_END;
+		e.Time = m.HiddenEnd;
+		EventEmit(e);
+	}
+
+	if (scn.CarSpeed > 0.f && scn.CarStart >= 0.f)
+	{
+		e.Type = EV_CAR_AT_INTERSECTION;
+		e.Time = scn.CarStart / scn.CarSpeed;
+		EventEmit(e);
+	}
+
+	if (m.Collision || m.MinSeparation < EVENT_NEAR_MISS_DISTANCE)
+	{
+		e.Type = m.Collision ? EV_COLLISION : EV_NEAR_MISS;
+		e.Time = m.MinSeparationTime;
+		e.Value = m.MinSeparation;
+		EventEmit(e);
+	}
+}
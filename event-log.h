@@ -0,0 +1,82 @@
+/*******************************************************
+--------------------- Event Log ---------------------
+Discrete moments of runs, written to a binary file as they
+happen: the bike entering and leaving the blindspot wedge, the car
+reaching the intersection, and a collision or near miss at the
+closest approach.
+
+Any thread may emit events. They go through a lock-free queue to
+a writer thread that gathers them into large sequential writes,
+so emitting never touches the disk. If the queue is ever full the
+event is dropped and counted, so the simulation never waits; a
+log opened lossless instead has the emitter yield until the writer
+makes room, for batch runs where every event matters more than
+the time.
+*******************************************************/
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include "blindspot-model.h"
+
+//File layout: one EventHeader followed by EventRecords in the order they were written
+const char EVENT_MAGIC[8] = { 'C', 'C', 'V', 'E', 'V', 'N', 'T', '1' };
+const unsigned int EVENT_VERSION = 1;
+
+//Events the queue holds; a power of two
+const int EVENT_QUEUE_SIZE = 1 << 16;
+
+//Events gathered into one write, and the longest an event waits for a batch to fill, in milliseconds
+const int EVENT_BATCH = 1 << 12;
+const int EVENT_FLUSH_MS = 100;
+
+//Closest approach below this that is not a collision is a near miss, in meters
+const float EVENT_NEAR_MISS_DISTANCE = 5.f;
+
+enum EventType
+{
+	EV_HIDDEN_START,		//bike enters the blindspot wedge
+	EV_HIDDEN_END,			//and leaves it
+	EV_CAR_AT_INTERSECTION,	//CarDistance reaches 0
+	EV_COLLISION,			//Value is the separation, under COLLISION_DISTANCE: when it first is
+							//for the simulation, at the closest approach for a whole run
+	EV_NEAR_MISS,			//Value is the closest approach, under EVENT_NEAR_MISS_DISTANCE
+	EV_TYPES
+};
+
+extern const char *EVENT_NAMES[EV_TYPES];
+
+//Who emitted an event
+enum EventSource
+{
+	EVS_SIMULATION,			//the GUI's simulation thread; Run counts restarts
+	EVS_SWEEP				//a batch sweep; Run is the row
+};
+
+struct EventHeader
+{
+	char			Magic[8];
+	unsigned int	Version;
+	unsigned int	RecordSize;
+};
+
+struct EventRecord
+{
+	unsigned long long	Run;
+	float				Time;		//seconds into the run
+	float				Value;		//depends on Type
+	unsigned int		Type;		//EventType
+	unsigned int		Source;		//EventSource
+};
+
+bool	EventLogOpen( const char *, bool lossless );
+bool	EventLogIsOpen( );
+//Never blocks unless the log is lossless; false if the event was dropped or no log is open
+bool	EventEmit( const EventRecord & );
+//Writes every event emitted before it was called
+void	EventLogClose( );
+
+//Emit the events of a whole run from its closed form metrics
+void	EmitRunEvents( unsigned long long run, unsigned int source, const Scenario &, const TrajectoryMetrics & );
+
+#endif
@@ -0,0 +1,339 @@
+/*******************************************************
+---------------------- Job System ----------------------
+Deques are guarded by a small lock each; a worker only ever
+contends with a thief on its own deque, so the locks are almost
+always free. Jobs submitted from outside the pool go to a shared
+injection queue that every worker checks before stealing.
+
+Job lifetime is reference counted: one reference for whoever
+created the job and one for the pool until the job has run.
+*******************************************************/
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "job-system.h"
+
+//How long an idle worker sleeps before looking for work again
+const int JOB_IDLE_WAIT_MS = 1;
+
+struct Job
+{
+	JobFunc				Func;
+	void *				Data;
+	int					Begin;
+	int					End;
+	std::atomic<int>	Pending;		//unfinished dependencies, plus one until submitted
+	std::atomic<int>	Refs;
+	std::atomic<bool>	Done;
+	std::mutex			Lock;			//guards Successors against the job finishing
+	Job *				Successors[JOB_MAX_SUCCESSORS];
+	int					SuccessorCount;
+};
+
+struct JobQueue
+{
+	std::mutex			Lock;
+	std::deque<Job *>	Jobs;
+};
+
+static JobQueue					Queues[JOB_MAX_WORKERS];
+static JobQueue					Injection;		//jobs submitted from outside the pool
+static std::thread				Workers[JOB_MAX_WORKERS];
+static int						NumWorkers;
+static std::atomic<bool>		Stopping(false);
+static std::mutex				IdleLock;
+static std::condition_variable	IdleWake;
+
+//Index of the worker running on this thread, -1 for any other thread
+static thread_local int			WorkerIndex = -1;
+static thread_local unsigned int	StealSeed = 1;
+
+
+static void ReleaseRef( Job *job )
+{
+	if (job->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete job;
+}
+
+//Put a job whose dependencies are done where a worker will find it
+static void Schedule( Job *job )
+{
+	JobQueue &q = WorkerIndex >= 0 ? Queues[WorkerIndex] : Injection;
+	{
+		std::lock_guard<std::mutex> lock(q.Lock);
+		q.Jobs.push_back(job);
+	}
+	IdleWake.notify_one();
+}
+
+static Job *PopBack( JobQueue &q )
+{
+	std::lock_guard<std::mutex> lock(q.Lock);
+	if (q.Jobs.empty())
+		return NULL;
+	Job *job = q.Jobs.back();
+	q.Jobs.pop_back();
+	return job;
+}
+
+static Job *PopFront( JobQueue &q )
+{
+	std::lock_guard<std::mutex> lock(q.Lock);
+	if (q.Jobs.empty())
+		return NULL;
+	Job *job = q.Jobs.front();
+	q.Jobs.pop_front();
+	return job;
+}
+
+//Own work first (newest, still warm in cache), then outside work, then steal the oldest
+static Job *FindJob( )
+{
+	Job *job = NULL;
+	if (WorkerIndex >= 0)
+		job = PopBack(Queues[WorkerIndex]);
+	if (job == NULL)
+		job = PopFront(Injection);
+
+	for (int i = 0; job == NULL && i < NumWorkers; i++)
+	{
+		StealSeed = StealSeed * 1103515245u + 12345u;
+		int victim = (int)((StealSeed >> 16) % (unsigned int)NumWorkers);
+		if (victim != WorkerIndex)
+			job = PopFront(Queues[victim]);
+	}
+	return job;
+}
+
+static void RunJob( Job *job )
+{
+	job->Func(job->Data, job->Begin, job->End);
+
+	//Mark done and take the successor list in one step, so nothing can be added after
+	Job *successors[JOB_MAX_SUCCESSORS];
+	int count;
+	{
+		std::lock_guard<std::mutex> lock(job->Lock);
+		job->Done.store(true, std::memory_order_release);
+		count = job->SuccessorCount;
+		for (int i = 0; i < count; i++)
+			successors[i] = job->Successors[i];
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		if (successors[i]->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Schedule(successors[i]);
+	}
+	ReleaseRef(job);
+}
+
+//Run one job if there is one; used by workers and by waiting threads
+static bool RunOne( )
+{
+	Job *job = FindJob();
+	if (job == NULL)
+		return false;
+	RunJob(job);
+	return true;
+}
+
+static void PinThread( std::thread &t, int cpu )
+{
+#ifdef WIN32
+	SetThreadAffinityMask((HANDLE)t.native_handle(), (DWORD_PTR)1 << (cpu % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+	(void)t; (void)cpu;
+#endif
+}
+
+static void WorkerLoop( int index )
+{
+	WorkerIndex = index;
+	StealSeed = 2654435761u * (unsigned int)(index + 1);
+	while (!Stopping.load(std::memory_order_acquire))
+	{
+		if (RunOne())
+			continue;
+
+		//Nothing anywhere; sleep until a submit wakes us or the timeout comes round
+		std::unique_lock<std::mutex> lock(IdleLock);
+		IdleWake.wait_for(lock, std::chrono::milliseconds(JOB_IDLE_WAIT_MS));
+	}
+}
+
+
+//Start the worker threads
+bool JobSystemStart( int workers, bool pin )
+{
+	if (NumWorkers > 0)
+		return true;
+
+	if (workers <= 0)
+	{
+		int hw = (int)std::thread::hardware_concurrency();
+		workers = hw > 1 ? hw - 1 : 1;
+	}
+	if (workers > JOB_MAX_WORKERS)
+		workers = JOB_MAX_WORKERS;
+
+	//Workers look at each other's deques, so the count has to be set before any start
+	Stopping.store(false);
+	NumWorkers = workers;
+	for (int i = 0; i < workers; i++)
+	{
+		Workers[i] = std::thread(WorkerLoop, i);
+		if (pin)
+			PinThread(Workers[i], i);
+	}
+	return true;
+}
+
+//Stop the workers once they finish the job in hand; queued jobs are left unrun
+void JobSystemStop( )
+{
+	if (NumWorkers == 0)
+		return;
+
+	Stopping.store(true, std::memory_order_release);
+	IdleWake.notify_all();
+	for (int i = 0; i < NumWorkers; i++)
+		Workers[i].join();
+	NumWorkers = 0;
+}
+
+int JobWorkerCount( )
+{
+	return NumWorkers;
+}
+
+//Make a job that is not yet submitted
+Job *JobCreate( JobFunc func, void *data, int begin, int end )
+{
+	Job *job = new Job;
+	job->Func = func;
+	job->Data = data;
+	job->Begin = begin;
+	job->End = end;
+	job->Pending.store(1);
+	job->Refs.store(2);
+	job->Done.store(false);
+	job->SuccessorCount = 0;
+	return job;
+}
+
+//Have job wait for dep; job must not have been submitted yet
+//Returns false if dep already has as many successors as it can hold
+bool JobDependsOn( Job *job, Job *dep )
+{
+	std::lock_guard<std::mutex> lock(dep->Lock);
+	if (dep->Done.load(std::memory_order_acquire))
+		return true;
+	if (dep->SuccessorCount == JOB_MAX_SUCCESSORS)
+	{
+		fprintf(stderr, "Job has more than %d jobs waiting on it\n", JOB_MAX_SUCCESSORS);
+		return false;
+	}
+	dep->Successors[dep->SuccessorCount++] = job;
+	job->Pending.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+//Let the job run once its dependencies are done
+void JobSubmit( Job *job )
+{
+	if (job->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		Schedule(job);
+}
+
+bool JobIsDone( const Job *job )
+{
+	return job->Done.load(std::memory_order_acquire);
+}
+
+//Wait for a job, running other jobs in the meantime
+void JobWait( Job *job )
+{
+	while (!JobIsDone(job))
+	{
+		if (!RunOne())
+			std::this_thread::yield();
+	}
+}
+
+//Drop the creator's reference; the job is freed once it has also run
+void JobRelease( Job *job )
+{
+	ReleaseRef(job);
+}
+
+
+//Shared by the chunks of one ParallelFor
+struct ForBatch
+{
+	JobFunc				Func;
+	void *				Data;
+	std::atomic<int>	Remaining;
+};
+
+static void ForChunk( void *data, int begin, int end )
+{
+	ForBatch *batch = (ForBatch *)data;
+	batch->Func(batch->Data, begin, end);
+	batch->Remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+//Run func over [begin, end) in chunks of at most grain items and wait for all of them
+void ParallelFor( int begin, int end, int grain, JobFunc func, void *data )
+{
+	if (end <= begin)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	//Without workers the chunks still keep to grain, since callers size buffers and index results by it
+	int chunks = (end - begin + grain - 1) / grain;
+	if (chunks == 1 || NumWorkers == 0)
+	{
+		for (int i = begin; i < end; i += grain)
+			func(data, i, i + grain < end ? i + grain : end);
+		return;
+	}
+
+	ForBatch batch;
+	batch.Func = func;
+	batch.Data = data;
+	batch.Remaining.store(chunks);
+
+	for (int i = begin; i < end; i += grain)
+	{
+		Job *job = JobCreate(ForChunk, &batch, i, i + grain < end ? i + grain : end);
+		JobSubmit(job);
+		JobRelease(job);
+	}
+
+	while (batch.Remaining.load(std::memory_order_acquire) > 0)
+	{
+		if (!RunOne())
+			std::this_thread::yield();
+	}
+}
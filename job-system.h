@@ -0,0 +1,47 @@
+/*******************************************************
+---------------------- Job System ----------------------
+One shared pool of worker threads for everything that can run
+in parallel: scenario evaluation, sweeps and any per-frame work.
+
+Each worker keeps its own deque of jobs. It pushes and pops at the
+back; idle workers steal from the front of someone else's deque.
+Jobs may depend on other jobs, and a parallel-for splits a range
+into chunks that spread out through stealing.
+
+Threads that are not workers (the GUI, the simulation thread)
+can submit and wait; a thread that waits helps run jobs instead
+of blocking, so nested parallelism never deadlocks.
+*******************************************************/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+//Largest number of worker threads
+const int JOB_MAX_WORKERS = 64;
+
+//Jobs a single job can release when it finishes
+const int JOB_MAX_SUCCESSORS = 16;
+
+typedef void (*JobFunc)( void *data, int begin, int end );
+
+struct Job;
+
+//Start the pool; workers <= 0 means one per hardware thread, less one for the GUI
+//When pin is true worker i is kept on hardware thread i
+bool	JobSystemStart( int workers, bool pin );
+void	JobSystemStop( );
+int		JobWorkerCount( );
+
+//Task graph: create jobs, wire up dependencies, then submit them
+//A job runs func( data, begin, end ) once all jobs it depends on have finished
+Job *	JobCreate( JobFunc, void *, int = 0, int = 0 );
+bool	JobDependsOn( Job *, Job * );
+void	JobSubmit( Job * );
+bool	JobIsDone( const Job * );
+void	JobWait( Job * );
+void	JobRelease( Job * );
+
+//Run func over [begin, end) in chunks of at most grain items and wait for all of them
+void	ParallelFor( int, int, int, JobFunc, void * );
+
+#endif
@@ -0,0 +1,272 @@
+/*******************************************************
+--------------------- Log ---------------------
+The writer formats each record by walking its format string: text
+is copied, and each conversion is handed to snprintf on its own
+with the argument stored for it. Integers are stored widened, so
+the conversion's length modifier is replaced by ll to match; a
+%s takes its string from the record's Text. A conversion with no
+argument left is copied as it is rather than read past the end.
+
+Formatted lines go into one buffer that is written when it is
+full, when LOG_BATCH messages are in it or when the oldest has
+waited LOG_FLUSH_MS, the same batching the event log uses.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "log.h"
+#include "mpsc-queue.h"
+
+//How long the writer sleeps when the queue is empty
+const int LOG_WRITER_SLEEP_MS = 5;
+
+//Longest line, and the text gathered into one write
+const int LOG_LINE_BYTES = 512;
+const int LOG_BUFFER_BYTES = 1 << 16;
+
+const char LOG_LEVEL_LETTERS[LOG_LEVEL_OFF] = { 'T', 'D', 'I', 'W', 'E' };
+
+typedef std::chrono::steady_clock LogClock;
+
+std::atomic<int>	LogRuntimeLevel(LOG_LEVEL_INFO);
+
+static MpscQueue<LogRecord, LOG_QUEUE_SIZE>	Queue;
+static std::atomic<bool>			Running(false);
+static std::atomic<bool>			WriterStop(false);
+static std::atomic<unsigned int>	Dropped(0);
+static std::thread					Writer;
+static FILE *						LogFile = NULL;
+static LogClock::time_point			StartTime = LogClock::now();
+static char							Buffer[LOG_BUFFER_BYTES];
+
+
+//Append at most size - 1 bytes to out; returns the bytes written
+static int Append( char *out, int size, const char *text, int length )
+{
+	if (length > size - 1)
+		length = size - 1;
+	if (length > 0)
+		memcpy(out, text, length);
+	return length > 0 ? length : 0;
+}
+
+//One line of text for the record, newline included; returns its length
+static int FormatRecord( const LogRecord &r, char *out, int size )
+{
+	int used = snprintf(out, size, "[%c %9.3f] ", LOG_LEVEL_LETTERS[r.Level], r.Time);
+	if (used < 0 || used >= size)
+		used = 0;
+
+	int arg = 0;
+	const char *p = r.Format;
+	while (*p != '\0' && used < size - 2)
+	{
+		if (*p != '%')
+		{
+			const char *run = p;
+			while (*p != '\0' && *p != '%')
+				p++;
+			used += Append(out + used, size - 1 - used, run, (int)(p - run));
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			out[used++] = '%';
+			p += 2;
+			continue;
+		}
+
+		//Flags, width and precision are kept; the length modifier is dropped
+		const char *start = p++;
+		while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+			p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		if (*p == '.')
+		{
+			p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+		const char *flagsEnd = p;
+		while (*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+			p++;
+		char conv = *p;
+		if (conv == '\0' || arg >= r.Count)
+		{
+			used += Append(out + used, size - 1 - used, start, (int)(p - start) + (conv != '\0'));
+			if (conv != '\0')
+				p++;
+			continue;
+		}
+		p++;
+
+		char spec[32];
+		int specLength = (int)(flagsEnd - start);
+		if (specLength > (int)sizeof(spec) - 4)
+			specLength = (int)sizeof(spec) - 4;
+		memcpy(spec, start, specLength);
+
+		int room = size - 1 - used;
+		int n = 0;
+		int type = r.Types[arg];
+		const LogArg &a = r.Args[arg];
+		arg++;
+		if (strchr("diouxXc", conv) != NULL)
+		{
+			long long v = type == LA_DOUBLE ? (long long)a.Double : a.Int;
+			if (conv == 'c')
+			{
+				spec[specLength] = 'c';
+				spec[specLength + 1] = '\0';
+				n = snprintf(out + used, room, spec, (int)v);
+			}
+			else
+			{
+				spec[specLength] = 'l';
+				spec[specLength + 1] = 'l';
+				spec[specLength + 2] = conv;
+				spec[specLength + 3] = '\0';
+				n = snprintf(out + used, room, spec, v);
+			}
+		}
+		else if (strchr("eEfFgGaA", conv) != NULL)
+		{
+			double v = type == LA_DOUBLE ? a.Double : type == LA_UNSIGNED ? (double)a.Unsigned : (double)a.Int;
+			spec[specLength] = conv;
+			spec[specLength + 1] = '\0';
+			n = snprintf(out + used, room, spec, v);
+		}
+		else if (conv == 's')
+		{
+			spec[specLength] = 's';
+			spec[specLength + 1] = '\0';
+			n = snprintf(out + used, room, spec, type == LA_STRING ? &r.Text[a.Int] : "?");
+		}
+		else if (conv == 'p')
+		{
+			n = snprintf(out + used, room, "%p", type == LA_POINTER ? a.Pointer : (const void *)0);
+		}
+		else
+		{
+			n = Append(out + used, room, start, (int)(p - start));
+		}
+		if (n > 0)
+			used += n < room ? n : room - 1;
+	}
+
+	//Messages carry their own newline the way fprintf( ) calls did; add one if not
+	if (used == 0 || out[used - 1] != '\n')
+		out[used++] = '\n';
+	out[used] = '\0';
+	return used;
+}
+
+//Background thread: format what is queued and write it in batches
+static void WriterLoop( )
+{
+	int bytes = 0, count = 0;
+	LogClock::time_point oldest = LogClock::now();
+	LogRecord r;
+	for (;;)
+	{
+		bool stopping = WriterStop.load(std::memory_order_acquire);
+		while (count < LOG_BATCH && bytes + LOG_LINE_BYTES <= LOG_BUFFER_BYTES && Queue.Pop(&r))
+		{
+			if (count == 0)
+				oldest = LogClock::now();
+			bytes += FormatRecord(r, &Buffer[bytes], LOG_LINE_BYTES);
+			count++;
+		}
+
+		bool full = count == LOG_BATCH || bytes + LOG_LINE_BYTES > LOG_BUFFER_BYTES;
+		bool stale = count > 0 && LogClock::now() - oldest >= std::chrono::milliseconds(LOG_FLUSH_MS);
+		if (full || stale || (stopping && count > 0))
+		{
+			fwrite(Buffer, 1, bytes, LogFile);
+			fflush(LogFile);
+			bytes = count = 0;
+			continue;
+		}
+
+		if (stopping)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_SLEEP_MS));
+	}
+}
+
+
+bool LogStart( const char *path )
+{
+	LogStop();
+
+	if (path != NULL)
+	{
+		LogFile = fopen(path, "w");
+		if (LogFile == NULL)
+		{
+			fprintf(stderr, "Unable to open log '%s'\n", path);
+			return false;
+		}
+	}
+	else
+	{
+		LogFile = stderr;
+	}
+
+	Queue.Reset();
+	Dropped.store(0);
+	StartTime = LogClock::now();
+	WriterStop.store(false);
+	Writer = std::thread(WriterLoop);
+	Running.store(true, std::memory_order_release);
+	return true;
+}
+
+void LogStop( )
+{
+	if (LogFile == NULL)
+		return;
+
+	Running.store(false, std::memory_order_release);
+	WriterStop.store(true, std::memory_order_release);
+	Writer.join();
+	if (LogFile != stderr)
+		fclose(LogFile);
+	LogFile = NULL;
+
+	if (Dropped.load() != 0)
+		fprintf(stderr, "Log dropped %u messages\n", Dropped.load());
+}
+
+void LogSetLevel( int level )
+{
+	LogRuntimeLevel.store(level, std::memory_order_relaxed);
+}
+
+void LogBegin( LogRecord *r, int level, const char *format )
+{
+	r->Time = std::chrono::duration<double>(LogClock::now() - StartTime).count();
+	r->Format = format;
+	r->Level = (unsigned char)level;
+	r->Count = 0;
+	r->TextUsed = 0;
+}
+
+void LogPost( const LogRecord &r )
+{
+	if (Running.load(std::memory_order_acquire))
+	{
+		if (!Queue.Push(r))
+			Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	char line[LOG_LINE_BYTES];
+	int length = FormatRecord(r, line, sizeof(line));
+	fwrite(line, 1, length, stderr);
+}
@@ -0,0 +1,211 @@
+/*******************************************************
+--------------------- Log ---------------------
+Leveled diagnostic messages for the interactive program, cheap
+enough to leave in the GLUT callbacks that run every frame.
+
+A call below LOG_COMPILE_LEVEL is removed by the preprocessor,
+arguments and all, so a release build pays nothing for its debug
+messages. A call above it but below the runtime level costs one
+relaxed load and a branch. Only an enabled call does work, and
+even then it does not format: the format string (which must be a
+literal) and the raw arguments are copied into a fixed record and
+pushed onto a lock-free queue. A writer thread turns the records
+into text and writes them in batches, so the caller never waits
+on printf or on stderr. If the queue is full the message is
+dropped and counted rather than stalling the frame.
+
+Before LogStart( ) and after LogStop( ) messages are written
+straight away, so nothing is lost at start up or shut down.
+*******************************************************/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+
+#include <atomic>
+
+enum LogLevel
+{
+	LOG_LEVEL_TRACE,
+	LOG_LEVEL_DEBUG,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_OFF
+};
+
+//Lowest level compiled in; set it on the compiler command line to override
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL	2		//LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL	0		//LOG_LEVEL_TRACE
+#endif
+#endif
+
+//Arguments one message may carry, and bytes of string arguments copied with it
+const int LOG_MAX_ARGS = 8;
+const int LOG_TEXT_BYTES = 64;
+
+//Messages the queue holds; a power of two
+const int LOG_QUEUE_SIZE = 1 << 12;
+
+//Messages formatted into one write, and the longest one waits for the rest, in milliseconds
+const int LOG_BATCH = 256;
+const int LOG_FLUSH_MS = 50;
+
+enum LogArgType
+{
+	LA_INT,
+	LA_UNSIGNED,
+	LA_DOUBLE,
+	LA_STRING,		//offset into the record's Text
+	LA_POINTER
+};
+
+union LogArg
+{
+	long long			Int;
+	unsigned long long	Unsigned;
+	double				Double;
+	const void *		Pointer;
+};
+
+struct LogRecord
+{
+	double			Time;					//seconds since the log started
+	const char *	Format;
+	unsigned char	Level;
+	unsigned char	Count;
+	unsigned char	Types[LOG_MAX_ARGS];
+	unsigned char	TextUsed;
+	LogArg			Args[LOG_MAX_ARGS];
+	char			Text[LOG_TEXT_BYTES];
+};
+
+extern std::atomic<int>	LogRuntimeLevel;
+
+//Start the writer thread; path NULL writes to stderr
+bool	LogStart( const char *path );
+//Write what is queued and stop the writer; later messages are written directly
+void	LogStop( );
+
+//Messages below level are skipped at run time
+void	LogSetLevel( int level );
+
+//Fill in the record's header; the arguments are added by LogPack( )
+void	LogBegin( LogRecord *, int level, const char *format );
+//Queue the record, or write it now if the writer is not running
+void	LogPost( const LogRecord & );
+
+inline bool LogEnabled( int level )
+{
+	return level >= LogRuntimeLevel.load(std::memory_order_relaxed);
+}
+
+//One overload per kind of argument; narrower types promote onto these
+inline void LogPackValue( LogRecord *r, LogArgType type, LogArg a )
+{
+	if (r->Count < LOG_MAX_ARGS)
+	{
+		r->Types[r->Count] = (unsigned char)type;
+		r->Args[r->Count] = a;
+		r->Count++;
+	}
+}
+
+inline void LogPack( LogRecord *r, long long v )			{ LogArg a; a.Int = v; LogPackValue(r, LA_INT, a); }
+inline void LogPack( LogRecord *r, int v )					{ LogPack(r, (long long)v); }
+inline void LogPack( LogRecord *r, long v )					{ LogPack(r, (long long)v); }
+inline void LogPack( LogRecord *r, unsigned long long v )	{ LogArg a; a.Unsigned = v; LogPackValue(r, LA_UNSIGNED, a); }
+inline void LogPack( LogRecord *r, unsigned int v )			{ LogPack(r, (unsigned long long)v); }
+inline void LogPack( LogRecord *r, unsigned long v )		{ LogPack(r, (unsigned long long)v); }
+inline void LogPack( LogRecord *r, double v )				{ LogArg a; a.Double = v; LogPackValue(r, LA_DOUBLE, a); }
+inline void LogPack( LogRecord *r, const void *v )			{ LogArg a; a.Pointer = v; LogPackValue(r, LA_POINTER, a); }
+
+//Strings are copied, truncated to what is left of the record's Text
+//TextUsed stops at the last byte, which is then a terminator every later string shares
+inline void LogPack( LogRecord *r, const char *s )
+{
+	LogArg a;
+	int room = LOG_TEXT_BYTES - 1 - r->TextUsed;
+	if (room <= 0)
+	{
+		r->Text[LOG_TEXT_BYTES - 1] = '\0';
+		a.Int = LOG_TEXT_BYTES - 1;
+		LogPackValue(r, LA_STRING, a);
+		return;
+	}
+
+	a.Int = r->TextUsed;
+	int n = 0;
+	if (s == NULL)
+		s = "(null)";
+	while (n < room && s[n] != '\0')
+	{
+		r->Text[r->TextUsed + n] = s[n];
+		n++;
+	}
+	r->Text[r->TextUsed + n] = '\0';
+	int used = r->TextUsed + n + 1;
+	r->TextUsed = (unsigned char)(used < LOG_TEXT_BYTES - 1 ? used : LOG_TEXT_BYTES - 1);
+	LogPackValue(r, LA_STRING, a);
+}
+
+inline void LogPackAll( LogRecord * )
+{
+}
+
+template <typename First, typename... Rest>
+inline void LogPackAll( LogRecord *r, const First &first, const Rest &... rest )
+{
+	LogPack(r, first);
+	LogPackAll(r, rest...);
+}
+
+template <typename... Args>
+void LogMessage( int level, const char *format, const Args &... args )
+{
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many arguments for one log message");
+	LogRecord r;
+	LogBegin(&r, level, format);
+	LogPackAll(&r, args...);
+	LogPost(r);
+}
+
+//The checks are on constants and one relaxed load; the arguments are only evaluated when the message is wanted
+#define LOG_AT(level, ...) \
+	do { if (LogEnabled(level)) LogMessage(level, __VA_ARGS__); } while (0)
+
+#if LOG_COMPILE_LEVEL <= 0
+#define LOG_TRACE(...)	LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...)	((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 1
+#define LOG_DEBUG(...)	LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)	((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 2
+#define LOG_INFO(...)	LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)	((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 3
+#define LOG_WARN(...)	LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)	((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 4
+#define LOG_ERROR(...)	LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)	((void)0)
+#endif
+
+#endif
@@ -0,0 +1,420 @@
+/*******************************************************
+-------------------- Lookup Table --------------------
+Blocks are laid out one after another with the last axis
+(BikeSpeed) changing fastest, both between blocks and between
+the points inside a block. A grid point is found by splitting
+its index on each axis into a block and a position in that block.
+
+Blocks are computed in batches on the job system and written out
+in order, so memory use stays at one batch however large the
+table grows. The table is written to a temporary file and only
+replaces the old one once it is complete.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+
+#include "job-system.h"
+#include "lookup-table.h"
+
+//Blocks computed before they are written out together
+const int LUT_BATCH_BLOCKS = 32;
+
+static const size_t BLOCK_FLOATS = (size_t)LUT_BLOCK_POINTS * LUT_METRICS;
+
+
+static int FloorDiv( int a, int b )
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+//True if the mapped file holds a complete table of this version
+static bool ValidTable( const MappedFile &mf )
+{
+	const LookupHeader *header = (const LookupHeader *)mf.Data;
+	if (mf.Size < sizeof(LookupHeader) ||
+		memcmp(header->Magic, LOOKUP_MAGIC, sizeof(header->Magic)) != 0 ||
+		header->Version != LOOKUP_VERSION ||
+		header->Metrics != LUT_METRICS ||
+		header->Block != LUT_BLOCK)
+		return false;
+
+	size_t blocks = 1;
+	for (int i = 0; i < SCN_FIELDS; i++)
+		blocks *= (size_t)header->Blocks[i];
+	return mf.Size >= sizeof(LookupHeader) + blocks * BLOCK_FLOATS * sizeof(float);
+}
+
+static void SetBlockRange( LookupHeader *header )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		header->BlockLo[i] = FloorDiv(header->Grid.Lo[i], LUT_BLOCK);
+		header->Blocks[i] = FloorDiv(header->Grid.Hi[i], LUT_BLOCK) - header->BlockLo[i] + 1;
+	}
+}
+
+//Values of grid point g, which has to be inside the table's blocks
+static const float *PointValues( const LookupTable &table, const int *g )
+{
+	const LookupHeader *h = table.Header;
+	size_t block = 0;
+	int within = 0;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		int b = FloorDiv(g[i], LUT_BLOCK);
+		block = block * (size_t)h->Blocks[i] + (size_t)(b - h->BlockLo[i]);
+		within = within * LUT_BLOCK + (g[i] - b * LUT_BLOCK);
+	}
+	return table.Values + (block * LUT_BLOCK_POINTS + within) * LUT_METRICS;
+}
+
+//Block coordinates of the block stored at position index
+static void BlockCoords( const LookupHeader &header, size_t index, int *coords )
+{
+	for (int i = SCN_FIELDS - 1; i >= 0; i--)
+	{
+		coords[i] = header.BlockLo[i] + (int)(index % (size_t)header.Blocks[i]);
+		index /= (size_t)header.Blocks[i];
+	}
+}
+
+//Position of a block in a table, or -1 if the table does not have it
+static long long BlockIndex( const LookupHeader &header, const int *coords )
+{
+	long long index = 0;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		int b = coords[i] - header.BlockLo[i];
+		if (b < 0 || b >= header.Blocks[i])
+			return -1;
+		index = index * header.Blocks[i] + b;
+	}
+	return index;
+}
+
+
+//Grid over the slider ranges with points grid points along each axis
+void LookupGridDefault( int points, LookupGrid *grid )
+{
+	if (points < 2)
+		points = 2;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		grid->Origin[i] = SCENARIO_MIN[i];
+		grid->Step[i] = (SCENARIO_MAX[i] - SCENARIO_MIN[i]) / (float)(points - 1);
+		grid->Lo[i] = 0;
+		grid->Hi[i] = points - 1;
+	}
+}
+
+void LookupExact( const Scenario &scn, float *values )
+{
+	TrajectoryMetrics m;
+	ComputeTrajectoryMetrics(scn, &m);
+	values[LUT_HIDDEN_TIME] = m.HiddenTime;
+	values[LUT_MIN_SEPARATION] = m.MinSeparation;
+	values[LUT_MIN_SEPARATION_TIME] = m.MinSeparationTime;
+}
+
+
+//Shared by the jobs filling one batch of blocks
+struct BuildBatch
+{
+	const LookupHeader *	Header;
+	const LookupTable *		Old;		//table being extended, NULL if there is none
+	size_t					First;		//position of the first block in the batch
+	float *					Values;
+	std::atomic<int>		Reused;
+	std::atomic<int>		Computed;
+};
+
+static void BuildBlocks( void *data, int begin, int end )
+{
+	BuildBatch *batch = (BuildBatch *)data;
+	const LookupGrid &grid = batch->Header->Grid;
+
+	for (int n = begin; n < end; n++)
+	{
+		float *out = batch->Values + (size_t)n * BLOCK_FLOATS;
+		int coords[SCN_FIELDS];
+		BlockCoords(*batch->Header, batch->First + n, coords);
+
+		//Same grid, so a block the old table has is still right
+		long long old = batch->Old != NULL ? BlockIndex(*batch->Old->Header, coords) : -1;
+		if (old >= 0)
+		{
+			memcpy(out, batch->Old->Values + (size_t)old * BLOCK_FLOATS, BLOCK_FLOATS * sizeof(float));
+			batch->Reused.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		for (int p = 0; p < LUT_BLOCK_POINTS; p++)
+		{
+			Scenario scn;
+			int rest = p;
+			for (int i = SCN_FIELDS - 1; i >= 0; i--)
+			{
+				int g = coords[i] * LUT_BLOCK + rest % LUT_BLOCK;
+				rest /= LUT_BLOCK;
+				SetScenarioField(&scn, i, grid.Origin[i] + (float)g * grid.Step[i]);
+			}
+			LookupExact(scn, out + (size_t)p * LUT_METRICS);
+		}
+		batch->Computed.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+//Shared by the jobs checking a finished table against the exact solution
+struct ErrorCheck
+{
+	const LookupTable *	Table;
+	float *				Errors;		//LUT_METRICS per sample
+};
+
+static void CheckErrors( void *data, int begin, int end )
+{
+	ErrorCheck *check = (ErrorCheck *)data;
+	const LookupGrid &grid = check->Table->Header->Grid;
+
+	for (int n = begin; n < end; n++)
+	{
+		//Same points every build, so errors of two builds can be compared
+		unsigned int seed = 2654435761u * (unsigned int)(n + 1);
+		Scenario scn;
+		for (int i = 0; i < SCN_FIELDS; i++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			float u = (float)(seed >> 8) / (float)(1 << 24);
+			float lo = grid.Origin[i] + (float)grid.Lo[i] * grid.Step[i];
+			float hi = grid.Origin[i] + (float)grid.Hi[i] * grid.Step[i];
+			SetScenarioField(&scn, i, lo + u * (hi - lo));
+		}
+
+		float exact[LUT_METRICS], table[LUT_METRICS];
+		LookupExact(scn, exact);
+		LookupTableEval(*check->Table, scn, table);
+		for (int m = 0; m < LUT_METRICS; m++)
+			check->Errors[(size_t)n * LUT_METRICS + m] = fabsf(table[m] - exact[m]);
+	}
+}
+
+//Fill in the error bounds of the table written to path
+static bool MeasureErrors( const char *path, LookupHeader *header )
+{
+	LookupTable table;
+	if (!LookupTableOpen(path, &table))
+		return false;
+
+	std::vector<float> errors((size_t)LUT_ERROR_SAMPLES * LUT_METRICS);
+	ErrorCheck check = { &table, &errors[0] };
+	ParallelFor(0, LUT_ERROR_SAMPLES, 256, CheckErrors, &check);
+	LookupTableClose(&table);
+
+	for (int m = 0; m < LUT_METRICS; m++)
+	{
+		double sum = 0.;
+		float worst = 0.f;
+		for (int n = 0; n < LUT_ERROR_SAMPLES; n++)
+		{
+			float e = errors[(size_t)n * LUT_METRICS + m];
+			sum += e;
+			if (e > worst)
+				worst = e;
+		}
+		header->MaxError[m] = worst;
+		header->MeanError[m] = (float)(sum / LUT_ERROR_SAMPLES);
+	}
+	return true;
+}
+
+//Build the table at path, reusing any blocks of the same grid already there
+bool LookupTableBuild( const char *path, const LookupGrid &grid )
+{
+	LookupHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, LOOKUP_MAGIC, sizeof(header.Magic));
+	header.Version = LOOKUP_VERSION;
+	header.Metrics = LUT_METRICS;
+	header.Block = LUT_BLOCK;
+	header.Grid = grid;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		if (!(grid.Step[i] > 0.f) || grid.Hi[i] < grid.Lo[i])
+		{
+			fprintf(stderr, "Lookup table axis %d has no points\n", i);
+			return false;
+		}
+	}
+	SetBlockRange(&header);
+
+	size_t blocks = 1;
+	for (int i = 0; i < SCN_FIELDS; i++)
+		blocks *= (size_t)header.Blocks[i];
+
+	//An existing table on the same grid points donates its blocks
+	LookupTable old;
+	bool reuse = false;
+	if (MapFile(path, &old.File))
+	{
+		old.Header = (const LookupHeader *)old.File.Data;
+		old.Values = (const float *)(old.File.Data + sizeof(LookupHeader));
+		reuse = ValidTable(old.File) &&
+				memcmp(old.Header->Grid.Origin, grid.Origin, sizeof(grid.Origin)) == 0 &&
+				memcmp(old.Header->Grid.Step, grid.Step, sizeof(grid.Step)) == 0;
+		if (!reuse)
+		{
+			fprintf(stderr, "'%s' is on a different grid, rebuilding all of it\n", path);
+			UnmapFile(&old.File);
+		}
+	}
+
+	char temp[1024];
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	FILE *fp = fopen(temp, "wb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Unable to open '%s'\n", temp);
+		if (reuse)
+			UnmapFile(&old.File);
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, fp);
+
+	BuildBatch batch;
+	batch.Header = &header;
+	batch.Old = reuse ? &old : NULL;
+	batch.Reused.store(0);
+	batch.Computed.store(0);
+	std::vector<float> values((size_t)LUT_BATCH_BLOCKS * BLOCK_FLOATS);
+	batch.Values = &values[0];
+
+	bool ok = true;
+	for (size_t first = 0; first < blocks && ok; first += LUT_BATCH_BLOCKS)
+	{
+		int count = blocks - first < (size_t)LUT_BATCH_BLOCKS ? (int)(blocks - first) : LUT_BATCH_BLOCKS;
+		batch.First = first;
+		ParallelFor(0, count, 1, BuildBlocks, &batch);
+		ok = fwrite(batch.Values, sizeof(float) * BLOCK_FLOATS, count, fp) == (size_t)count;
+		fprintf(stderr, "\rLookup table: %d blocks computed, %d reused of %d", batch.Computed.load(), batch.Reused.load(), (int)blocks);
+	}
+	fprintf(stderr, "\n");
+	fclose(fp);
+	if (reuse)
+		UnmapFile(&old.File);
+	if (!ok)
+	{
+		fprintf(stderr, "Unable to write '%s'\n", temp);
+		remove(temp);
+		return false;
+	}
+
+	//Store the error bounds in the header, then put the table in place
+	if (!MeasureErrors(temp, &header))
+		return false;
+	fp = fopen(temp, "r+b");
+	if (fp == NULL || fwrite(&header, sizeof(header), 1, fp) != 1)
+	{
+		fprintf(stderr, "Unable to write '%s'\n", temp);
+		if (fp != NULL)
+			fclose(fp);
+		return false;
+	}
+	fclose(fp);
+
+	remove(path);
+	if (rename(temp, path) != 0)
+	{
+		fprintf(stderr, "Unable to rename '%s' to '%s'\n", temp, path);
+		return false;
+	}
+	return true;
+}
+
+bool LookupTableOpen( const char *path, LookupTable *table )
+{
+	table->Header = NULL;
+	table->Values = NULL;
+	if (!MapFile(path, &table->File))
+	{
+		fprintf(stderr, "Unable to open lookup table '%s'\n", path);
+		return false;
+	}
+	if (!ValidTable(table->File))
+	{
+		fprintf(stderr, "'%s' is not a complete version %u lookup table\n", path, LOOKUP_VERSION);
+		UnmapFile(&table->File);
+		return false;
+	}
+
+	table->Header = (const LookupHeader *)table->File.Data;
+	table->Values = (const float *)(table->File.Data + sizeof(LookupHeader));
+	return true;
+}
+
+void LookupTableClose( LookupTable *table )
+{
+	if (table->Header == NULL)
+		return;
+
+	UnmapFile(&table->File);
+	table->Header = NULL;
+	table->Values = NULL;
+}
+
+//Interpolated metrics, indexed by LookupMetric
+//Returns false if the scenario is outside the table, whose edges are used instead
+bool LookupTableEval( const LookupTable &table, const Scenario &scn, float *values )
+{
+	const LookupGrid &grid = table.Header->Grid;
+	bool inside = true;
+	int k[SCN_FIELDS];
+	float f[SCN_FIELDS];
+
+	//Grid cell holding the scenario and how far across it the scenario is
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		float u = (GetScenarioField(scn, i) - grid.Origin[i]) / grid.Step[i];
+		if (u < (float)grid.Lo[i])
+		{
+			u = (float)grid.Lo[i];
+			inside = false;
+		}
+		if (u > (float)grid.Hi[i])
+		{
+			u = (float)grid.Hi[i];
+			inside = false;
+		}
+		k[i] = (int)floorf(u);
+		if (k[i] >= grid.Hi[i])
+			k[i] = grid.Hi[i] > grid.Lo[i] ? grid.Hi[i] - 1 : grid.Lo[i];
+		f[i] = u - (float)k[i];
+	}
+
+	for (int m = 0; m < LUT_METRICS; m++)
+		values[m] = 0.f;
+
+	//Weighted sum over the corners of the cell
+	for (int corner = 0; corner < (1 << SCN_FIELDS); corner++)
+	{
+		float weight = 1.f;
+		int g[SCN_FIELDS];
+		for (int i = 0; i < SCN_FIELDS; i++)
+		{
+			int bit = (corner >> i) & 1;
+			weight *= bit ? f[i] : 1.f - f[i];
+			g[i] = k[i] + bit;
+		}
+		if (weight == 0.f)
+			continue;
+
+		const float *p = PointValues(table, g);
+		for (int m = 0; m < LUT_METRICS; m++)
+			values[m] += weight * p[m];
+	}
+	return inside;
+}
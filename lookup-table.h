@@ -0,0 +1,93 @@
+/*******************************************************
+-------------------- Lookup Table --------------------
+Key metrics of a run, sampled on a regular grid over the slider
+ranges and stored in a file that is memory mapped for use. Any
+slider combination is then a multilinear interpolation between
+the 2^7 grid points around it, cheap enough for any machine to
+do every frame.
+
+The table is built offline in blocks of LUT_BLOCK points along
+every axis. Grid points sit at fixed spots, so when a range is
+extended the blocks already in the old file are copied over and
+only the new ones are computed.
+
+Building also compares the table against the exact solution at
+random points and stores the worst and mean errors it found.
+*******************************************************/
+
+#ifndef LOOKUP_TABLE_H
+#define LOOKUP_TABLE_H
+
+#include "blindspot-model.h"
+#include "mapped-file.h"
+
+//File layout: one LookupHeader followed by every block of the grid
+const char LOOKUP_MAGIC[8]	= { 'C', 'C', 'V', 'L', 'U', 'T', 'B', '1' };
+const unsigned int LOOKUP_VERSION = 1;
+
+//Grid points along each axis of one block
+const int LUT_BLOCK = 4;
+const int LUT_BLOCK_POINTS = LUT_BLOCK * LUT_BLOCK * LUT_BLOCK * LUT_BLOCK * LUT_BLOCK * LUT_BLOCK * LUT_BLOCK;
+
+//Grid points along each axis of the default table, ends included
+//A multiple of LUT_BLOCK leaves no part of a block outside the table
+const int LUT_DEFAULT_POINTS = 8;
+
+//Random points checked against the exact solution after a build
+const int LUT_ERROR_SAMPLES = 20000;
+
+//Metrics in the table, from ComputeTrajectoryMetrics( )
+enum LookupMetric
+{
+	LUT_HIDDEN_TIME,
+	LUT_MIN_SEPARATION,
+	LUT_MIN_SEPARATION_TIME,
+	LUT_METRICS
+};
+
+//Grid point k along axis i is at Origin[i] + k * Step[i]; the table covers Lo[i] to Hi[i]
+struct LookupGrid
+{
+	float	Origin[SCN_FIELDS];
+	float	Step[SCN_FIELDS];
+	int		Lo[SCN_FIELDS];
+	int		Hi[SCN_FIELDS];
+};
+
+struct LookupHeader
+{
+	char			Magic[8];
+	unsigned int	Version;
+	unsigned int	Metrics;		//LUT_METRICS
+	unsigned int	Block;			//LUT_BLOCK
+	LookupGrid		Grid;
+	int				BlockLo[SCN_FIELDS];	//first block along each axis
+	int				Blocks[SCN_FIELDS];		//blocks along each axis
+	float			MaxError[LUT_METRICS];	//worst difference from the exact solution that was found
+	float			MeanError[LUT_METRICS];
+};
+
+struct LookupTable
+{
+	MappedFile				File;
+	const LookupHeader *	Header;
+	const float *			Values;		//LUT_METRICS floats per grid point, block after block
+};
+
+//Grid over the slider ranges with points grid points along each axis
+void	LookupGridDefault( int points, LookupGrid * );
+
+//Build the table at path, reusing any blocks of the same grid already there
+bool	LookupTableBuild( const char *, const LookupGrid & );
+
+bool	LookupTableOpen( const char *, LookupTable * );
+void	LookupTableClose( LookupTable * );
+
+//Interpolated metrics, indexed by LookupMetric
+//Returns false if the scenario is outside the table, whose edges are used instead
+bool	LookupTableEval( const LookupTable &, const Scenario &, float * );
+
+//Exact metrics in the same order, for comparing against the table
+void	LookupExact( const Scenario &, float * );
+
+#endif
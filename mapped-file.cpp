@@ -0,0 +1,112 @@
+/*******************************************************
+--------------------- Mapped File ---------------------
+CreateFileMapping( ) on Windows, mmap( ) everywhere else.
+An empty file maps to Data == NULL, Size == 0.
+*******************************************************/
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped-file.h"
+
+
+#ifdef WIN32
+
+bool MapFile( const char *path, MappedFile *mf )
+{
+	mf->Data = NULL;
+	mf->Size = 0;
+	mf->Mapping = NULL;
+	mf->File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mf->File == INVALID_HANDLE_VALUE)
+	{
+		mf->File = NULL;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx((HANDLE)mf->File, &size))
+	{
+		UnmapFile(mf);
+		return false;
+	}
+	mf->Size = (size_t)size.QuadPart;
+	if (mf->Size == 0)
+		return true;
+
+	mf->Mapping = CreateFileMappingA((HANDLE)mf->File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mf->Mapping != NULL)
+		mf->Data = (const unsigned char *)MapViewOfFile((HANDLE)mf->Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mf->Data == NULL)
+	{
+		UnmapFile(mf);
+		return false;
+	}
+	return true;
+}
+
+void UnmapFile( MappedFile *mf )
+{
+	if (mf->Data != NULL)
+		UnmapViewOfFile(mf->Data);
+	if (mf->Mapping != NULL)
+		CloseHandle((HANDLE)mf->Mapping);
+	if (mf->File != NULL)
+		CloseHandle((HANDLE)mf->File);
+	mf->Data = NULL;
+	mf->Size = 0;
+	mf->Mapping = NULL;
+	mf->File = NULL;
+}
+
+#else
+
+bool MapFile( const char *path, MappedFile *mf )
+{
+	mf->Data = NULL;
+	mf->Size = 0;
+	mf->Fd = open(path, O_RDONLY);
+	if (mf->Fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(mf->Fd, &st) != 0)
+	{
+		UnmapFile(mf);
+		return false;
+	}
+	mf->Size = (size_t)st.st_size;
+	if (mf->Size == 0)
+		return true;
+
+	void *data = mmap(NULL, mf->Size, PROT_READ, MAP_SHARED, mf->Fd, 0);
+	if (data == MAP_FAILED)
+	{
+		mf->Size = 0;
+		UnmapFile(mf);
+		return false;
+	}
+	mf->Data = (const unsigned char *)data;
+	return true;
+}
+
+void UnmapFile( MappedFile *mf )
+{
+	if (mf->Data != NULL)
+		munmap((void *)mf->Data, mf->Size);
+	if (mf->Fd >= 0)
+		close(mf->Fd);
+	mf->Data = NULL;
+	mf->Size = 0;
+	mf->Fd = -1;
+}
+
+#endif
@@ -0,0 +1,27 @@
+/*******************************************************
+--------------------- Mapped File ---------------------
+Read-only memory mapping of a whole file, so large recordings
+and tables can be used in place without being read into memory.
+*******************************************************/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+struct MappedFile
+{
+	const unsigned char *	Data;
+	size_t					Size;
+#ifdef WIN32
+	void *					File;		//HANDLE of the open file
+	void *					Mapping;	//HANDLE of the file mapping
+#else
+	int						Fd;
+#endif
+};
+
+bool	MapFile( const char *, MappedFile * );
+void	UnmapFile( MappedFile * );
+
+#endif
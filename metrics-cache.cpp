@@ -0,0 +1,247 @@
+/*******************************************************
+-------------------- Metrics Cache --------------------
+Each shard is a hash map into a recency list: a hit moves the
+entry to the front and an insert past the shard's share of
+METRICS_CACHE_CAPACITY drops the entry at the back. Keys pick
+their shard from the same hash, so unrelated lookups rarely
+share a lock.
+
+The disk tier keeps only an index of key to file offset in memory.
+Records are read back on a memory miss and appended as new results
+come in. Appends go to the end of the last whole record rather than
+the end of the file, so a record half written when the program died
+is ignored on the next open and then written over.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "metrics-cache.h"
+
+struct MetricsKeyHash
+{
+	size_t operator()( const MetricsKey &key ) const
+	{
+		//FNV-1a over the quantized values
+		unsigned int h = 2166136261u;
+		for (int i = 0; i < METRICS_KEY_FIELDS; i++)
+		{
+			h ^= (unsigned int)key.Values[i];
+			h *= 16777619u;
+		}
+		return h;
+	}
+};
+
+struct MetricsKeyEqual
+{
+	bool operator()( const MetricsKey &a, const MetricsKey &b ) const
+	{
+		return memcmp(a.Values, b.Values, sizeof(a.Values)) == 0;
+	}
+};
+
+typedef std::list<MetricsCacheRecord>	CacheList;
+typedef std::unordered_map<MetricsKey, CacheList::iterator, MetricsKeyHash, MetricsKeyEqual>	CacheIndex;
+typedef std::unordered_map<MetricsKey, long, MetricsKeyHash, MetricsKeyEqual>				OffsetIndex;
+
+struct CacheShard
+{
+	std::mutex	Lock;
+	CacheList	Entries;		//most recently used first
+	CacheIndex	Index;
+};
+
+static CacheShard			Shards[METRICS_CACHE_SHARDS];
+static std::atomic<int>		Hits(0);
+static std::atomic<int>		Misses(0);
+
+//Disk tier
+static std::mutex			DiskLock;
+static FILE *				DiskFile = NULL;
+static OffsetIndex			DiskIndex;
+static long					DiskEnd;			//end of the last whole record
+
+
+static CacheShard &ShardOf( const MetricsKey &key )
+{
+	return Shards[MetricsKeyHash()(key) % METRICS_CACHE_SHARDS];
+}
+
+//Put a record at the front of its shard, evicting the least recently used if the shard is full
+static void Remember( const MetricsCacheRecord &record )
+{
+	CacheShard &shard = ShardOf(record.Key);
+	std::lock_guard<std::mutex> lock(shard.Lock);
+
+	CacheIndex::iterator found = shard.Index.find(record.Key);
+	if (found != shard.Index.end())
+	{
+		found->second->Metrics = record.Metrics;
+		shard.Entries.splice(shard.Entries.begin(), shard.Entries, found->second);
+		return;
+	}
+
+	shard.Entries.push_front(record);
+	shard.Index[record.Key] = shard.Entries.begin();
+	if ((int)shard.Entries.size() > METRICS_CACHE_CAPACITY / METRICS_CACHE_SHARDS)
+	{
+		shard.Index.erase(shard.Entries.back().Key);
+		shard.Entries.pop_back();
+	}
+}
+
+static bool FindOnDisk( const MetricsKey &key, MetricsCacheRecord *record )
+{
+	std::lock_guard<std::mutex> lock(DiskLock);
+	if (DiskFile == NULL)
+		return false;
+
+	OffsetIndex::iterator found = DiskIndex.find(key);
+	if (found == DiskIndex.end())
+		return false;
+
+	if (fseek(DiskFile, found->second, SEEK_SET) != 0 || fread(record, sizeof(*record), 1, DiskFile) != 1)
+	{
+		fprintf(stderr, "Unable to read metrics cache record at %ld\n", found->second);
+		return false;
+	}
+	return true;
+}
+
+static void StoreOnDisk( const MetricsCacheRecord &record )
+{
+	std::lock_guard<std::mutex> lock(DiskLock);
+	if (DiskFile == NULL || DiskIndex.count(record.Key) != 0)
+		return;
+
+	if (fseek(DiskFile, DiskEnd, SEEK_SET) != 0 || fwrite(&record, sizeof(record), 1, DiskFile) != 1)
+	{
+		fprintf(stderr, "Unable to write metrics cache record\n");
+		return;
+	}
+	DiskIndex[record.Key] = DiskEnd;
+	DiskEnd += (long)sizeof(record);
+}
+
+
+MetricsKey MetricsKeyOf( const Scenario &scn, float fov )
+{
+	float values[METRICS_KEY_FIELDS] = { scn.AngleIntersection, scn.LeadingAngle, scn.TrailingAngle,
+										 scn.CarStart, scn.CarSpeed, scn.BikeStart, scn.BikeSpeed, fov };
+	MetricsKey key;
+	for (int i = 0; i < METRICS_KEY_FIELDS; i++)
+		key.Values[i] = (int)floorf(values[i] / METRICS_CACHE_QUANTUM + 0.5f);
+	return key;
+}
+
+//Open the disk tier, creating it if needed, and index what it already holds
+bool MetricsCacheOpen( const char *path )
+{
+	MetricsCacheClose();
+	std::lock_guard<std::mutex> lock(DiskLock);
+
+	MetricsCacheHeader header;
+	DiskFile = fopen(path, "r+b");
+	if (DiskFile != NULL)
+	{
+		bool valid = fread(&header, sizeof(header), 1, DiskFile) == 1 &&
+					 memcmp(header.Magic, METRICS_CACHE_MAGIC, sizeof(header.Magic)) == 0 &&
+					 header.Version == METRICS_CACHE_VERSION &&
+					 header.RecordSize == sizeof(MetricsCacheRecord);
+		if (!valid)
+		{
+			fprintf(stderr, "Metrics cache '%s' is from a different version, starting it over\n", path);
+			fclose(DiskFile);
+			DiskFile = NULL;
+		}
+	}
+
+	if (DiskFile == NULL)
+	{
+		DiskFile = fopen(path, "w+b");
+		if (DiskFile == NULL)
+		{
+			fprintf(stderr, "Unable to open metrics cache '%s'\n", path);
+			return false;
+		}
+		memcpy(header.Magic, METRICS_CACHE_MAGIC, sizeof(header.Magic));
+		header.Version = METRICS_CACHE_VERSION;
+		header.RecordSize = sizeof(MetricsCacheRecord);
+		fwrite(&header, sizeof(header), 1, DiskFile);
+		DiskEnd = (long)sizeof(header);
+		return true;
+	}
+
+	//Only the keys stay in memory; later records for the same key win
+	MetricsCacheRecord record;
+	long offset = (long)sizeof(header);
+	while (fread(&record, sizeof(record), 1, DiskFile) == 1)
+	{
+		DiskIndex[record.Key] = offset;
+		offset += (long)sizeof(record);
+	}
+	DiskEnd = offset;
+	return true;
+}
+
+void MetricsCacheClose( )
+{
+	std::lock_guard<std::mutex> lock(DiskLock);
+	if (DiskFile == NULL)
+		return;
+
+	fclose(DiskFile);
+	DiskFile = NULL;
+	DiskIndex.clear();
+}
+
+//Look up the metrics of a run, in memory first and then on disk
+bool MetricsCacheFind( const MetricsKey &key, PrecomputedMetrics *metrics )
+{
+	CacheShard &shard = ShardOf(key);
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		CacheIndex::iterator found = shard.Index.find(key);
+		if (found != shard.Index.end())
+		{
+			shard.Entries.splice(shard.Entries.begin(), shard.Entries, found->second);
+			*metrics = found->second->Metrics;
+			Hits.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	MetricsCacheRecord record;
+	if (FindOnDisk(key, &record))
+	{
+		Remember(record);
+		*metrics = record.Metrics;
+		Hits.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Misses.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void MetricsCacheStore( const MetricsKey &key, const PrecomputedMetrics &metrics )
+{
+	MetricsCacheRecord record;
+	record.Key = key;
+	record.Metrics = metrics;
+	Remember(record);
+	StoreOnDisk(record);
+}
+
+void MetricsCacheStats( int *hits, int *misses )
+{
+	*hits = Hits.load(std::memory_order_relaxed);
+	*misses = Misses.load(std::memory_order_relaxed);
+}
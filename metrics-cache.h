@@ -0,0 +1,61 @@
+/*******************************************************
+-------------------- Metrics Cache --------------------
+Remembers the metrics of every run that has been worked out, so
+going back to slider positions that were already tried, or
+evaluating overlapping grids, is a lookup instead of a recompute.
+
+Runs are keyed by their parameters rounded to METRICS_CACHE_QUANTUM.
+The in-memory tier is a sharded hash table with least recently
+used eviction; the optional disk tier is an append-only file that
+keeps results across sessions.
+*******************************************************/
+
+#ifndef METRICS_CACHE_H
+#define METRICS_CACHE_H
+
+#include "metrics-precompute.h"
+
+//File layout: one MetricsCacheHeader followed by MetricsCacheRecords
+const char METRICS_CACHE_MAGIC[8]	= { 'C', 'C', 'V', 'C', 'A', 'C', 'H', '1' };
+const unsigned int METRICS_CACHE_VERSION = 1;
+
+//Key resolution, in degrees, meters and meters per second
+const float METRICS_CACHE_QUANTUM = 0.01f;
+
+//Entries kept in memory, and the number of independently locked parts they are split over
+const int METRICS_CACHE_CAPACITY = 4096;
+const int METRICS_CACHE_SHARDS = 16;
+
+//Scenario fields in order, then the field of view the raster used, in METRICS_CACHE_QUANTUM units
+const int METRICS_KEY_FIELDS = 8;
+
+struct MetricsKey
+{
+	int		Values[METRICS_KEY_FIELDS];
+};
+
+struct MetricsCacheHeader
+{
+	char			Magic[8];
+	unsigned int	Version;
+	unsigned int	RecordSize;
+};
+
+struct MetricsCacheRecord
+{
+	MetricsKey			Key;
+	PrecomputedMetrics	Metrics;
+};
+
+MetricsKey	MetricsKeyOf( const Scenario &, float fov );
+
+//Disk tier; without it the cache only lives as long as the program
+bool		MetricsCacheOpen( const char * );
+void		MetricsCacheClose( );
+
+//Safe to call from any thread
+bool		MetricsCacheFind( const MetricsKey &, PrecomputedMetrics * );
+void		MetricsCacheStore( const MetricsKey &, const PrecomputedMetrics & );
+void		MetricsCacheStats( int *hits, int *misses );
+
+#endif
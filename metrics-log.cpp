@@ -0,0 +1,107 @@
+/*******************************************************
+------------------ Per-frame Metrics Log ------------------
+Rows are written strictly in frame order. A row waiting on the
+GPU blocks the rows behind it, and the oldest waiting row is
+written without its GPU value once the queue is full.
+*******************************************************/
+
+#include <stdio.h>
+
+#include "metrics-log.h"
+
+//Write buffer size for the log file
+const int METRICS_BUFFER_SIZE = 1 << 16;
+
+static FILE *		LogFile = NULL;
+static FrameMetrics	Pending[METRICS_PENDING];
+static int			PendingHead = 0;	//oldest row
+static int			PendingCount = 0;
+
+
+static void WriteRow( const FrameMetrics &m )
+{
+	fprintf(LogFile, "%d,%.4f,%.3f,%.3f,%d,%d,%d,%d\n",
+		m.Frame, m.Time, m.CarDistance, m.BikeDistance, m.BikeHidden, m.RasterVisible, m.RasterTotal, m.GpuSamples);
+}
+
+//Write every row at the front of the queue that is no longer waiting
+static void FlushReady( )
+{
+	while (PendingCount > 0 && !Pending[PendingHead].GpuPending)
+	{
+		WriteRow(Pending[PendingHead]);
+		PendingHead = (PendingHead + 1) % METRICS_PENDING;
+		PendingCount--;
+	}
+}
+
+
+bool MetricsLogOpen( const char *path )
+{
+	MetricsLogClose();
+
+	LogFile = fopen(path, "w");
+	if (LogFile == NULL)
+	{
+		fprintf(stderr, "Unable to open metrics log '%s'\n", path);
+		return false;
+	}
+	setvbuf(LogFile, NULL, _IOFBF, METRICS_BUFFER_SIZE);
+	fprintf(LogFile, "frame,time,car_distance,bike_distance,bike_hidden,raster_visible,raster_total,gpu_samples\n");
+	PendingHead = PendingCount = 0;
+	return true;
+}
+
+bool MetricsLogIsOpen( )
+{
+	return LogFile != NULL;
+}
+
+void MetricsLogFrame( const FrameMetrics &m )
+{
+	if (LogFile == NULL)
+		return;
+
+	//Give up on the oldest GPU result rather than grow the queue
+	if (PendingCount == METRICS_PENDING)
+	{
+		Pending[PendingHead].GpuPending = false;
+		FlushReady();
+	}
+
+	Pending[(PendingHead + PendingCount) % METRICS_PENDING] = m;
+	PendingCount++;
+	FlushReady();
+}
+
+//Fill in the GPU result for a frame that was logged earlier
+void MetricsLogGpuResult( int frame, int samples )
+{
+	if (LogFile == NULL)
+		return;
+
+	for (int i = 0; i < PendingCount; i++)
+	{
+		FrameMetrics &m = Pending[(PendingHead + i) % METRICS_PENDING];
+		if (m.Frame == frame)
+		{
+			m.GpuSamples = samples;
+			m.GpuPending = false;
+			break;
+		}
+	}
+	FlushReady();
+}
+
+void MetricsLogClose( )
+{
+	if (LogFile == NULL)
+		return;
+
+	for (int i = 0; i < PendingCount; i++)
+		Pending[(PendingHead + i) % METRICS_PENDING].GpuPending = false;
+	FlushReady();
+
+	fclose(LogFile);
+	LogFile = NULL;
+}
@@ -0,0 +1,39 @@
+/*******************************************************
+------------------ Per-frame Metrics Log ------------------
+One comma separated row per rendered frame holding the analytic
+blindspot result next to the measured visibility of the bike.
+
+GPU occlusion results arrive a few frames after the frame that
+issued them, so rows wait in a small queue until their result
+is in (or until it is clear the result will never come).
+*******************************************************/
+
+#ifndef METRICS_LOG_H
+#define METRICS_LOG_H
+
+//Value used for a measurement that was not taken
+const int METRICS_NONE = -1;
+
+//Rows that may wait for a late GPU result before being written without it
+const int METRICS_PENDING = 8;
+
+struct FrameMetrics
+{
+	int		Frame;
+	float	Time;
+	float	CarDistance;
+	float	BikeDistance;
+	int		BikeHidden;			//analytic model: bike inside the blindspot wedge
+	int		RasterVisible;		//CPU raster: visible bike pixels
+	int		RasterTotal;		//CPU raster: bike pixels with no car in the way
+	int		GpuSamples;			//GPU occlusion query: bike samples that passed the depth test
+	bool	GpuPending;			//GpuSamples will be filled in by MetricsLogGpuResult( )
+};
+
+bool	MetricsLogOpen( const char * );
+bool	MetricsLogIsOpen( );
+void	MetricsLogFrame( const FrameMetrics & );
+void	MetricsLogGpuResult( int, int );
+void	MetricsLogClose( );
+
+#endif
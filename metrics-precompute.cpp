@@ -0,0 +1,186 @@
+/*******************************************************
+----------------- Metrics Precompute -----------------
+A request is one job that fills in the closed form metrics, then
+spreads the sampled curves over the pool with a parallel-for. Each
+chunk rasterizes into its own target, so chunks share nothing but
+the result they write into.
+
+Requests are numbered; CurrentRequest always holds the newest, and
+anything working on an older number stops at its next check. A job
+that finishes just as a newer request comes in can still get past
+that check, so a result only replaces the one waiting in Finished
+if its number is higher; whichever loses is deleted by the job
+that found it.
+
+Runs that have been worked out before come straight from the
+metrics cache, and every finished run goes into it.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "job-system.h"
+#include "metrics-cache.h"
+#include "metrics-precompute.h"
+#include "visibility-raster.h"
+
+//One request and the result its jobs fill in
+struct Request
+{
+	PrecomputedMetrics	Result;
+	std::atomic<int>	HiddenSamples;		//summed by chunks that finish in any order
+};
+
+static std::atomic<int>			CurrentRequest(0);
+static std::atomic<int>			InFlight(0);		//requests whose job has not finished
+static std::atomic<Request *>	Finished(NULL);		//newest result nobody has picked up
+static int						LastRequest;		//GUI thread only
+static int						LastShown;			//GUI thread only
+
+static bool Cancelled( const Request *req )
+{
+	return CurrentRequest.load(std::memory_order_relaxed) != req->Result.Request;
+}
+
+//Time to collision and raster visibility for samples [ begin, end )
+static void SampleChunk( void *data, int begin, int end )
+{
+	Request *req = (Request *)data;
+	PrecomputedMetrics *res = &req->Result;
+	if (Cancelled(req))
+		return;
+
+	RasterTarget target;
+	if (!RasterTargetInit(&target, RASTER_DEFAULT_RES))
+		return;
+
+	int hidden = 0;
+	for (int i = begin; i < end; i++)
+	{
+		float t = ((float)i + 0.5f) * res->SampleStep;
+		res->TimeToCollision[i] = TimeToCollision(res->Params, t);
+
+		ScenarioState state = StateAtTime(res->Params, t);
+		DriverView view = { res->Fov, res->Params.AngleIntersection, res->Params.LeadingAngle, res->Params.TrailingAngle,
+							state.CarDistance, state.BikeDistance };
+		RasterVisibility vis;
+		RasterizeDriverView(view, &target, &vis);
+		if (vis.BikePixels > 0 && vis.VisiblePixels == 0)
+			hidden++;
+	}
+	RasterTargetFree(&target);
+	req->HiddenSamples.fetch_add(hidden, std::memory_order_relaxed);
+}
+
+//Leave req in Finished unless a newer result is already there; the older of the two is deleted
+static void Publish( Request *req )
+{
+	for (;;)
+	{
+		//Take what is there first, since PrecomputeLatest( ) may delete it as soon as it is looked at
+		Request *old = Finished.exchange(NULL, std::memory_order_acq_rel);
+		if (old != NULL && old->Result.Request > req->Result.Request)
+		{
+			delete req;
+			req = old;
+		}
+		else
+		{
+			delete old;
+		}
+
+		//Another job may have published in the meantime; go round again and compare with that
+		Request *empty = NULL;
+		if (Finished.compare_exchange_strong(empty, req, std::memory_order_acq_rel, std::memory_order_relaxed))
+			return;
+	}
+}
+
+static void RunRequest( void *data, int, int )
+{
+	Request *req = (Request *)data;
+	PrecomputedMetrics *res = &req->Result;
+
+	if (!Cancelled(req))
+	{
+		MetricsKey key = MetricsKeyOf(res->Params, res->Fov);
+		PrecomputedMetrics cached;
+		if (MetricsCacheFind(key, &cached))
+		{
+			res->Metrics = cached.Metrics;
+			res->SampleStep = cached.SampleStep;
+			memcpy(res->TimeToCollision, cached.TimeToCollision, sizeof(res->TimeToCollision));
+			res->RasterHiddenTime = cached.RasterHiddenTime;
+			res->FromCache = true;
+		}
+		else
+		{
+			ComputeTrajectoryMetrics(res->Params, &res->Metrics);
+			res->SampleStep = res->Metrics.Duration / (float)PRECOMPUTE_SAMPLES;
+			ParallelFor(0, PRECOMPUTE_SAMPLES, PRECOMPUTE_GRAIN, SampleChunk, req);
+			res->RasterHiddenTime = (float)req->HiddenSamples.load() * res->SampleStep;
+
+			//Chunks skipped after a cancel leave holes, so only a complete result is kept
+			if (!Cancelled(req))
+				MetricsCacheStore(key, *res);
+		}
+	}
+
+	//A request made while the chunks ran makes this result stale
+	if (Cancelled(req))
+		delete req;
+	else
+		Publish(req);
+	InFlight.fetch_sub(1, std::memory_order_release);
+}
+
+
+//Start computing the metrics of a run, cancelling whatever is still being worked on
+int PrecomputeRequest( const Scenario &scn, float fov )
+{
+	Request *req = new Request;
+	req->Result.Request = ++LastRequest;
+	req->Result.Params = scn;
+	req->Result.Fov = fov;
+	req->Result.FromCache = false;
+	req->HiddenSamples.store(0);
+	CurrentRequest.store(LastRequest, std::memory_order_relaxed);
+
+	InFlight.fetch_add(1, std::memory_order_relaxed);
+	Job *job = JobCreate(RunRequest, req);
+	JobSubmit(job);
+	JobRelease(job);
+	return LastRequest;
+}
+
+//Copy out the newest result if one has finished since the last call
+bool PrecomputeLatest( PrecomputedMetrics *out )
+{
+	Request *req = Finished.exchange(NULL, std::memory_order_acq_rel);
+	if (req == NULL)
+		return false;
+
+	//Finished only ever moves to a newer result, but a stale one can still be
+	//published after a newer one has been taken from it
+	bool newer = req->Result.Request > LastShown;
+	if (newer)
+	{
+		*out = req->Result;
+		LastShown = req->Result.Request;
+	}
+	delete req;
+	return newer;
+}
+
+//Cancel outstanding work and wait for the jobs to wind down
+void PrecomputeStop( )
+{
+	CurrentRequest.store(0, std::memory_order_relaxed);
+	while (InFlight.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+
+	delete Finished.exchange(NULL);
+}
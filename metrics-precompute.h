@@ -0,0 +1,46 @@
+/*******************************************************
+----------------- Metrics Precompute -----------------
+Works out the metrics of the whole run the sliders describe on
+the job system, so the overlay can show how a configuration plays
+out before Play is pressed.
+
+Every request supersedes the ones before it: jobs still working on
+an older request notice and stop early, and their results are
+never shown. Results come back through a single atomic pointer,
+so neither side ever waits on the other.
+*******************************************************/
+
+#ifndef METRICS_PRECOMPUTE_H
+#define METRICS_PRECOMPUTE_H
+
+#include "blindspot-model.h"
+
+//Evenly spaced times over a run at which the curves are sampled
+const int PRECOMPUTE_SAMPLES = 512;
+
+//Samples handled by one job; a superseded request stops at the next chunk
+const int PRECOMPUTE_GRAIN = 32;
+
+struct PrecomputedMetrics
+{
+	int					Request;		//number PrecomputeRequest( ) returned
+	Scenario			Params;
+	float				Fov;
+	TrajectoryMetrics	Metrics;
+	float				SampleStep;		//seconds between samples, the first is at SampleStep / 2
+	float				TimeToCollision[PRECOMPUTE_SAMPLES];	//TTC_NEVER where there is none
+	float				RasterHiddenTime;	//seconds the bike is on screen with no pixel visible
+	bool				FromCache;		//looked up rather than worked out
+};
+
+//Start computing the metrics of a run, cancelling whatever is still being worked on
+//Returns a number that identifies the request
+int		PrecomputeRequest( const Scenario &, float fov );
+
+//Copy out the newest result if one has finished since the last call
+bool	PrecomputeLatest( PrecomputedMetrics * );
+
+//Cancel outstanding work and wait for the jobs to wind down
+void	PrecomputeStop( );
+
+#endif
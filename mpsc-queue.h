@@ -0,0 +1,86 @@
+/*******************************************************
+--------------------- MPSC Queue ---------------------
+Bounded lock-free queue any number of threads push onto and one
+thread pops from. Every cell carries a sequence number saying
+whose turn it is: a producer claims the tail with one compare and
+swap when the cell's sequence equals the position, fills it and
+publishes it by storing position + 1; the consumer takes it when
+it sees position + 1 and hands the cell back to the producers a
+lap later by storing position + size. A full queue shows up as a
+sequence behind the position, and Push( ) returns false there
+instead of waiting.
+*******************************************************/
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+//Size must be a power of two
+template <typename T, int Size>
+struct MpscQueue
+{
+	struct Cell
+	{
+		std::atomic<unsigned int>	Sequence;
+		T							Value;
+	};
+
+	Cell						Cells[Size];
+	std::atomic<unsigned int>	Tail;		//next cell to claim, shared by the producers
+	unsigned int				Head;		//next cell to take, owned by the consumer
+
+	//Empty the queue; nothing may be pushing or popping
+	void Reset( )
+	{
+		for (int i = 0; i < Size; i++)
+			Cells[i].Sequence.store((unsigned int)i, std::memory_order_relaxed);
+		Tail.store(0, std::memory_order_relaxed);
+		Head = 0;
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	//Any thread; false if the queue is full
+	bool Push( const T &value )
+	{
+		unsigned int pos = Tail.load(std::memory_order_relaxed);
+		Cell *cell;
+		for (;;)
+		{
+			cell = &Cells[pos & (Size - 1)];
+			int diff = (int)(cell->Sequence.load(std::memory_order_acquire) - pos);
+			if (diff == 0)
+			{
+				if (Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				//The consumer has not taken this cell's last value yet
+				return false;
+			}
+			else
+			{
+				pos = Tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->Value = value;
+		cell->Sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Consumer thread only; false if the queue is empty
+	bool Pop( T *value )
+	{
+		Cell &cell = Cells[Head & (Size - 1)];
+		if (cell.Sequence.load(std::memory_order_acquire) != Head + 1)
+			return false;
+		*value = cell.Value;
+		cell.Sequence.store(Head + Size, std::memory_order_release);
+		Head++;
+		return true;
+	}
+};
+
+#endif
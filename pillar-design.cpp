@@ -0,0 +1,292 @@
+/*******************************************************
+--------------------- Pillar Design ---------------------
+The search runs on x = ( LeadingAngle, angular width ), where the
+width is TrailingAngle - LeadingAngle. In those terms the
+constraints are a triangle: the leading edge has a lowest angle,
+the width a smallest value and the trailing edge a highest angle.
+Every step is projected back into the triangle.
+
+The samples are drawn once and reused for every evaluation, so
+the objective the line search sees is a fixed function.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "blindspot-model.h"
+#include "dual-number.h"
+#include "job-system.h"
+#include "pillar-design.h"
+#include "qmc.h"
+#include "visibility-raster.h"
+
+//Samples summed by one job
+const int PILLAR_GRAIN = 256;
+
+//Armijo sufficient decrease factor and the most times a step is halved
+const float PILLAR_ARMIJO = 1e-4f;
+const int	PILLAR_MAX_HALVINGS = 30;
+
+//Derivatives with respect to LeadingAngle and the width
+typedef Dual<2>	PillarDual;
+
+//The batch of junctions one design is evaluated over
+struct PillarBatch
+{
+	std::vector<Scenario>	Samples;
+	std::vector<double>		Partial;		//hidden time, d/dLeading, d/dWidth for each chunk
+	float					Leading;
+	float					Width;
+};
+
+
+void DesignDistributionDefault( DesignDistribution *dist )
+{
+	dist->AngleMin = 30.f;
+	dist->AngleMax = 150.f;
+	dist->CarSpeedMin = 8.f;
+	dist->CarSpeedMax = 25.f;
+	dist->BikeSpeedMin = 3.f;
+	dist->BikeSpeedMax = 10.f;
+	dist->ArrivalSpread = 2.f;
+	dist->CarStart = 100.f;
+}
+
+void PillarConstraintsDefault( PillarConstraints *cons )
+{
+	cons->MinWidth = 0.25f;
+	cons->LeadingMin = 10.f;
+	cons->TrailingMax = 45.f;
+}
+
+//Distance across the blinder DrawCar( ) builds between these angles
+float PillarWidth( float leadingAngle, float trailingAngle )
+{
+	return 2.f * CAR_BLINDER_DISTANCE * sinf(0.5f * (trailingAngle - leadingAngle) * MODEL_DEG_TO_RAD);
+}
+
+//Draw the junctions: each bike is timed to reach the intersection near when the car does
+static bool DrawSamples( const DesignDistribution &dist, int sampler, int count, std::vector<Scenario> *samples )
+{
+	QmcSequence seq;
+	if (!QmcInit(&seq, sampler, 4, true, 0))
+		return false;
+	std::vector<float> points(count * 4);
+	QmcGenerate(seq, 0, count, &points[0]);
+
+	samples->resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const float *u = &points[i * 4];
+		Scenario &scn = (*samples)[i];
+		scn.AngleIntersection = dist.AngleMin + u[0] * (dist.AngleMax - dist.AngleMin);
+		scn.CarSpeed = dist.CarSpeedMin + u[1] * (dist.CarSpeedMax - dist.CarSpeedMin);
+		scn.BikeSpeed = dist.BikeSpeedMin + u[2] * (dist.BikeSpeedMax - dist.BikeSpeedMin);
+		scn.CarStart = dist.CarStart;
+
+		float arrival = dist.CarStart / scn.CarSpeed + (2.f * u[3] - 1.f) * dist.ArrivalSpread;
+		scn.BikeStart = arrival > 0.f ? arrival * scn.BikeSpeed : 0.f;
+		scn.LeadingAngle = scn.TrailingAngle = 0.f;
+	}
+	return true;
+}
+
+static void EvaluateChunk( void *data, int begin, int end )
+{
+	PillarBatch *batch = (PillarBatch *)data;
+	PillarDual leading = PillarDual::Variable(batch->Leading, 0);
+	PillarDual trailing = leading + PillarDual::Variable(batch->Width, 1);
+
+	double sum[3] = { 0., 0., 0. };
+	for (int i = begin; i < end; i++)
+	{
+		const Scenario &s = batch->Samples[i];
+		BasicScenario<PillarDual> scn = { s.AngleIntersection, leading, trailing, s.CarStart, s.CarSpeed, s.BikeStart, s.BikeSpeed };
+		BasicTrajectoryMetrics<PillarDual> m;
+		ComputeTrajectoryMetrics(scn, &m);
+		sum[0] += m.HiddenTime.Value;
+		sum[1] += m.HiddenTime.Deriv[0];
+		sum[2] += m.HiddenTime.Deriv[1];
+	}
+
+	double *partial = &batch->Partial[(begin / PILLAR_GRAIN) * 3];
+	for (int k = 0; k < 3; k++)
+		partial[k] = sum[k];
+}
+
+//Mean hidden time over the batch at x, and its gradient
+static float Evaluate( PillarBatch *batch, const float *x, float *grad )
+{
+	int count = (int)batch->Samples.size();
+	batch->Leading = x[0];
+	batch->Width = x[1];
+	batch->Partial.assign(((count + PILLAR_GRAIN - 1) / PILLAR_GRAIN) * 3, 0.);
+	ParallelFor(0, count, PILLAR_GRAIN, EvaluateChunk, batch);
+
+	double sum[3] = { 0., 0., 0. };
+	for (size_t i = 0; i < batch->Partial.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+			sum[k] += batch->Partial[i + k];
+	}
+	grad[0] = (float)(sum[1] / count);
+	grad[1] = (float)(sum[2] / count);
+	return (float)(sum[0] / count);
+}
+
+//Nearest point of segment a-b to p
+static void ClosestOnSegment( const float *a, const float *b, const float *p, float *out )
+{
+	float dx = b[0] - a[0], dy = b[1] - a[1];
+	float len2 = dx * dx + dy * dy;
+	float t = len2 > 0.f ? ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / len2 : 0.f;
+	if (t < 0.f)
+		t = 0.f;
+	if (t > 1.f)
+		t = 1.f;
+	out[0] = a[0] + t * dx;
+	out[1] = a[1] + t * dy;
+}
+
+//Nearest point of the feasible triangle to x, in place
+static void Project( const float corners[3][2], float *x )
+{
+	float leadMin = corners[0][0], widthMin = corners[0][1], trailMax = corners[1][0] + corners[1][1];
+	if (x[0] >= leadMin && x[1] >= widthMin && x[0] + x[1] <= trailMax)
+		return;
+
+	float best[2] = { x[0], x[1] }, bestDist = -1.f;
+	for (int e = 0; e < 3; e++)
+	{
+		float q[2];
+		ClosestOnSegment(corners[e], corners[(e + 1) % 3], x, q);
+		float d = (q[0] - x[0]) * (q[0] - x[0]) + (q[1] - x[1]) * (q[1] - x[1]);
+		if (bestDist < 0.f || d < bestDist)
+		{
+			bestDist = d;
+			best[0] = q[0];
+			best[1] = q[1];
+		}
+	}
+	x[0] = best[0];
+	x[1] = best[1];
+}
+
+
+//Best pillar angles for the distribution, starting from leadingAngle / trailingAngle
+bool OptimizePillars( const DesignDistribution &dist, const PillarConstraints &cons, int sampler, int samples,
+					  float leadingAngle, float trailingAngle, PillarDesign *design )
+{
+	float ratio = cons.MinWidth / (2.f * CAR_BLINDER_DISTANCE);
+	if (samples < 1 || ratio > 1.f)
+	{
+		fprintf(stderr, "No pillar can be %.3f m wide\n", cons.MinWidth);
+		return false;
+	}
+	float widthMin = 2.f * asinf(ratio > 0.f ? ratio : 0.f) / MODEL_DEG_TO_RAD;
+	if (cons.LeadingMin + widthMin > cons.TrailingMax)
+	{
+		fprintf(stderr, "A %.3f m pillar does not fit between %.1f and %.1f degrees\n", cons.MinWidth, cons.LeadingMin, cons.TrailingMax);
+		return false;
+	}
+
+	//Corners of the feasible triangle in ( leading, width )
+	const float corners[3][2] =
+	{
+		{ cons.LeadingMin, widthMin },
+		{ cons.TrailingMax - widthMin, widthMin },
+		{ cons.LeadingMin, cons.TrailingMax - cons.LeadingMin }
+	};
+
+	PillarBatch batch;
+	if (!DrawSamples(dist, sampler, samples, &batch.Samples))
+		return false;
+
+	float x[2] = { leadingAngle, trailingAngle - leadingAngle };
+	float g[2];
+	design->StartHidden = Evaluate(&batch, x, g);
+	Project(corners, x);
+	float f = Evaluate(&batch, x, g);
+	design->Evaluations = 2;
+	design->Converged = false;
+	design->Stalled = false;
+
+	//Inverse Hessian estimate, starting from the identity
+	float H[2][2] = { { 1.f, 0.f }, { 0.f, 1.f } };
+
+	int iter;
+	for (iter = 0; iter < PILLAR_MAX_ITERATIONS; iter++)
+	{
+		//Quasi-Newton direction, or steepest descent if that does not go downhill
+		float d[2] = { -(H[0][0] * g[0] + H[0][1] * g[1]), -(H[1][0] * g[0] + H[1][1] * g[1]) };
+		if (d[0] * g[0] + d[1] * g[1] >= 0.f)
+		{
+			d[0] = -g[0];
+			d[1] = -g[1];
+			H[0][0] = H[1][1] = 1.f;
+			H[0][1] = H[1][0] = 0.f;
+		}
+
+		//Backtrack along the projected path until the decrease is enough
+		float step = 1.f, xn[2], gn[2], fn = f;
+		bool accepted = false;
+		for (int h = 0; h < PILLAR_MAX_HALVINGS && !accepted; h++, step *= 0.5f)
+		{
+			xn[0] = x[0] + step * d[0];
+			xn[1] = x[1] + step * d[1];
+			Project(corners, xn);
+			float decrease = g[0] * (xn[0] - x[0]) + g[1] * (xn[1] - x[1]);
+			fn = Evaluate(&batch, xn, gn);
+			design->Evaluations++;
+			accepted = fn <= f + PILLAR_ARMIJO * decrease;
+		}
+
+		//Every halving failed: the search has stalled, not converged, and stays where it was
+		if (!accepted)
+		{
+			design->Stalled = true;
+			break;
+		}
+
+		float s[2] = { xn[0] - x[0], xn[1] - x[1] };
+		if (sqrtf(s[0] * s[0] + s[1] * s[1]) < PILLAR_TOLERANCE)
+		{
+			design->Converged = true;
+			if (fn < f)
+			{
+				x[0] = xn[0];
+				x[1] = xn[1];
+				f = fn;
+			}
+			break;
+		}
+
+		//BFGS update of the inverse Hessian, skipped when the curvature is not positive
+		float y[2] = { gn[0] - g[0], gn[1] - g[1] };
+		float sy = s[0] * y[0] + s[1] * y[1];
+		if (sy > 1e-10f)
+		{
+			float Hy[2] = { H[0][0] * y[0] + H[0][1] * y[1], H[1][0] * y[0] + H[1][1] * y[1] };
+			float yHy = y[0] * Hy[0] + y[1] * Hy[1];
+			for (int i = 0; i < 2; i++)
+			{
+				for (int j = 0; j < 2; j++)
+					H[i][j] += ((sy + yHy) * s[i] * s[j]) / (sy * sy) - (Hy[i] * s[j] + s[i] * Hy[j]) / sy;
+			}
+		}
+
+		x[0] = xn[0];
+		x[1] = xn[1];
+		f = fn;
+		g[0] = gn[0];
+		g[1] = gn[1];
+	}
+
+	design->LeadingAngle = x[0];
+	design->TrailingAngle = x[0] + x[1];
+	design->ExpectedHidden = f;
+	design->Iterations = iter;
+	return true;
+}
@@ -0,0 +1,65 @@
+/*******************************************************
+--------------------- Pillar Design ---------------------
+Searches for the blinder (A-pillar) angles built by DrawCar( )
+that hide cyclists for the least time on average, over a spread
+of junction angles and speeds rather than a single scenario.
+
+The expected hidden time and its gradient come from running the
+dual number model over a fixed batch of sampled junctions on the
+job system. A projected quasi-Newton (BFGS) search then moves the
+pillar while keeping it wide enough to be built.
+*******************************************************/
+
+#ifndef PILLAR_DESIGN_H
+#define PILLAR_DESIGN_H
+
+//Samples of the junction distribution used for one design
+const int PILLAR_DEFAULT_SAMPLES = 4096;
+
+//Search limits
+const int	PILLAR_MAX_ITERATIONS = 100;
+const float	PILLAR_TOLERANCE = 1e-3f;		//degrees; a step shorter than this ends the search
+
+//Junctions and speeds to design for, each spread evenly over its range
+struct DesignDistribution
+{
+	float	AngleMin, AngleMax;				//AngleIntersection, degrees
+	float	CarSpeedMin, CarSpeedMax;		//meters per second
+	float	BikeSpeedMin, BikeSpeedMax;
+	float	ArrivalSpread;					//seconds the bike reaches the intersection before or after the car
+	float	CarStart;						//meters
+};
+
+//What makes a pillar buildable
+struct PillarConstraints
+{
+	float	MinWidth;			//meters across the blinder, between its two edges
+	float	LeadingMin;			//degrees; the windscreen keeps the pillar at least this far from straight ahead
+	float	TrailingMax;		//degrees; and no further round than this
+};
+
+struct PillarDesign
+{
+	float	LeadingAngle;
+	float	TrailingAngle;
+	float	ExpectedHidden;		//mean hidden time over the samples, seconds
+	float	StartHidden;		//the same for the starting angles
+	int		Iterations;
+	int		Evaluations;
+	bool	Converged;		//a step shorter than PILLAR_TOLERANCE was taken
+	bool	Stalled;		//the line search found no step that went far enough downhill
+};
+
+void	DesignDistributionDefault( DesignDistribution * );
+void	PillarConstraintsDefault( PillarConstraints * );
+
+//Distance across the blinder DrawCar( ) builds between these angles
+float	PillarWidth( float leadingAngle, float trailingAngle );
+
+//Best pillar angles for the distribution, starting from leadingAngle / trailingAngle
+//The junctions are the first samples points of a scrambled sequence of QmcKind sampler
+//Returns false if the constraints leave no room for a pillar
+bool	OptimizePillars( const DesignDistribution &, const PillarConstraints &, int sampler, int samples,
+						 float leadingAngle, float trailingAngle, PillarDesign * );
+
+#endif
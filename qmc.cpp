@@ -0,0 +1,258 @@
+/*******************************************************
+----------------- Quasi-Monte Carlo Sampling -----------------
+Sobol points use the Joe and Kuo direction numbers and are taken
+in Gray code order, so each point is the previous one with a
+single direction number XORed in. Any 2^m aligned points are
+the same set as in natural order.
+
+The scramble is Burley's hash based version of Owen's nested
+uniform scramble ("Practical Hash-based Owen Scrambling", 2020):
+reverse the bits, apply a Laine-Karras permutation, reverse back.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "qmc.h"
+
+const char *QMC_NAMES[QMC_KINDS] = { "random", "halton", "sobol" };
+
+//Bits in a Sobol coordinate
+const int SOBOL_BITS = 32;
+
+//Primitive polynomial degree s, its coefficients a and the initial
+//direction numbers m for Sobol dimensions 2 onwards (Joe and Kuo)
+struct SobolPolynomial
+{
+	int				Degree;
+	unsigned int	Coefficients;
+	unsigned int	Initial[8];
+};
+
+const SobolPolynomial SOBOL_POLYNOMIALS[QMC_MAX_DIMENSIONS - 1] =
+{
+	{ 1, 0,		{ 1 } },
+	{ 2, 1,		{ 1, 3 } },
+	{ 3, 1,		{ 1, 3, 1 } },
+	{ 3, 2,		{ 1, 1, 1 } },
+	{ 4, 1,		{ 1, 1, 3, 3 } },
+	{ 4, 4,		{ 1, 3, 5, 13 } },
+	{ 5, 2,		{ 1, 1, 5, 5, 17 } },
+	{ 5, 4,		{ 1, 1, 5, 5, 5 } },
+	{ 5, 7,		{ 1, 1, 7, 11, 19 } },
+	{ 5, 11,	{ 1, 1, 5, 1, 1 } },
+	{ 5, 13,	{ 1, 1, 1, 3, 11 } },
+	{ 5, 14,	{ 1, 3, 5, 5, 31 } },
+	{ 6, 1,		{ 1, 3, 3, 9, 7, 49 } },
+	{ 6, 13,	{ 1, 1, 1, 15, 21, 21 } },
+	{ 6, 16,	{ 1, 3, 1, 13, 27, 49 } }
+};
+
+const int HALTON_BASES[QMC_MAX_DIMENSIONS] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+
+//Largest float below 1, for values that round up to it
+const float QMC_BELOW_ONE = 1.f - 1.f / (float)(1 << 24);
+
+//Direction numbers for every dimension, built on first use
+static unsigned int	SobolDirections[QMC_MAX_DIMENSIONS][SOBOL_BITS];
+
+
+static bool SobolInit( )
+{
+	for (int k = 0; k < SOBOL_BITS; k++)
+		SobolDirections[0][k] = 1u << (SOBOL_BITS - 1 - k);
+
+	for (int d = 1; d < QMC_MAX_DIMENSIONS; d++)
+	{
+		const SobolPolynomial &p = SOBOL_POLYNOMIALS[d - 1];
+		unsigned int *v = SobolDirections[d];
+		int s = p.Degree;
+		for (int k = 0; k < s; k++)
+			v[k] = p.Initial[k] << (SOBOL_BITS - 1 - k);
+		for (int k = s; k < SOBOL_BITS; k++)
+		{
+			v[k] = v[k - s] ^ (v[k - s] >> s);
+			for (int j = 1; j < s; j++)
+			{
+				if ((p.Coefficients >> (s - 1 - j)) & 1)
+					v[k] ^= v[k - j];
+			}
+		}
+	}
+	return true;
+}
+
+//Hash for seeds and for QMC_RANDOM points
+static unsigned int Hash( unsigned int x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static unsigned int ReverseBits( unsigned int x )
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+static unsigned int OwenScramble( unsigned int x, unsigned int seed )
+{
+	x = ReverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return ReverseBits(x);
+}
+
+//Top 24 bits as a float in [0, 1)
+static float ToUnit( unsigned int x )
+{
+	return (float)(x >> 8) * (1.f / (float)(1 << 24));
+}
+
+static int TrailingZeros( unsigned int x )
+{
+	int n = 0;
+	while ((x & 1) == 0)
+	{
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+static void SobolGenerate( const QmcSequence &seq, int first, int count, float *out )
+{
+	int dims = seq.Dimensions;
+	unsigned int x[QMC_MAX_DIMENSIONS];
+
+	//Jump straight to the first point, then walk the Gray code
+	unsigned int gray = (unsigned int)first ^ ((unsigned int)first >> 1);
+	for (int d = 0; d < dims; d++)
+	{
+		x[d] = 0;
+		for (int k = 0; gray >> k; k++)
+		{
+			if ((gray >> k) & 1)
+				x[d] ^= SobolDirections[d][k];
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		float *p = out + i * dims;
+		for (int d = 0; d < dims; d++)
+			p[d] = ToUnit(seq.Scrambled ? OwenScramble(x[d], seq.Seeds[d]) : x[d]);
+
+		int c = TrailingZeros((unsigned int)(first + i + 1));
+		for (int d = 0; d < dims; d++)
+			x[d] ^= SobolDirections[d][c];
+	}
+}
+
+static void HaltonGenerate( const QmcSequence &seq, int first, int count, float *out )
+{
+	int dims = seq.Dimensions;
+	for (int i = 0; i < count; i++)
+	{
+		float *p = out + i * dims;
+		for (int d = 0; d < dims; d++)
+		{
+			int base = HALTON_BASES[d];
+			const unsigned char *perm = seq.Permutations[d];
+			double inv = 1. / base, scale = inv, value = 0.;
+			for (unsigned int n = (unsigned int)(first + i); n > 0; n /= base)
+			{
+				value += perm[n % base] * scale;
+				scale *= inv;
+			}
+
+			//The endless zero digits after the last one scramble to perm[ 0 ] each
+			value += perm[0] * scale * base / (base - 1);
+			float v = (float)value;
+			p[d] = v < 1.f ? v : QMC_BELOW_ONE;
+		}
+	}
+}
+
+static void RandomGenerate( const QmcSequence &seq, int first, int count, float *out )
+{
+	int dims = seq.Dimensions;
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int n = Hash((unsigned int)(first + i));
+		for (int d = 0; d < dims; d++)
+			out[i * dims + d] = ToUnit(Hash(n ^ seq.Seeds[d]));
+	}
+}
+
+
+int QmcFindKind( const char *name )
+{
+	for (int k = 0; k < QMC_KINDS; k++)
+	{
+		if (strcmp(name, QMC_NAMES[k]) == 0)
+			return k;
+	}
+	return -1;
+}
+
+bool QmcInit( QmcSequence *seq, int kind, int dimensions, bool scrambled, unsigned int seed )
+{
+	if (kind < 0 || kind >= QMC_KINDS || dimensions < 1 || dimensions > QMC_MAX_DIMENSIONS)
+	{
+		fprintf(stderr, "No quasi-random sequence of kind %d with %d dimensions\n", kind, dimensions);
+		return false;
+	}
+	static bool sobolReady = SobolInit();
+	(void)sobolReady;
+
+	seq->Kind = kind;
+	seq->Dimensions = dimensions;
+	seq->Scrambled = scrambled || kind == QMC_RANDOM;
+	for (int d = 0; d < dimensions; d++)
+	{
+		seq->Seeds[d] = Hash(seed * (unsigned int)QMC_MAX_DIMENSIONS + (unsigned int)d + 1u);
+
+		//Fisher-Yates shuffle of the digits, or the identity when not scrambled
+		int base = HALTON_BASES[d];
+		unsigned char *perm = seq->Permutations[d];
+		for (int j = 0; j < base; j++)
+			perm[j] = (unsigned char)j;
+		unsigned int state = seq->Seeds[d];
+		for (int j = base - 1; seq->Scrambled && j > 0; j--)
+		{
+			state = Hash(state + 1u);
+			int k = (int)(state % (unsigned int)(j + 1));
+			unsigned char t = perm[j];
+			perm[j] = perm[k];
+			perm[k] = t;
+		}
+	}
+	return true;
+}
+
+void QmcGenerate( const QmcSequence &seq, int first, int count, float *out )
+{
+	switch (seq.Kind)
+	{
+		case QMC_SOBOL:
+			SobolGenerate(seq, first, count, out);
+			break;
+		case QMC_HALTON:
+			HaltonGenerate(seq, first, count, out);
+			break;
+		default:
+			RandomGenerate(seq, first, count, out);
+			break;
+	}
+}
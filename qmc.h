@@ -0,0 +1,54 @@
+/*******************************************************
+----------------- Quasi-Monte Carlo Sampling -----------------
+Points in the unit cube for every mode that draws scenarios at
+random. Low discrepancy sequences (Sobol and Halton) fill the cube
+far more evenly than independent random points, so an average
+over them settles with many fewer evaluations.
+
+Point n of a sequence depends only on n and the seed, so threads
+split a run by taking disjoint ranges of n: the union is the same
+sequence one thread would have made, with no correlation between
+the pieces. Different seeds give independent scrambles of the
+same sequence, which is how the error of an estimate is measured.
+*******************************************************/
+
+#ifndef QMC_H
+#define QMC_H
+
+enum QmcKind
+{
+	QMC_RANDOM,			//independent uniform points, from a counter based hash
+	QMC_HALTON,
+	QMC_SOBOL,
+	QMC_KINDS
+};
+
+//Names for the command line, in QmcKind order
+extern const char *QMC_NAMES[QMC_KINDS];
+
+//Most dimensions a sequence can have
+const int QMC_MAX_DIMENSIONS = 16;
+
+//Largest Halton base, the QMC_MAX_DIMENSIONS-th prime
+const int QMC_MAX_BASE = 53;
+
+struct QmcSequence
+{
+	int				Kind;
+	int				Dimensions;
+	bool			Scrambled;
+	unsigned int	Seeds[QMC_MAX_DIMENSIONS];						//per dimension scramble seeds
+	unsigned char	Permutations[QMC_MAX_DIMENSIONS][QMC_MAX_BASE];	//Halton digit scrambles
+};
+
+//QmcKind from a name in QMC_NAMES, or -1
+int		QmcFindKind( const char * );
+
+//Scrambling is Owen's nested uniform scramble for Sobol and random digit
+//permutations for Halton; QMC_RANDOM is always random
+bool	QmcInit( QmcSequence *, int kind, int dimensions, bool scrambled, unsigned int seed );
+
+//Points first to first + count - 1 into out, Dimensions floats in [0, 1) per point
+void	QmcGenerate( const QmcSequence &, int first, int count, float *out );
+
+#endif
@@ -0,0 +1,340 @@
+/*******************************************************
+--------------------- Result Query ---------------------
+A query runs in up to three passes over the chunks that survive
+the zone maps: exact-value grouping first finds the distinct
+values of the group column among the rows that pass, then every
+slice of chunks accumulates counts, sums, mins and maxes for each
+of its groups, and the slices are added up.
+
+Groups are dense indices, either buckets counted up from the lowest
+bucket the zone maps allow or positions in the sorted distinct
+values, so accumulating a row is an array index, not a lookup.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "job-system.h"
+#include "result-query.h"
+
+const char *QUERY_FUNC_NAMES[QF_FUNCS] = { "count", "min", "max", "sum", "mean" };
+
+//Running totals of one aggregate column within one group
+struct QueryAccum
+{
+	double	Sum;
+	float	Min, Max;
+};
+
+//Everything the scan jobs share
+struct QueryScan
+{
+	const ResultFile *				File;
+	const Query *					Q;
+	std::vector<int>				Chunks;			//those the zone maps did not rule out
+	int								Grain;			//chunks per slice
+	int								Groups;
+	float							Base;			//bucket number of group 0
+	std::vector<int>				Source;			//aggregate whose totals each aggregate uses
+	std::vector<float>				Distinct;		//group values when grouping by exact value
+	std::vector<std::vector<float> >	SliceDistinct;
+	std::vector<unsigned long long>	Counts;			//slice, group
+	std::vector<QueryAccum>			Accums;			//slice, group, aggregate
+};
+
+//Decode buffers of one job
+struct QueryScratch
+{
+	std::vector<float>			Values;
+	std::vector<unsigned char>	Mask;
+	std::vector<int>			Group;
+
+	QueryScratch( ) : Values(RESULT_CHUNK_ROWS), Mask(RESULT_CHUNK_ROWS), Group(RESULT_CHUNK_ROWS)
+	{
+	}
+};
+
+
+void QueryInit( Query *q )
+{
+	q->Filters.clear();
+	q->GroupColumn = -1;
+	q->GroupWidth = 0.f;
+	q->Aggregates.clear();
+}
+
+//Mask of the rows of a chunk that pass every filter; returns the rows of the chunk
+static int SelectRows( const QueryScan &scan, int chunk, QueryScratch *s )
+{
+	const ResultChunk *c = scan.File->Chunks[chunk];
+	int rows = (int)c->Rows;
+	unsigned char *mask = &s->Mask[0];
+	for (int i = 0; i < rows; i++)
+		mask[i] = 1;
+
+	const std::vector<QueryFilter> &filters = scan.Q->Filters;
+	for (size_t f = 0; f < filters.size(); f++)
+	{
+		const QueryFilter &filter = filters[f];
+		const ResultColumnInfo &info = c->Column[filter.Column];
+		if (info.Min >= filter.Lo && info.Max <= filter.Hi)
+			continue;
+
+		float *v = &s->Values[0];
+		float lo = filter.Lo, hi = filter.Hi;
+		ResultDecodeColumn(*scan.File, chunk, filter.Column, v);
+		for (int i = 0; i < rows; i++)
+			mask[i] &= (unsigned char)((v[i] >= lo) & (v[i] <= hi));
+	}
+	return rows;
+}
+
+//Group of every row of a chunk into s->Group
+static void GroupRows( const QueryScan &scan, int chunk, int rows, QueryScratch *s )
+{
+	int *group = &s->Group[0];
+	if (scan.Q->GroupColumn < 0)
+	{
+		for (int i = 0; i < rows; i++)
+			group[i] = 0;
+		return;
+	}
+
+	float *v = &s->Values[0];
+	ResultDecodeColumn(*scan.File, chunk, scan.Q->GroupColumn, v);
+	if (scan.Q->GroupWidth > 0.f)
+	{
+		float inv = 1.f / scan.Q->GroupWidth, base = scan.Base;
+		int last = scan.Groups - 1;
+		for (int i = 0; i < rows; i++)
+		{
+			int g = (int)(floorf(v[i] * inv) - base);
+			group[i] = g < 0 ? 0 : (g > last ? last : g);
+		}
+	}
+	else
+	{
+		//Only passing rows are among the distinct values; the rest go in group 0 with a zero mask
+		const std::vector<float> &distinct = scan.Distinct;
+		const unsigned char *mask = &s->Mask[0];
+		int last = scan.Groups - 1;
+		for (int i = 0; i < rows; i++)
+		{
+			int g = mask[i] ? (int)(std::lower_bound(distinct.begin(), distinct.end(), v[i]) - distinct.begin()) : 0;
+			group[i] = g > last ? last : g;
+		}
+	}
+}
+
+//Distinct values of the group column among the passing rows of a slice
+static void DistinctSlice( void *data, int begin, int end )
+{
+	QueryScan *scan = (QueryScan *)data;
+	std::vector<float> &out = scan->SliceDistinct[begin / scan->Grain];
+	QueryScratch s;
+	std::vector<float> groupValues(RESULT_CHUNK_ROWS);
+	for (int k = begin; k < end; k++)
+	{
+		int chunk = scan->Chunks[k];
+		int rows = SelectRows(*scan, chunk, &s);
+		ResultDecodeColumn(*scan->File, chunk, scan->Q->GroupColumn, &groupValues[0]);
+		for (int i = 0; i < rows; i++)
+		{
+			if (s.Mask[i])
+				out.push_back(groupValues[i]);
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+		if ((int)out.size() > QUERY_MAX_GROUPS)
+			return;
+	}
+}
+
+static void ScanSlice( void *data, int begin, int end )
+{
+	QueryScan *scan = (QueryScan *)data;
+	const std::vector<QueryAggregate> &aggs = scan->Q->Aggregates;
+	int numAggs = (int)aggs.size();
+	int slice = begin / scan->Grain;
+	unsigned long long *counts = &scan->Counts[(size_t)slice * scan->Groups];
+	QueryAccum *accums = numAggs > 0 ? &scan->Accums[(size_t)slice * scan->Groups * numAggs] : NULL;
+
+	QueryScratch s;
+	for (int k = begin; k < end; k++)
+	{
+		int chunk = scan->Chunks[k];
+		int rows = SelectRows(*scan, chunk, &s);
+		GroupRows(*scan, chunk, rows, &s);
+		const unsigned char *mask = &s.Mask[0];
+		const int *group = &s.Group[0];
+
+		for (int i = 0; i < rows; i++)
+			counts[group[i]] += mask[i];
+
+		//Aggregates of a column share the totals of the first one of it
+		for (int a = 0; a < numAggs; a++)
+		{
+			if (aggs[a].Func == QF_COUNT || scan->Source[a] != a)
+				continue;
+
+			const float *v = &s.Values[0];
+			ResultDecodeColumn(*scan->File, chunk, aggs[a].Column, &s.Values[0]);
+			if (scan->Groups == 1)
+			{
+				//One group: branch free loops the compiler can vectorize
+				double sum = 0.;
+				float lo = INFINITY, hi = -INFINITY;
+				for (int i = 0; i < rows; i++)
+				{
+					sum += mask[i] ? v[i] : 0.f;
+					lo = mask[i] && v[i] < lo ? v[i] : lo;
+					hi = mask[i] && v[i] > hi ? v[i] : hi;
+				}
+				QueryAccum &acc = accums[a];
+				acc.Sum += sum;
+				acc.Min = lo < acc.Min ? lo : acc.Min;
+				acc.Max = hi > acc.Max ? hi : acc.Max;
+				continue;
+			}
+
+			for (int i = 0; i < rows; i++)
+			{
+				if (!mask[i])
+					continue;
+				QueryAccum &acc = accums[group[i] * numAggs + a];
+				acc.Sum += v[i];
+				acc.Min = v[i] < acc.Min ? v[i] : acc.Min;
+				acc.Max = v[i] > acc.Max ? v[i] : acc.Max;
+			}
+		}
+	}
+}
+
+bool RunQuery( const ResultFile &rf, const Query &q, QueryResult *result )
+{
+	QueryScan scan;
+	scan.File = &rf;
+	scan.Q = &q;
+	result->Keys.clear();
+	result->Counts.clear();
+	result->Values.clear();
+	result->Rows = rf.Rows;
+	result->Matched = 0;
+
+	//Zone maps: drop every chunk some filter cannot match
+	int numChunks = (int)rf.Chunks.size();
+	for (int c = 0; c < numChunks; c++)
+	{
+		bool keep = true;
+		for (size_t f = 0; f < q.Filters.size() && keep; f++)
+			keep = ResultChunkMayMatch(rf, c, q.Filters[f].Column, q.Filters[f].Lo, q.Filters[f].Hi);
+		if (keep)
+			scan.Chunks.push_back(c);
+	}
+	result->ChunksScanned = (int)scan.Chunks.size();
+	result->ChunksSkipped = numChunks - result->ChunksScanned;
+	if (scan.Chunks.empty())
+		return true;
+
+	int slices = JobWorkerCount() + 1;
+	scan.Grain = ((int)scan.Chunks.size() + slices - 1) / slices;
+	slices = ((int)scan.Chunks.size() + scan.Grain - 1) / scan.Grain;
+
+	scan.Groups = 1;
+	scan.Base = 0.f;
+	if (q.GroupColumn >= 0 && q.GroupWidth > 0.f)
+	{
+		//Buckets between the lowest and highest values the kept chunks and filters allow
+		float lo = INFINITY, hi = -INFINITY;
+		for (size_t k = 0; k < scan.Chunks.size(); k++)
+		{
+			const ResultColumnInfo &info = rf.Chunks[scan.Chunks[k]]->Column[q.GroupColumn];
+			lo = info.Min < lo ? info.Min : lo;
+			hi = info.Max > hi ? info.Max : hi;
+		}
+		for (size_t f = 0; f < q.Filters.size(); f++)
+		{
+			if (q.Filters[f].Column != q.GroupColumn)
+				continue;
+			lo = q.Filters[f].Lo > lo ? q.Filters[f].Lo : lo;
+			hi = q.Filters[f].Hi < hi ? q.Filters[f].Hi : hi;
+		}
+		scan.Base = floorf(lo / q.GroupWidth);
+		double groups = (double)floorf(hi / q.GroupWidth) - scan.Base + 1.;
+		if (!(groups <= QUERY_MAX_GROUPS))
+		{
+			fprintf(stderr, "Buckets of %g make more than %d groups of %s\n", q.GroupWidth, QUERY_MAX_GROUPS, RESULT_COLUMN_NAMES[q.GroupColumn]);
+			return false;
+		}
+		scan.Groups = groups > 1. ? (int)groups : 1;
+	}
+	else if (q.GroupColumn >= 0)
+	{
+		scan.SliceDistinct.resize(slices);
+		ParallelFor(0, (int)scan.Chunks.size(), scan.Grain, DistinctSlice, &scan);
+		for (int s = 0; s < slices; s++)
+			scan.Distinct.insert(scan.Distinct.end(), scan.SliceDistinct[s].begin(), scan.SliceDistinct[s].end());
+		std::sort(scan.Distinct.begin(), scan.Distinct.end());
+		scan.Distinct.erase(std::unique(scan.Distinct.begin(), scan.Distinct.end()), scan.Distinct.end());
+		if ((int)scan.Distinct.size() > QUERY_MAX_GROUPS)
+		{
+			fprintf(stderr, "%s has more than %d distinct values; group it in buckets\n", RESULT_COLUMN_NAMES[q.GroupColumn], QUERY_MAX_GROUPS);
+			return false;
+		}
+		if (scan.Distinct.empty())
+			return true;
+		scan.Groups = (int)scan.Distinct.size();
+	}
+
+	int numAggs = (int)q.Aggregates.size();
+	for (int a = 0; a < numAggs; a++)
+	{
+		int b = 0;
+		while (b < a && !(q.Aggregates[b].Func != QF_COUNT && q.Aggregates[b].Column == q.Aggregates[a].Column))
+			b++;
+		scan.Source.push_back(b);
+	}
+	QueryAccum empty = { 0., INFINITY, -INFINITY };
+	scan.Counts.assign((size_t)slices * scan.Groups, 0);
+	scan.Accums.assign((size_t)slices * scan.Groups * numAggs, empty);
+	ParallelFor(0, (int)scan.Chunks.size(), scan.Grain, ScanSlice, &scan);
+
+	for (int g = 0; g < scan.Groups; g++)
+	{
+		unsigned long long count = 0;
+		for (int s = 0; s < slices; s++)
+			count += scan.Counts[(size_t)s * scan.Groups + g];
+		if (count == 0)
+			continue;
+
+		result->Matched += count;
+		result->Keys.push_back(q.GroupColumn < 0 ? 0.f :
+							   q.GroupWidth > 0.f ? (scan.Base + g) * q.GroupWidth : scan.Distinct[g]);
+		result->Counts.push_back(count);
+		for (int a = 0; a < numAggs; a++)
+		{
+			QueryAccum total = empty;
+			for (int s = 0; s < slices; s++)
+			{
+				const QueryAccum &acc = scan.Accums[((size_t)s * scan.Groups + g) * numAggs + scan.Source[a]];
+				total.Sum += acc.Sum;
+				total.Min = acc.Min < total.Min ? acc.Min : total.Min;
+				total.Max = acc.Max > total.Max ? acc.Max : total.Max;
+			}
+
+			double value;
+			switch (q.Aggregates[a].Func)
+			{
+				case QF_COUNT:	value = (double)count;			break;
+				case QF_MIN:	value = total.Min;				break;
+				case QF_MAX:	value = total.Max;				break;
+				case QF_SUM:	value = total.Sum;				break;
+				default:		value = total.Sum / count;		break;
+			}
+			result->Values.push_back(value);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+/*******************************************************
+--------------------- Result Query ---------------------
+Filter, group and aggregate the rows of a result file without
+loading it: for example the largest HiddenTime in each 10 degree
+band of AngleIntersection where CarSpeed > 15.
+
+Filters are ranges on columns, all of which a row must pass. A
+chunk whose min / max for some filtered column misses the range is
+skipped without decoding, and a filter a chunk's range lies wholly
+inside is not checked row by row. The chunks left are decoded a
+column at a time and scanned in plain loops over float arrays,
+spread over the job system with partial results per slice of
+chunks, merged at the end.
+*******************************************************/
+
+#ifndef RESULT_QUERY_H
+#define RESULT_QUERY_H
+
+#include <vector>
+
+#include "result-store.h"
+
+//Most groups a query can produce
+const int QUERY_MAX_GROUPS = 1 << 14;
+
+enum QueryFunc
+{
+	QF_COUNT,
+	QF_MIN,
+	QF_MAX,
+	QF_SUM,
+	QF_MEAN,
+	QF_FUNCS
+};
+
+extern const char *QUERY_FUNC_NAMES[QF_FUNCS];
+
+//Rows pass when Lo <= column <= Hi
+struct QueryFilter
+{
+	int		Column;
+	float	Lo, Hi;
+};
+
+struct QueryAggregate
+{
+	int		Func;			//QueryFunc
+	int		Column;			//ignored by QF_COUNT
+};
+
+struct Query
+{
+	std::vector<QueryFilter>	Filters;
+	int							GroupColumn;	//-1 for one group of every row that passes
+	float						GroupWidth;		//bucket width; 0 groups by exact value
+	std::vector<QueryAggregate>	Aggregates;
+};
+
+struct QueryResult
+{
+	std::vector<float>				Keys;		//lowest value of each group, ascending
+	std::vector<unsigned long long>	Counts;		//rows in each group
+	std::vector<double>				Values;		//group after group, one per aggregate
+	unsigned long long				Rows;		//in the file
+	unsigned long long				Matched;
+	int								ChunksScanned;
+	int								ChunksSkipped;
+};
+
+void	QueryInit( Query * );
+
+//Groups with no rows are left out of the result
+bool	RunQuery( const ResultFile &, const Query &, QueryResult * );
+
+#endif
@@ -0,0 +1,568 @@
+/*******************************************************
+--------------------- Result Store ---------------------
+Packed values are laid out least significant bit first in 32 bit
+words, so a column of b bit values is ( rows * b + 31 ) / 32 words.
+Delta encoding works on the bit patterns of the floats: the
+difference of each from the one before, zigzagged so small steps
+either way are small numbers. Grid values and times that grow
+steadily come out a few bits each.
+
+Every column's data starts on an 8 byte boundary inside the
+chunk, and every chunk is a multiple of 8 bytes, so the reader can
+use the descriptors in place in the mapped file.
+*******************************************************/
+
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#include "job-system.h"
+#include "result-store.h"
+
+const char *RESULT_COLUMN_NAMES[RESULT_COLUMNS] =
+{
+	"AngleIntersection", "LeadingAngle", "TrailingAngle", "CarStart", "CarSpeed", "BikeStart", "BikeSpeed",
+	"HiddenTime", "HiddenStart", "HiddenEnd", "MinSeparation", "MinSeparationTime", "Collision"
+};
+
+//Full chunks encoded together before they are written
+const int RESULT_WRITE_BATCH = 8;
+
+//One column of one chunk being encoded
+struct EncodeTask
+{
+	const float *				Values;
+	int							Rows;
+	ResultColumnInfo			Info;
+	std::vector<unsigned char>	Data;
+};
+
+
+int ResultFindColumn( const char *name )
+{
+	for (int i = 0; i < RESULT_COLUMNS; i++)
+	{
+		if (strcmp(name, RESULT_COLUMN_NAMES[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+void ResultRowOf( const Scenario &scn, const TrajectoryMetrics &m, ResultRow *row )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+		row->Value[i] = GetScenarioField(scn, i);
+	row->Value[RC_HIDDEN_TIME] = m.HiddenTime;
+	row->Value[RC_HIDDEN_START] = m.HiddenStart;
+	row->Value[RC_HIDDEN_END] = m.HiddenEnd;
+	row->Value[RC_MIN_SEPARATION] = m.MinSeparation;
+	row->Value[RC_MIN_SEPARATION_TIME] = m.MinSeparationTime;
+	row->Value[RC_COLLISION] = m.Collision ? 1.f : 0.f;
+}
+
+static unsigned int FloatBits( float f )
+{
+	unsigned int u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float BitsFloat( unsigned int u )
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static unsigned int BitsNeeded( unsigned int v )
+{
+	unsigned int bits = 0;
+	while (v != 0)
+	{
+		bits++;
+		v >>= 1;
+	}
+	return bits;
+}
+
+//Bytes of count packed values, rounded up to whole words
+static size_t PackedBytes( size_t count, unsigned int bits )
+{
+	return ((count * bits + 31) / 32) * 4;
+}
+
+static void PackBits( const unsigned int *values, size_t count, unsigned int bits, unsigned char *out )
+{
+	unsigned int *words = (unsigned int *)out;
+	memset(out, 0, PackedBytes(count, bits));
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t bit = i * bits;
+		size_t word = bit >> 5;
+		unsigned int shift = (unsigned int)(bit & 31);
+		words[word] |= values[i] << shift;
+		if (shift + bits > 32)
+			words[word + 1] |= values[i] >> (32 - shift);
+	}
+}
+
+static unsigned int UnpackBits( const unsigned int *words, size_t i, unsigned int bits )
+{
+	size_t bit = i * bits;
+	size_t word = bit >> 5;
+	unsigned int shift = (unsigned int)(bit & 31);
+	unsigned long long v = words[word] >> shift;
+	if (shift + bits > 32)
+		v |= (unsigned long long)words[word + 1] << (32 - shift);
+	return bits == 32 ? (unsigned int)v : (unsigned int)v & ((1u << bits) - 1u);
+}
+
+static unsigned int ZigZag( unsigned int delta )
+{
+	int d = (int)delta;
+	return ((unsigned int)d << 1) ^ (unsigned int)(d >> 31);
+}
+
+static unsigned int UnZigZag( unsigned int z )
+{
+	return (z >> 1) ^ (0u - (z & 1u));
+}
+
+//Smallest encoding of one column of a chunk
+static void EncodeColumn( EncodeTask *task )
+{
+	const float *v = task->Values;
+	int rows = task->Rows;
+	ResultColumnInfo &info = task->Info;
+	memset(&info, 0, sizeof(info));
+
+	info.Min = info.Max = v[0];
+	bool constant = true;
+	for (int i = 1; i < rows; i++)
+	{
+		if (v[i] < info.Min)
+			info.Min = v[i];
+		if (v[i] > info.Max)
+			info.Max = v[i];
+		constant = constant && FloatBits(v[i]) == FloatBits(v[0]);
+	}
+	if (constant)
+	{
+		info.Encoding = RE_CONSTANT;
+		task->Data.assign(sizeof(float), 0);
+		memcpy(&task->Data[0], &v[0], sizeof(float));
+		info.Bytes = sizeof(float);
+		return;
+	}
+
+	size_t best = (size_t)rows * sizeof(float);
+	info.Encoding = RE_RAW;
+
+	//Distinct bit patterns, if there are few enough of them
+	std::vector<unsigned int> distinct(rows);
+	for (int i = 0; i < rows; i++)
+		distinct[i] = FloatBits(v[i]);
+	std::sort(distinct.begin(), distinct.end());
+	distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+	unsigned int dictBits = BitsNeeded((unsigned int)distinct.size() - 1);
+	size_t dictBytes = distinct.size() * sizeof(float) + PackedBytes(rows, dictBits);
+	if (distinct.size() <= (size_t)RESULT_MAX_DICTIONARY && dictBytes < best)
+	{
+		best = dictBytes;
+		info.Encoding = RE_DICTIONARY;
+		info.Bits = dictBits;
+		info.Dictionary = (unsigned int)distinct.size();
+	}
+
+	std::vector<unsigned int> deltas(rows - 1);
+	unsigned int widest = 0;
+	for (int i = 1; i < rows; i++)
+	{
+		deltas[i - 1] = ZigZag(FloatBits(v[i]) - FloatBits(v[i - 1]));
+		widest |= deltas[i - 1];
+	}
+	unsigned int deltaBits = BitsNeeded(widest);
+	size_t deltaBytes = sizeof(float) + PackedBytes(rows - 1, deltaBits);
+	if (deltaBytes < best)
+	{
+		best = deltaBytes;
+		info.Encoding = RE_DELTA;
+		info.Bits = deltaBits;
+		info.Dictionary = 0;
+	}
+
+	task->Data.assign(best, 0);
+	unsigned char *out = &task->Data[0];
+	switch (info.Encoding)
+	{
+		case RE_DICTIONARY:
+		{
+			memcpy(out, &distinct[0], distinct.size() * sizeof(float));
+			std::vector<unsigned int> index(rows);
+			for (int i = 0; i < rows; i++)
+				index[i] = (unsigned int)(std::lower_bound(distinct.begin(), distinct.end(), FloatBits(v[i])) - distinct.begin());
+			PackBits(&index[0], rows, info.Bits, out + distinct.size() * sizeof(float));
+			break;
+		}
+		case RE_DELTA:
+			memcpy(out, &v[0], sizeof(float));
+			PackBits(&deltas[0], rows - 1, info.Bits, out + sizeof(float));
+			break;
+		default:
+			memcpy(out, v, best);
+			break;
+	}
+	info.Bytes = (unsigned int)best;
+}
+
+static void EncodeTasks( void *data, int begin, int end )
+{
+	EncodeTask *tasks = (EncodeTask *)data;
+	for (int t = begin; t < end; t++)
+		EncodeColumn(&tasks[t]);
+}
+
+static size_t Align8( size_t n )
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+//Encode and write chunks of the pending rows; all of them if last, otherwise only full ones
+static bool FlushChunks( ResultWriter *w, bool last )
+{
+	int rows = w->PendingRows;
+	int chunkRows = (int)w->Header.ChunkRows;
+	int chunks = last ? (rows + chunkRows - 1) / chunkRows : rows / chunkRows;
+	if (chunks == 0)
+		return true;
+
+	//Pending is column after column, rows apart
+	int capacity = (int)(w->Pending.size() / RESULT_COLUMNS);
+	std::vector<EncodeTask> tasks(chunks * RESULT_COLUMNS);
+	for (int c = 0; c < chunks; c++)
+	{
+		int first = c * chunkRows;
+		int count = rows - first < chunkRows ? rows - first : chunkRows;
+		for (int col = 0; col < RESULT_COLUMNS; col++)
+		{
+			EncodeTask &t = tasks[c * RESULT_COLUMNS + col];
+			t.Values = &w->Pending[(size_t)col * capacity + first];
+			t.Rows = count;
+		}
+	}
+	ParallelFor(0, (int)tasks.size(), 1, EncodeTasks, &tasks[0]);
+
+	bool ok = true;
+	for (int c = 0; c < chunks && ok; c++)
+	{
+		ResultChunk chunk;
+		memset(&chunk, 0, sizeof(chunk));
+		chunk.Magic = RESULT_CHUNK_MAGIC;
+		chunk.Rows = tasks[c * RESULT_COLUMNS].Rows;
+		chunk.FirstRow = w->Header.Rows;
+
+		size_t offset = sizeof(ResultChunk);
+		for (int col = 0; col < RESULT_COLUMNS; col++)
+		{
+			chunk.Column[col] = tasks[c * RESULT_COLUMNS + col].Info;
+			chunk.Column[col].Offset = offset;
+			offset = Align8(offset + chunk.Column[col].Bytes);
+		}
+		chunk.Bytes = offset;
+
+		static const unsigned char padding[8] = { 0 };
+		ok = fwrite(&chunk, sizeof(chunk), 1, w->File) == 1;
+		for (int col = 0; col < RESULT_COLUMNS && ok; col++)
+		{
+			const std::vector<unsigned char> &data = tasks[c * RESULT_COLUMNS + col].Data;
+			size_t pad = Align8(data.size()) - data.size();
+			ok = fwrite(&data[0], 1, data.size(), w->File) == data.size() &&
+				 (pad == 0 || fwrite(padding, 1, pad, w->File) == pad);
+		}
+
+		w->ChunkOffsets.push_back(w->Offset);
+		w->Offset += chunk.Bytes;
+		w->Header.Rows += chunk.Rows;
+		w->Header.Chunks++;
+	}
+
+	//Keep what was not written at the front
+	int written = chunks * chunkRows < rows ? chunks * chunkRows : rows;
+	for (int col = 0; col < RESULT_COLUMNS; col++)
+	{
+		float *column = &w->Pending[(size_t)col * capacity];
+		memmove(column, column + written, (rows - written) * sizeof(float));
+	}
+	w->PendingRows = rows - written;
+
+	if (!ok)
+		fprintf(stderr, "Error writing result chunks\n");
+	return ok;
+}
+
+//Start a writer's in-memory state for a file
+static void WriterInit( ResultWriter *w )
+{
+	memset(&w->Header, 0, sizeof(w->Header));
+	memcpy(w->Header.Magic, RESULT_MAGIC, sizeof(w->Header.Magic));
+	w->Header.Version = RESULT_VERSION;
+	w->Header.Columns = RESULT_COLUMNS;
+	w->Header.ChunkRows = RESULT_CHUNK_ROWS;
+	w->Offset = sizeof(ResultHeader);
+	w->Pending.assign((size_t)RESULT_COLUMNS * RESULT_CHUNK_ROWS * RESULT_WRITE_BATCH, 0.f);
+	w->PendingRows = 0;
+	w->ChunkOffsets.clear();
+}
+
+
+bool ResultWriterOpen( const char *path, ResultWriter *w )
+{
+	w->File = fopen(path, "wb");
+	if (w->File == NULL)
+	{
+		fprintf(stderr, "Unable to create result file '%s'\n", path);
+		return false;
+	}
+
+	WriterInit(w);
+	if (fwrite(&w->Header, sizeof(w->Header), 1, w->File) != 1)
+	{
+		fprintf(stderr, "Error writing result file '%s'\n", path);
+		fclose(w->File);
+		w->File = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool ResultWriterReopen( const char *path, unsigned long long offset, unsigned long long rows,
+						 const std::vector<unsigned long long> &chunkOffsets, ResultWriter *w )
+{
+	w->File = fopen(path, "r+b");
+	if (w->File == NULL)
+	{
+		fprintf(stderr, "Unable to reopen result file '%s'\n", path);
+		return false;
+	}
+
+	WriterInit(w);
+	w->Offset = offset;
+	w->Header.Rows = rows;
+	w->Header.Chunks = chunkOffsets.size();
+	w->ChunkOffsets = chunkOffsets;
+
+#ifdef WIN32
+	bool ok = _chsize_s(_fileno(w->File), (__int64)offset) == 0 && _fseeki64(w->File, (__int64)offset, SEEK_SET) == 0;
+#else
+	bool ok = ftruncate(fileno(w->File), (off_t)offset) == 0 && fseeko(w->File, (off_t)offset, SEEK_SET) == 0;
+#endif
+	if (!ok)
+	{
+		fprintf(stderr, "Unable to cut result file '%s' back to %llu bytes\n", path, offset);
+		fclose(w->File);
+		w->File = NULL;
+	}
+	return ok;
+}
+
+bool ResultWriterAppend( ResultWriter *w, const ResultRow *rows, int count )
+{
+	int capacity = (int)(w->Pending.size() / RESULT_COLUMNS);
+	for (int r = 0; r < count; r++)
+	{
+		for (int col = 0; col < RESULT_COLUMNS; col++)
+			w->Pending[(size_t)col * capacity + w->PendingRows] = rows[r].Value[col];
+		w->PendingRows++;
+		if (w->PendingRows == capacity && !FlushChunks(w, false))
+			return false;
+	}
+	return true;
+}
+
+bool ResultWriterAppendChunk( ResultWriter *w, const ResultChunk *chunk )
+{
+	if (w->PendingRows != 0)
+	{
+		fprintf(stderr, "Chunks can only be copied between whole chunks\n");
+		return false;
+	}
+
+	//Only its place in the run changes
+	ResultChunk copy = *chunk;
+	copy.FirstRow = w->Header.Rows;
+	const unsigned char *data = (const unsigned char *)chunk + sizeof(ResultChunk);
+	size_t bytes = (size_t)(chunk->Bytes - sizeof(ResultChunk));
+	if (fwrite(&copy, sizeof(copy), 1, w->File) != 1 || fwrite(data, 1, bytes, w->File) != bytes)
+	{
+		fprintf(stderr, "Error writing result chunks\n");
+		return false;
+	}
+
+	w->ChunkOffsets.push_back(w->Offset);
+	w->Offset += chunk->Bytes;
+	w->Header.Rows += chunk->Rows;
+	w->Header.Chunks++;
+	return true;
+}
+
+bool ResultWriterSync( ResultWriter *w )
+{
+	if (!FlushChunks(w, false) || fflush(w->File) != 0)
+		return false;
+#ifdef WIN32
+	bool ok = _commit(_fileno(w->File)) == 0;
+#else
+	bool ok = fsync(fileno(w->File)) == 0;
+#endif
+	if (!ok)
+		fprintf(stderr, "Unable to sync result file\n");
+	return ok;
+}
+
+bool ResultWriterClose( ResultWriter *w )
+{
+	if (w->File == NULL)
+		return false;
+
+	bool ok = FlushChunks(w, true);
+	w->Header.Directory = w->Offset;
+	if (ok && !w->ChunkOffsets.empty())
+		ok = fwrite(&w->ChunkOffsets[0], sizeof(unsigned long long), w->ChunkOffsets.size(), w->File) == w->ChunkOffsets.size();
+	ok = ok && fseek(w->File, 0, SEEK_SET) == 0 && fwrite(&w->Header, sizeof(w->Header), 1, w->File) == 1;
+	ok = fclose(w->File) == 0 && ok;
+	w->File = NULL;
+	w->Pending.clear();
+	if (!ok)
+		fprintf(stderr, "Error finishing result file\n");
+	return ok;
+}
+
+//Chunk at offset, or NULL if there is not a whole one there
+static const ResultChunk *ChunkAt( const MappedFile &file, unsigned long long offset )
+{
+	if (offset % 8 != 0 || offset + sizeof(ResultChunk) > file.Size)
+		return NULL;
+	const ResultChunk *chunk = (const ResultChunk *)(file.Data + offset);
+	if (chunk->Magic != RESULT_CHUNK_MAGIC || chunk->Bytes < sizeof(ResultChunk) || offset + chunk->Bytes > file.Size)
+		return NULL;
+	for (int col = 0; col < RESULT_COLUMNS; col++)
+	{
+		const ResultColumnInfo &info = chunk->Column[col];
+		if (info.Offset + info.Bytes > chunk->Bytes)
+			return NULL;
+	}
+	return chunk;
+}
+
+bool ResultFileOpen( const char *path, ResultFile *rf )
+{
+	rf->Header = NULL;
+	rf->Chunks.clear();
+	rf->Rows = 0;
+	if (!MapFile(path, &rf->File))
+	{
+		fprintf(stderr, "Unable to open result file '%s'\n", path);
+		return false;
+	}
+
+	const MappedFile &file = rf->File;
+	const ResultHeader *h = (const ResultHeader *)file.Data;
+	if (file.Size < sizeof(ResultHeader) || memcmp(h->Magic, RESULT_MAGIC, sizeof(h->Magic)) != 0 ||
+		h->Version != RESULT_VERSION || h->Columns != RESULT_COLUMNS)
+	{
+		fprintf(stderr, "'%s' is not a version %u result file\n", path, RESULT_VERSION);
+		UnmapFile(&rf->File);
+		return false;
+	}
+	rf->Header = h;
+
+	if (h->Directory != 0 && h->Directory + h->Chunks * sizeof(unsigned long long) <= file.Size)
+	{
+		const unsigned long long *offsets = (const unsigned long long *)(file.Data + h->Directory);
+		for (unsigned long long c = 0; c < h->Chunks; c++)
+		{
+			const ResultChunk *chunk = ChunkAt(file, offsets[c]);
+			if (chunk == NULL)
+				break;
+			rf->Chunks.push_back(chunk);
+		}
+	}
+	else
+	{
+		//Never closed: take every whole chunk there is
+		unsigned long long offset = sizeof(ResultHeader);
+		const ResultChunk *chunk;
+		while ((chunk = ChunkAt(file, offset)) != NULL)
+		{
+			rf->Chunks.push_back(chunk);
+			offset += chunk->Bytes;
+		}
+	}
+
+	for (size_t c = 0; c < rf->Chunks.size(); c++)
+		rf->Rows += rf->Chunks[c]->Rows;
+	return true;
+}
+
+void ResultFileClose( ResultFile *rf )
+{
+	if (rf->Header != NULL)
+		UnmapFile(&rf->File);
+	rf->Header = NULL;
+	rf->Chunks.clear();
+	rf->Rows = 0;
+}
+
+bool ResultChunkMayMatch( const ResultFile &rf, int chunk, int column, float lo, float hi )
+{
+	const ResultColumnInfo &info = rf.Chunks[chunk]->Column[column];
+	return info.Max >= lo && info.Min <= hi;
+}
+
+void ResultDecodeColumn( const ResultFile &rf, int chunk, int column, float *out )
+{
+	const ResultChunk *c = rf.Chunks[chunk];
+	const ResultColumnInfo &info = c->Column[column];
+	const unsigned char *data = (const unsigned char *)c + info.Offset;
+	int rows = (int)c->Rows;
+
+	switch (info.Encoding)
+	{
+		case RE_CONSTANT:
+			for (int i = 0; i < rows; i++)
+				out[i] = info.Min;
+			break;
+
+		case RE_DICTIONARY:
+		{
+			const float *dict = (const float *)data;
+			const unsigned int *words = (const unsigned int *)(data + info.Dictionary * sizeof(float));
+			for (int i = 0; i < rows; i++)
+				out[i] = dict[UnpackBits(words, i, info.Bits)];
+			break;
+		}
+
+		case RE_DELTA:
+		{
+			const unsigned int *words = (const unsigned int *)(data + sizeof(float));
+			unsigned int bits = FloatBits(*(const float *)data);
+			out[0] = BitsFloat(bits);
+			for (int i = 1; i < rows; i++)
+			{
+				bits += UnZigZag(info.Bits > 0 ? UnpackBits(words, i - 1, info.Bits) : 0u);
+				out[i] = BitsFloat(bits);
+			}
+			break;
+		}
+
+		default:
+			memcpy(out, data, rows * sizeof(float));
+			break;
+	}
+}
@@ -0,0 +1,152 @@
+/*******************************************************
+--------------------- Result Store ---------------------
+Columnar binary file for the rows sweeps and Monte Carlo runs
+produce: the seven scenario fields and the metrics of each run.
+
+Rows are stored in chunks of RESULT_CHUNK_ROWS. Inside a chunk
+each column is encoded on its own with whichever of these is
+smallest:
+	constant		every row the same
+	dictionary		few distinct values, bit-packed indices into them
+	delta			bit-packed differences of the raw bits, for
+					columns that change steadily
+	raw				plain floats
+Every chunk also records each column's min and max. A reader that
+only wants, say, one AngleIntersection range skips any chunk whose
+range cannot match without decoding it, and sweeps write their
+rows with AngleIntersection outermost, so those ranges are narrow.
+
+Chunks are encoded in parallel on the job system. Each one on disk
+starts with its own descriptor, so a file whose directory was
+never written can still be read chunk by chunk.
+*******************************************************/
+
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "blindspot-model.h"
+#include "mapped-file.h"
+
+//File layout: ResultHeader, chunks (each a ResultChunk then its column data),
+//then the directory, one 64 bit file offset per chunk
+const char RESULT_MAGIC[8] = { 'C', 'C', 'V', 'R', 'S', 'L', 'T', '1' };
+const unsigned int RESULT_VERSION = 1;
+const unsigned int RESULT_CHUNK_MAGIC = 0x4b4e4843;		//"CHNK"
+
+const int RESULT_CHUNK_ROWS = 1 << 16;
+
+//Most distinct values a dictionary column holds
+const int RESULT_MAX_DICTIONARY = 256;
+
+//Columns: the scenario fields in ScenarioField order, then the metrics
+enum ResultColumn
+{
+	RC_HIDDEN_TIME = SCN_FIELDS,
+	RC_HIDDEN_START,
+	RC_HIDDEN_END,
+	RC_MIN_SEPARATION,
+	RC_MIN_SEPARATION_TIME,
+	RC_COLLISION,				//1 or 0
+	RESULT_COLUMNS
+};
+
+extern const char *RESULT_COLUMN_NAMES[RESULT_COLUMNS];
+
+//Column of that name, or -1
+int		ResultFindColumn( const char * );
+
+enum ResultEncoding
+{
+	RE_RAW,
+	RE_CONSTANT,
+	RE_DICTIONARY,
+	RE_DELTA
+};
+
+struct ResultHeader
+{
+	char				Magic[8];
+	unsigned int		Version;
+	unsigned int		Columns;			//RESULT_COLUMNS
+	unsigned int		ChunkRows;			//RESULT_CHUNK_ROWS
+	unsigned int		Reserved;
+	unsigned long long	Rows;
+	unsigned long long	Chunks;
+	unsigned long long	Directory;			//offset of the directory, 0 if the file was not closed
+};
+
+struct ResultColumnInfo
+{
+	unsigned int		Encoding;			//ResultEncoding
+	unsigned int		Bits;				//per packed value, dictionary and delta
+	unsigned int		Dictionary;			//values in the dictionary
+	unsigned int		Bytes;				//of encoded data
+	unsigned long long	Offset;				//of the encoded data from the start of the chunk
+	float				Min, Max;
+};
+
+struct ResultChunk
+{
+	unsigned int		Magic;				//RESULT_CHUNK_MAGIC
+	unsigned int		Rows;
+	unsigned long long	FirstRow;			//row number of the chunk's first row in the whole run
+	unsigned long long	Bytes;				//of the chunk, this descriptor included
+	ResultColumnInfo	Column[RESULT_COLUMNS];
+};
+
+//One run's values in ResultColumn order
+struct ResultRow
+{
+	float	Value[RESULT_COLUMNS];
+};
+
+struct ResultWriter
+{
+	FILE *					File;
+	ResultHeader			Header;
+	unsigned long long		Offset;			//where the next chunk goes
+	std::vector<float>		Pending;		//rows not written yet, column after column
+	int						PendingRows;
+	std::vector<unsigned long long>	ChunkOffsets;
+};
+
+struct ResultFile
+{
+	MappedFile								File;
+	const ResultHeader *					Header;
+	std::vector<const ResultChunk *>		Chunks;
+	unsigned long long						Rows;
+};
+
+//Row for a scenario and its metrics
+void	ResultRowOf( const Scenario &, const TrajectoryMetrics &, ResultRow * );
+
+bool	ResultWriterOpen( const char *, ResultWriter * );
+//Rows are buffered and written a whole chunk at a time
+bool	ResultWriterAppend( ResultWriter *, const ResultRow *, int );
+//Copies an encoded chunk from another file as it is; nothing may be pending
+bool	ResultWriterAppendChunk( ResultWriter *, const ResultChunk * );
+//Writes every whole chunk pending and waits until the file is on disk
+bool	ResultWriterSync( ResultWriter * );
+//Writes the last partial chunk and the directory
+bool	ResultWriterClose( ResultWriter * );
+
+//Carry on a file whose first offset bytes hold rows rows in chunks at chunkOffsets,
+//as a writer had them after ResultWriterSync( ); anything after offset is cut off
+bool	ResultWriterReopen( const char *, unsigned long long offset, unsigned long long rows,
+							const std::vector<unsigned long long> &chunkOffsets, ResultWriter * );
+
+bool	ResultFileOpen( const char *, ResultFile * );
+void	ResultFileClose( ResultFile * );
+
+//False if no row of the chunk can have column in [ lo, hi ]
+bool	ResultChunkMayMatch( const ResultFile &, int chunk, int column, float lo, float hi );
+
+//Every row of one column of a chunk into out
+void	ResultDecodeColumn( const ResultFile &, int chunk, int column, float *out );
+
+#endif
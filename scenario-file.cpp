@@ -0,0 +1,418 @@
+/*******************************************************
+--------------------- Scenario File ---------------------
+The file is parsed where it is mapped. A first pass splits it into
+sections and keeps only where each one's name, base and body are;
+names are never copied. The sections are then sorted by name, which
+finds duplicates and gives a binary search for bases and for
+ScenarioFind( ). A second pass resolves the sections in file order,
+each starting from its already resolved base, and checks them.
+
+Only a number is copied out, into a small buffer, so strtod( ) has
+the terminator the mapped text does not.
+
+A mapping shows the file as it is now, so a file truncated while it
+is parsed takes the pages under the parser away with it.
+ScenarioFileRead( ) is for files that are being edited: it reads
+a copy first and parses that, and a copy cut short by a save in
+progress is only a file with problems.
+*******************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "scenario-file.h"
+
+//Longest number token
+const int SCENARIO_NUMBER_CHARS = 63;
+
+//Where one section's parts are in the text
+struct SectionText
+{
+	const char *	Base;			//NULL without one
+	int				BaseLength;
+	const char *	Body;
+	const char *	BodyEnd;
+	int				BodyLine;
+};
+
+struct ParseState
+{
+	const char *	Path;
+	int				Errors;
+};
+
+
+static void ParseError( ParseState *ps, int line, const char *format, ... )
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "%s:%d: ", ps->Path, line);
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	ps->Errors++;
+}
+
+static bool IsSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+//Trim spaces off both ends of [ *begin, *end )
+static void Trim( const char **begin, const char **end )
+{
+	while (*begin < *end && IsSpace(**begin))
+		(*begin)++;
+	while (*end > *begin && IsSpace((*end)[-1]))
+		(*end)--;
+}
+
+//End of the line starting at p, before any comment
+static const char *LineContentEnd( const char *p, const char *end )
+{
+	while (p < end && *p != '\n' && *p != '#' && *p != ';')
+		p++;
+	return p;
+}
+
+static const char *NextLine( const char *p, const char *end )
+{
+	while (p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+static int CompareNames( const char *a, int aLength, const char *b, int bLength )
+{
+	int c = memcmp(a, b, aLength < bLength ? aLength : bLength);
+	if (c != 0)
+		return c;
+	return aLength - bLength;
+}
+
+//Entries index with this name in the sorted ByName, -1 if there is none
+static int FindName( const ScenarioFile &file, const char *name, int length )
+{
+	int lo = 0, hi = (int)file.ByName.size();
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		const ScenarioEntry &e = file.Entries[file.ByName[mid]];
+		int c = CompareNames(e.Name, e.NameLength, name, length);
+		if (c == 0)
+			return file.ByName[mid];
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+struct NameLess
+{
+	const ScenarioFile *	File;
+
+	bool operator( )( int a, int b ) const
+	{
+		const ScenarioEntry &ea = File->Entries[a];
+		const ScenarioEntry &eb = File->Entries[b];
+		int c = CompareNames(ea.Name, ea.NameLength, eb.Name, eb.NameLength);
+		return c != 0 ? c < 0 : a < b;
+	}
+};
+
+//A whole token as a number
+static bool ParseNumber( const char *begin, const char *end, double *value )
+{
+	Trim(&begin, &end);
+	int length = (int)(end - begin);
+	if (length < 1 || length > SCENARIO_NUMBER_CHARS)
+		return false;
+	char text[SCENARIO_NUMBER_CHARS + 1];
+	memcpy(text, begin, length);
+	text[length] = '\0';
+	char *stop;
+	*value = strtod(text, &stop);
+	return stop == text + length;
+}
+
+//value or min:max:steps
+static bool ParseValue( const char *begin, const char *end, float *lo, float *hi, int *steps )
+{
+	const char *parts[4] = { begin, NULL, NULL, NULL };
+	int count = 1;
+	for (const char *p = begin; p < end; p++)
+	{
+		if (*p == ':')
+		{
+			if (count == 3)
+				return false;
+			parts[count++] = p + 1;
+		}
+	}
+	parts[count] = end + 1;
+
+	double v[3];
+	for (int i = 0; i < count; i++)
+	{
+		if (!ParseNumber(parts[i], parts[i + 1] - 1, &v[i]))
+			return false;
+	}
+	if (count == 1)
+	{
+		*lo = *hi = (float)v[0];
+		*steps = 1;
+		return true;
+	}
+	if (count != 3 || v[2] != (double)(int)v[2] || v[2] < 1.)
+		return false;
+	*lo = (float)v[0];
+	*hi = (float)v[1];
+	*steps = (int)v[2];
+	return true;
+}
+
+//Apply one section's Field = value lines to its spec
+static void ParseBody( ParseState *ps, const SectionText &text, SweepSpec *spec )
+{
+	bool seen[SCN_FIELDS] = { false };
+	int line = text.BodyLine;
+	for (const char *p = text.Body; p < text.BodyEnd; p = NextLine(p, text.BodyEnd), line++)
+	{
+		const char *begin = p, *end = LineContentEnd(p, text.BodyEnd);
+		Trim(&begin, &end);
+		//A broken [ line has been reported already
+		if (begin == end || *begin == '[')
+			continue;
+
+		const char *equals = (const char *)memchr(begin, '=', end - begin);
+		if (equals == NULL)
+		{
+			ParseError(ps, line, "expected Field = value");
+			continue;
+		}
+		const char *nameEnd = equals;
+		Trim(&begin, &nameEnd);
+		int field = -1;
+		for (int i = 0; i < SCN_FIELDS; i++)
+		{
+			if (CompareNames(begin, (int)(nameEnd - begin), SCENARIO_NAMES[i], (int)strlen(SCENARIO_NAMES[i])) == 0)
+				field = i;
+		}
+		if (field < 0)
+		{
+			ParseError(ps, line, "unknown field '%.*s'", (int)(nameEnd - begin), begin);
+			continue;
+		}
+		if (seen[field])
+		{
+			ParseError(ps, line, "%s is given twice", SCENARIO_NAMES[field]);
+			continue;
+		}
+		seen[field] = true;
+
+		float lo, hi;
+		int steps;
+		if (!ParseValue(equals + 1, end, &lo, &hi, &steps))
+		{
+			ParseError(ps, line, "expected %s = value or min:max:steps", SCENARIO_NAMES[field]);
+			continue;
+		}
+		spec->Lo[field] = lo;
+		spec->Hi[field] = hi;
+		spec->Steps[field] = steps;
+	}
+}
+
+//Every run of the scenario must be one the simulation can show
+static void CheckEntry( ParseState *ps, const ScenarioEntry &e )
+{
+	const SweepSpec &spec = e.Spec;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		if (!(spec.Lo[i] >= SCENARIO_MIN[i] && spec.Hi[i] <= SCENARIO_MAX[i]))
+			ParseError(ps, e.Line, "'%.*s': %s must be between %g and %g", e.NameLength, e.Name,
+					   SCENARIO_NAMES[i], SCENARIO_MIN[i], SCENARIO_MAX[i]);
+		else if (spec.Lo[i] > spec.Hi[i])
+			ParseError(ps, e.Line, "'%.*s': %s runs from %g down to %g", e.NameLength, e.Name,
+					   SCENARIO_NAMES[i], spec.Lo[i], spec.Hi[i]);
+	}
+	if (spec.Hi[SCN_LA] > spec.Lo[SCN_TA])
+		ParseError(ps, e.Line, "'%.*s': LeadingAngle goes past TrailingAngle", e.NameLength, e.Name);
+}
+
+
+//Parse and check [ text, text + size ), which the file holds on to
+static bool ParseFile( const char *path, const char *text, size_t size, ScenarioFile *file )
+{
+	ParseState ps;
+	ps.Path = path;
+	ps.Errors = 0;
+
+	//Split the text into sections
+	const char *p = text;
+	const char *end = p + size;
+	std::vector<SectionText> sections;
+	int line = 1;
+	for (; p < end; p = NextLine(p, end), line++)
+	{
+		const char *begin = p, *contentEnd = LineContentEnd(p, end);
+		Trim(&begin, &contentEnd);
+		if (begin == contentEnd)
+			continue;
+		if (*begin != '[')
+		{
+			if (sections.empty())
+				ParseError(&ps, line, "expected a [ scenario ] before any fields");
+			continue;
+		}
+		if (contentEnd[-1] != ']')
+		{
+			ParseError(&ps, line, "expected ] at the end of the scenario name");
+			continue;
+		}
+
+		const char *name = begin + 1, *nameEnd = contentEnd - 1;
+		SectionText text;
+		text.Base = NULL;
+		text.BaseLength = 0;
+		const char *colon = (const char *)memchr(name, ':', nameEnd - name);
+		if (colon != NULL)
+		{
+			const char *base = colon + 1, *baseEnd = nameEnd;
+			Trim(&base, &baseEnd);
+			text.Base = base;
+			text.BaseLength = (int)(baseEnd - base);
+			nameEnd = colon;
+		}
+		Trim(&name, &nameEnd);
+		if (name == nameEnd || (text.Base != NULL && text.BaseLength == 0))
+		{
+			ParseError(&ps, line, "empty scenario name");
+			continue;
+		}
+
+		//The previous section's body ends here
+		if (!sections.empty())
+			sections.back().BodyEnd = p;
+		text.Body = NextLine(p, end);
+		text.BodyEnd = end;
+		text.BodyLine = line + 1;
+		sections.push_back(text);
+
+		ScenarioEntry e;
+		e.Name = name;
+		e.NameLength = (int)(nameEnd - name);
+		e.Line = line;
+		file->Entries.push_back(e);
+	}
+
+	//Sort by name, which also brings duplicates together
+	int count = (int)file->Entries.size();
+	file->ByName.resize(count);
+	for (int i = 0; i < count; i++)
+		file->ByName[i] = i;
+	NameLess less;
+	less.File = file;
+	std::sort(file->ByName.begin(), file->ByName.end(), less);
+	for (int i = 1; i < count; i++)
+	{
+		const ScenarioEntry &a = file->Entries[file->ByName[i - 1]];
+		const ScenarioEntry &b = file->Entries[file->ByName[i]];
+		if (CompareNames(a.Name, a.NameLength, b.Name, b.NameLength) == 0)
+			ParseError(&ps, b.Line, "'%.*s' is already a scenario on line %d", b.NameLength, b.Name, a.Line);
+	}
+
+	//Resolve each section on top of its base, in file order so every base is done first
+	for (int i = 0; i < count; i++)
+	{
+		ScenarioEntry &e = file->Entries[i];
+		const SectionText &text = sections[i];
+		SweepSpecDefault(&e.Spec);
+		if (text.Base != NULL)
+		{
+			int base = FindName(*file, text.Base, text.BaseLength);
+			if (base < 0 || base >= i)
+				ParseError(&ps, e.Line, "'%.*s' must be a scenario earlier in the file", text.BaseLength, text.Base);
+			else
+				e.Spec = file->Entries[base].Spec;
+		}
+		ParseBody(&ps, text, &e.Spec);
+		CheckEntry(&ps, e);
+	}
+
+	if (ps.Errors != 0)
+	{
+		fprintf(stderr, "%s: %d problem%s, not loaded\n", path, ps.Errors, ps.Errors == 1 ? "" : "s");
+		ScenarioFileClose(file);
+		return false;
+	}
+	return true;
+}
+
+
+bool ScenarioFileOpen( const char *path, ScenarioFile *file )
+{
+	file->Entries.clear();
+	file->ByName.clear();
+	file->Text.clear();
+	file->Mapped = MapFile(path, &file->Map);
+	if (!file->Mapped)
+	{
+		fprintf(stderr, "Unable to open scenario file '%s'\n", path);
+		return false;
+	}
+	return ParseFile(path, (const char *)file->Map.Data, file->Map.Size, file);
+}
+
+bool ScenarioFileRead( const char *path, ScenarioFile *file )
+{
+	file->Entries.clear();
+	file->ByName.clear();
+	file->Text.clear();
+	file->Mapped = false;
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Unable to open scenario file '%s'\n", path);
+		return false;
+	}
+
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		file->Text.insert(file->Text.end(), buffer, buffer + n);
+	bool ok = !ferror(fp);
+	fclose(fp);
+	if (!ok)
+	{
+		fprintf(stderr, "Error reading scenario file '%s'\n", path);
+		return false;
+	}
+	return ParseFile(path, file->Text.empty() ? NULL : &file->Text[0], file->Text.size(), file);
+}
+
+void ScenarioFileClose( ScenarioFile *file )
+{
+	if (file->Mapped)
+		UnmapFile(&file->Map);
+	file->Mapped = false;
+	file->Text.clear();
+	file->Entries.clear();
+	file->ByName.clear();
+}
+
+int ScenarioFind( const ScenarioFile &file, const char *name )
+{
+	return FindName(file, name, (int)strlen(name));
+}
+
+std::string ScenarioName( const ScenarioEntry &e )
+{
+	return std::string(e.Name, e.NameLength);
+}
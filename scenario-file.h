@@ -0,0 +1,78 @@
+/*******************************************************
+--------------------- Scenario File ---------------------
+Named scenarios kept in a text file, so a study is written down
+once and opened by name in the GUI or handed to the batch tool
+instead of being set up on the sliders every time.
+
+	#Comments run from # or ; to the end of the line
+	[Perfect conditions]
+	AngleIntersection = 69
+	LeadingAngle = 19.4
+	TrailingAngle = 27.1
+	CarStart = 100
+	CarSpeed = 18
+	BikeStart = 39
+	BikeSpeed = 7
+
+	[Fast car : Perfect conditions]
+	CarSpeed = 25
+
+	[Car speeds : Fast car]
+	CarSpeed = 8:30:23
+
+Each [ section ] is one scenario. A field is either one value or
+min:max:steps, the same as on the sweep command line, so a scenario
+is a grid of runs just as a sweep is; the blinder is set by its
+LeadingAngle and TrailingAngle like any other field. A scenario
+named after a colon starts from that scenario's values, which must
+come earlier in the file; without one it starts from the
+simulation's starting values ( SweepSpecDefault( ) ).
+
+Every scenario is checked when the file is opened: every value must
+be within its slider's range and the blinder's leading edge may not
+come after its trailing edge in any run. Each problem is reported
+with its line and the file is refused if there are any.
+*******************************************************/
+
+#ifndef SCENARIO_FILE_H
+#define SCENARIO_FILE_H
+
+#include <string>
+#include <vector>
+
+#include "mapped-file.h"
+#include "sweep.h"
+
+//The file the GUI opens scenarios from unless told otherwise
+const char * const SCENARIO_FILE = "scenarios.txt";
+
+struct ScenarioEntry
+{
+	const char *	Name;			//points into the file's text; not terminated
+	int				NameLength;
+	int				Line;			//of its [ section ] line
+	SweepSpec		Spec;
+};
+
+struct ScenarioFile
+{
+	MappedFile					Map;
+	bool						Mapped;			//false when the text was read into Text instead
+	std::vector<char>			Text;
+	std::vector<ScenarioEntry>	Entries;		//in file order
+	std::vector<int>			ByName;			//Entries indices sorted by name
+};
+
+//Map and check the whole file; false, with every problem reported, if it cannot be used
+bool		ScenarioFileOpen( const char *path, ScenarioFile * );
+
+//The same, from a copy read into memory, for a file that may be rewritten while it is parsed
+bool		ScenarioFileRead( const char *path, ScenarioFile * );
+void		ScenarioFileClose( ScenarioFile * );
+
+//Index into Entries of the scenario with this name, -1 if there is none
+int			ScenarioFind( const ScenarioFile &, const char *name );
+
+std::string	ScenarioName( const ScenarioEntry & );
+
+#endif
@@ -0,0 +1,216 @@
+/*******************************************************
+--------------------- Scenario Watch ---------------------
+On Linux the thread waits on inotify for the file's directory, not
+the file: editors often save by writing a new file and renaming it
+over the old one, which a watch on the old file would never see.
+A write finishing (IN_CLOSE_WRITE) or a file renamed into place
+(IN_MOVED_TO) under the right name counts as a change. Elsewhere,
+or if inotify cannot be had, the file's size and modification time
+are looked at every SCENARIO_WATCH_POLL_MS; times are whole
+seconds, so two saves of the same size in one second look like one.
+
+Either way the thread waits SCENARIO_WATCH_SETTLE_MS after a change
+for any more, so one save is read once. The reloaded scenario is
+handed over under a mutex held only for the copy, with an atomic
+flag so a frame with nothing new never takes the lock.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "scenario-file.h"
+#include "scenario-watch.h"
+
+static std::thread			Watcher;
+static std::atomic<bool>	WatchStop(false);
+static bool					Watching = false;
+static std::string			WatchPath;
+static std::string			WatchName;
+
+static std::mutex			PendingLock;
+static Scenario				Pending;
+static std::atomic<bool>	PendingOn(false);
+
+
+//Read the file again and leave the scenario for the GUI if it is good
+static void Reload( )
+{
+	//A copy, since the file may be cut short by another save while it is parsed
+	ScenarioFile file;
+	if (!ScenarioFileRead(WatchPath.c_str(), &file))
+	{
+		fprintf(stderr, "Keeping scenario '%s' as it was\n", WatchName.c_str());
+		return;
+	}
+
+	int index = ScenarioFind(file, WatchName.c_str());
+	if (index < 0)
+	{
+		fprintf(stderr, "No scenario '%s' in %s any more; keeping it as it was\n", WatchName.c_str(), WatchPath.c_str());
+	}
+	else
+	{
+		Scenario scn;
+		SweepScenario(file.Entries[index].Spec, 0, &scn);
+		std::lock_guard<std::mutex> lock(PendingLock);
+		Pending = scn;
+		PendingOn.store(true, std::memory_order_release);
+	}
+	ScenarioFileClose(&file);
+}
+
+static void Settle( )
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(SCENARIO_WATCH_SETTLE_MS));
+}
+
+//Size and modification time, or zeros if the file is not there right now
+static void FileStamp( long long *size, long long *modified )
+{
+	struct stat st;
+	if (stat(WatchPath.c_str(), &st) != 0)
+	{
+		*size = *modified = 0;
+		return;
+	}
+	*size = (long long)st.st_size;
+	*modified = (long long)st.st_mtime;
+}
+
+static void PollLoop( )
+{
+	long long size, modified;
+	FileStamp(&size, &modified);
+	while (!WatchStop.load(std::memory_order_acquire))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(SCENARIO_WATCH_POLL_MS));
+		long long newSize, newModified;
+		FileStamp(&newSize, &newModified);
+		if (newSize == size && newModified == modified)
+			continue;
+
+		Settle();
+		FileStamp(&size, &modified);
+		if (size != 0 || modified != 0)
+			Reload();
+	}
+}
+
+#ifdef __linux__
+
+//True if any of the events waiting on fd are for file
+static bool ReadEvents( int fd, const std::string &file )
+{
+	//Aligned for the inotify_event structures read into it
+	long long buffer[512];
+	bool changed = false;
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		const char *p = (const char *)buffer;
+		while (p < (const char *)buffer + n)
+		{
+			const struct inotify_event *e = (const struct inotify_event *)p;
+			if (e->len > 0 && file == e->name)
+				changed = true;
+			p += sizeof(struct inotify_event) + e->len;
+		}
+	}
+	return changed;
+}
+
+static void WatchLoop( )
+{
+	size_t slash = WatchPath.find_last_of('/');
+	std::string dir = slash == std::string::npos ? "." : WatchPath.substr(0, slash > 0 ? slash : 1);
+	std::string file = slash == std::string::npos ? WatchPath : WatchPath.substr(slash + 1);
+
+	int fd = inotify_init1(IN_NONBLOCK);
+	if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		PollLoop();
+		return;
+	}
+
+	while (!WatchStop.load(std::memory_order_acquire))
+	{
+		struct pollfd p;
+		p.fd = fd;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll(&p, 1, SCENARIO_WATCH_POLL_MS) <= 0 || !ReadEvents(fd, file))
+			continue;
+
+		Settle();
+		ReadEvents(fd, file);
+		Reload();
+	}
+	close(fd);
+}
+
+#else
+
+static void WatchLoop( )
+{
+	PollLoop();
+}
+
+#endif
+
+
+bool ScenarioWatchStart( const char *path, const char *name )
+{
+	ScenarioWatchStop();
+
+	struct stat st;
+	if (stat(path, &st) != 0)
+	{
+		fprintf(stderr, "Unable to watch scenario file '%s'\n", path);
+		return false;
+	}
+
+	WatchPath = path;
+	WatchName = name;
+	PendingOn.store(false);
+	WatchStop.store(false);
+	Watcher = std::thread(WatchLoop);
+	Watching = true;
+	return true;
+}
+
+void ScenarioWatchStop( )
+{
+	if (!Watching)
+		return;
+
+	WatchStop.store(true, std::memory_order_release);
+	Watcher.join();
+	Watching = false;
+}
+
+bool ScenarioWatchTake( Scenario *scn )
+{
+	if (!PendingOn.load(std::memory_order_acquire))
+		return false;
+
+	std::lock_guard<std::mutex> lock(PendingLock);
+	*scn = Pending;
+	PendingOn.store(false, std::memory_order_relaxed);
+	return true;
+}
@@ -0,0 +1,31 @@
+/*******************************************************
+--------------------- Scenario Watch ---------------------
+Keeps a scenario opened from a file up to date with the file, so
+editing a study shows up in the running simulation without a
+restart.
+
+A background thread waits for the file to change, reads and checks
+it again and looks the scenario up by name. A good result is left
+for the GUI to take between frames; a file with problems is
+reported and the scenario already showing stays. Neither the
+waiting nor the parsing happens on the thread that draws.
+*******************************************************/
+
+#ifndef SCENARIO_WATCH_H
+#define SCENARIO_WATCH_H
+
+#include "blindspot-model.h"
+
+//How often the file is looked at where there is no change notification, and how long
+//to wait for more writes after a change before reading the file, in milliseconds
+const int SCENARIO_WATCH_POLL_MS = 250;
+const int SCENARIO_WATCH_SETTLE_MS = 50;
+
+//Watch path for changes to the scenario called name; stops any earlier watch
+bool	ScenarioWatchStart( const char *path, const char *name );
+void	ScenarioWatchStop( );
+
+//The scenario's first run as the file last read, if it has been read again since the last call
+bool	ScenarioWatchTake( Scenario * );
+
+#endif
@@ -0,0 +1,247 @@
+/*******************************************************
+--------------------- Sensitivity ---------------------
+The estimators are Saltelli's for the first order index,
+	S_i = mean( f(B) * ( f(AB_i) - f(A) ) ) / V
+and Jansen's for the total order index,
+	ST_i = mean( ( f(A) - f(AB_i) )^2 ) / ( 2 V )
+with V the variance of f(A) and f(B) together.
+
+Row n of A and B is point n of a 2 * SCN_FIELDS dimensional
+quasi-random sequence; its first half fills A and the second half
+B. Rows are generated inside the jobs, so only the function values
+are ever stored.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "job-system.h"
+#include "qmc.h"
+#include "sensitivity.h"
+
+//Rows evaluated by one job
+const int SOBOL_GRAIN = 256;
+
+//Slowest speed the default range draws, meters per second
+const float SOBOL_MIN_SPEED = 1.f;
+
+//Dimensions of one quasi-random point: a row of A then a row of B
+const int SOBOL_DIMENSIONS = 2 * SCN_FIELDS;
+
+//Function values of every matrix, and what the jobs need to fill them
+struct SobolBatch
+{
+	SensitivityRange	Range;
+	QmcSequence			Sequence;
+	int					Samples;
+	std::vector<float>	A, B;
+	std::vector<float>	AB;					//SCN_FIELDS blocks of Samples values
+	int					Resamples;
+	std::vector<float>	First, Total;		//Resamples rows of SCN_FIELDS
+};
+
+
+void SensitivityRangeDefault( SensitivityRange *range )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		range->Lo[i] = SCENARIO_MIN[i];
+		range->Hi[i] = SCENARIO_MAX[i];
+	}
+
+	//A run that barely moves lasts for ever, and its hidden time would swamp the variance
+	if (range->Lo[SCN_CSPEED] < SOBOL_MIN_SPEED)
+		range->Lo[SCN_CSPEED] = SOBOL_MIN_SPEED;
+	if (range->Lo[SCN_BSPEED] < SOBOL_MIN_SPEED)
+		range->Lo[SCN_BSPEED] = SOBOL_MIN_SPEED;
+}
+
+//Scenario at point u of the unit cube
+static void ScenarioAt( const SensitivityRange &range, const float *u, Scenario *scn )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+		SetScenarioField(scn, i, range.Lo[i] + u[i] * (range.Hi[i] - range.Lo[i]));
+}
+
+static float HiddenTime( const Scenario &scn )
+{
+	TrajectoryMetrics m;
+	ComputeTrajectoryMetrics(scn, &m);
+	return m.HiddenTime;
+}
+
+static void EvaluateRows( void *data, int begin, int end )
+{
+	SobolBatch *batch = (SobolBatch *)data;
+	const SensitivityRange &range = batch->Range;
+	int samples = batch->Samples;
+
+	float points[SOBOL_GRAIN * SOBOL_DIMENSIONS];
+	QmcGenerate(batch->Sequence, begin, end - begin, points);
+
+	for (int n = begin; n < end; n++)
+	{
+		const float *u = &points[(n - begin) * SOBOL_DIMENSIONS];
+		Scenario a, b;
+		ScenarioAt(range, u, &a);
+		ScenarioAt(range, u + SCN_FIELDS, &b);
+
+		batch->A[n] = HiddenTime(a);
+		batch->B[n] = HiddenTime(b);
+		for (int i = 0; i < SCN_FIELDS; i++)
+		{
+			Scenario ab = a;
+			SetScenarioField(&ab, i, GetScenarioField(b, i));
+			batch->AB[i * samples + n] = HiddenTime(ab);
+		}
+	}
+}
+
+//Indices over the given rows, or over all of them in order if rows is NULL
+//Returns the variance
+static double Estimate( const SobolBatch &batch, const int *rows, float *first, float *total )
+{
+	int samples = batch.Samples;
+	double sum = 0., sum2 = 0.;
+	double s[SCN_FIELDS] = { 0. }, st[SCN_FIELDS] = { 0. };
+
+	for (int k = 0; k < samples; k++)
+	{
+		int n = rows != NULL ? rows[k] : k;
+		double fa = batch.A[n], fb = batch.B[n];
+		sum += fa + fb;
+		sum2 += fa * fa + fb * fb;
+		for (int i = 0; i < SCN_FIELDS; i++)
+		{
+			double fab = batch.AB[i * samples + n];
+			s[i] += fb * (fab - fa);
+			st[i] += (fa - fab) * (fa - fab);
+		}
+	}
+
+	double mean = sum / (2. * samples);
+	double var = sum2 / (2. * samples) - mean * mean;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		first[i] = var > 0. ? (float)(s[i] / samples / var) : 0.f;
+		total[i] = var > 0. ? (float)(st[i] / samples / (2. * var)) : 0.f;
+	}
+	return var;
+}
+
+static void Bootstrap( void *data, int begin, int end )
+{
+	SobolBatch *batch = (SobolBatch *)data;
+	std::vector<int> rows(batch->Samples);
+
+	for (int r = begin; r < end; r++)
+	{
+		unsigned int seed = 2654435761u * (unsigned int)(r + 1);
+		for (int k = 0; k < batch->Samples; k++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			rows[k] = (int)(((unsigned long long)(seed >> 8) * (unsigned int)batch->Samples) >> 24);
+		}
+		Estimate(*batch, &rows[0], &batch->First[r * SCN_FIELDS], &batch->Total[r * SCN_FIELDS]);
+	}
+}
+
+//Central SOBOL_CONFIDENCE interval of field i over the resamples
+static void Interval( const std::vector<float> &values, int resamples, int i, float *lo, float *hi )
+{
+	std::vector<float> column(resamples);
+	for (int r = 0; r < resamples; r++)
+		column[r] = values[r * SCN_FIELDS + i];
+	std::sort(column.begin(), column.end());
+
+	float tail = 0.5f * (1.f - SOBOL_CONFIDENCE) * (resamples - 1);
+	*lo = column[(int)floorf(tail)];
+	*hi = column[(int)ceilf(resamples - 1 - tail)];
+}
+
+
+bool SobolIndices( const SensitivityRange &range, int sampler, int samples, int resamples, SensitivityIndices *indices )
+{
+	if (samples < 2 || resamples < 1)
+	{
+		fprintf(stderr, "Sobol indices need at least 2 samples and 1 resample\n");
+		return false;
+	}
+
+	SobolBatch batch;
+	batch.Range = range;
+	batch.Samples = samples;
+	batch.Resamples = resamples;
+	if (!QmcInit(&batch.Sequence, sampler, SOBOL_DIMENSIONS, true, 0))
+		return false;
+	batch.A.resize(samples);
+	batch.B.resize(samples);
+	batch.AB.resize(SCN_FIELDS * samples);
+	ParallelFor(0, samples, SOBOL_GRAIN, EvaluateRows, &batch);
+
+	double mean = 0.;
+	for (int n = 0; n < samples; n++)
+		mean += batch.A[n] + batch.B[n];
+	indices->Mean = (float)(mean / (2. * samples));
+	indices->Variance = (float)Estimate(batch, NULL, indices->First, indices->Total);
+	indices->Evaluations = samples * (SCN_FIELDS + 2);
+	if (indices->Variance <= 0.f)
+	{
+		fprintf(stderr, "The hidden time is the same everywhere in the range\n");
+		return false;
+	}
+
+	batch.First.resize(resamples * SCN_FIELDS);
+	batch.Total.resize(resamples * SCN_FIELDS);
+	ParallelFor(0, resamples, 1, Bootstrap, &batch);
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		Interval(batch.First, resamples, i, &indices->FirstLo[i], &indices->FirstHi[i]);
+		Interval(batch.Total, resamples, i, &indices->TotalLo[i], &indices->TotalHi[i]);
+	}
+	return true;
+}
+
+//Mean hidden time over points of one sequence, for comparing samplers
+struct MeanBatch
+{
+	const SensitivityRange *	Range;
+	const QmcSequence *			Sequence;
+	std::vector<double>			Partial;
+};
+
+static void MeanChunk( void *data, int begin, int end )
+{
+	MeanBatch *batch = (MeanBatch *)data;
+	float points[SOBOL_GRAIN * SCN_FIELDS];
+	QmcGenerate(*batch->Sequence, begin, end - begin, points);
+
+	double sum = 0.;
+	for (int n = 0; n < end - begin; n++)
+	{
+		Scenario scn;
+		ScenarioAt(*batch->Range, &points[n * SCN_FIELDS], &scn);
+		sum += HiddenTime(scn);
+	}
+	batch->Partial[begin / SOBOL_GRAIN] = sum;
+}
+
+float MeanHiddenTime( const SensitivityRange &range, const QmcSequence &seq, int samples )
+{
+	if (seq.Dimensions != SCN_FIELDS || samples < 1)
+		return 0.f;
+
+	MeanBatch batch;
+	batch.Range = &range;
+	batch.Sequence = &seq;
+	batch.Partial.assign((samples + SOBOL_GRAIN - 1) / SOBOL_GRAIN, 0.);
+	ParallelFor(0, samples, SOBOL_GRAIN, MeanChunk, &batch);
+
+	double sum = 0.;
+	for (size_t i = 0; i < batch.Partial.size(); i++)
+		sum += batch.Partial[i];
+	return (float)(sum / samples);
+}
@@ -0,0 +1,55 @@
+/*******************************************************
+--------------------- Sensitivity ---------------------
+Variance based global sensitivity analysis of the hidden time.
+Every scenario field is drawn uniformly from its range and the
+Sobol indices say how much of the spread in hidden time each one
+explains: the first order index on its own, the total order index
+together with everything it interacts with.
+
+The estimates follow Saltelli: two quasi-random sample matrices A
+and B, and for every field a matrix AB_i that is A with column i
+taken from B, for samples * ( SCN_FIELDS + 2 ) evaluations in all.
+Confidence intervals come from bootstrapping the rows.
+*******************************************************/
+
+#ifndef SENSITIVITY_H
+#define SENSITIVITY_H
+
+#include "blindspot-model.h"
+#include "qmc.h"
+
+//Rows of each sample matrix, and bootstrap resamples for the intervals
+const int	SOBOL_DEFAULT_SAMPLES = 1 << 16;
+const int	SOBOL_DEFAULT_RESAMPLES = 200;
+const float	SOBOL_CONFIDENCE = 0.95f;
+
+//Range each field is drawn from; Lo == Hi holds a field still
+struct SensitivityRange
+{
+	float	Lo[SCN_FIELDS];
+	float	Hi[SCN_FIELDS];
+};
+
+//Indices by ScenarioField, each with its bootstrap confidence interval
+struct SensitivityIndices
+{
+	float	First[SCN_FIELDS];
+	float	FirstLo[SCN_FIELDS], FirstHi[SCN_FIELDS];
+	float	Total[SCN_FIELDS];
+	float	TotalLo[SCN_FIELDS], TotalHi[SCN_FIELDS];
+	float	Mean;				//of the hidden time, seconds
+	float	Variance;
+	int		Evaluations;
+};
+
+//The slider ranges, with the speeds kept off zero
+void	SensitivityRangeDefault( SensitivityRange * );
+
+//Rows are drawn from a scrambled sequence of QmcKind sampler
+//Returns false if the arguments make no sense or the hidden time never varies
+bool	SobolIndices( const SensitivityRange &, int sampler, int samples, int resamples, SensitivityIndices * );
+
+//Mean hidden time over the first samples points of a SCN_FIELDS dimensional sequence
+float	MeanHiddenTime( const SensitivityRange &, const QmcSequence &, int samples );
+
+#endif
@@ -0,0 +1,394 @@
+/*******************************************************
+------------------ Simulation Thread ------------------
+Triple buffer: the simulation owns one snapshot, the renderer
+owns another and the third sits in the middle. Publishing and
+reading each swap their own slot with the middle one in a single
+atomic exchange, with a flag saying the middle holds something
+the renderer has not seen.
+
+The simulation thread also owns the trajectory recorder, so
+recording steps are pushed from exactly one thread.
+
+Events are found step by step: each step is compared with the one
+before, so an event is stamped with the first step past it. A
+restart, seek or parameter change starts the comparison afresh
+rather than reporting the jump as an event.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#include "event-log.h"
+#include "sim-thread.h"
+#include "trajectory-recorder.h"
+
+//Set in the middle slot index when it holds an unread snapshot
+const int SNAPSHOT_FRESH = 4;
+
+//Triple buffer
+static SimSnapshot		Snapshots[3];
+static std::atomic<int>	MiddleSlot(1);
+static int				BackSlot = 0;		//simulation thread
+static int				FrontSlot = 2;		//renderer
+
+//Command queue, GUI -> simulation
+static SimCommand					Commands[SIM_QUEUE_SIZE];
+static std::atomic<unsigned int>	CommandHead(0);		//owned by the simulation
+static std::atomic<unsigned int>	CommandTail(0);		//owned by the GUI
+static int							CommandSequence;
+
+static std::thread			SimThread;
+static std::atomic<bool>	SimStop(false);
+
+//State below is only touched by the simulation thread
+struct SimState
+{
+	double	Time;
+	double	CarTravelled;
+	double	BikeTravelled;
+};
+
+//What the last step looked like, for finding events
+struct EventWatch
+{
+	bool	Hidden;
+	bool	Closing;			//separation was shrinking
+	float	CarDistance;
+	float	Separation;
+	float	Time;
+};
+
+static Scenario		Params;
+static SimState		SimPrev, SimCur;
+static double		SimAccumulator;		//simulated seconds owed to the next step
+static float		TimeScale;
+static bool			Playing;
+static bool			PlaybackOn;
+static unsigned int	Steps;
+static int			LastCommand;
+static unsigned int	Published;
+static EventWatch	Watch;
+static unsigned long long	Run;			//restarts so far, the Run of emitted events
+
+
+//Queue the state of this step for the trajectory recording
+static void RecordStep( )
+{
+	if (!RecorderIsRecording())
+		return;
+
+	TrajectoryRecord r;
+	r.Step = Steps;
+	r.Time = (float)SimCur.Time;
+	r.CarDistance = (float)(Params.CarStart - SimCur.CarTravelled);
+	r.BikeDistance = (float)(Params.BikeStart - SimCur.BikeTravelled);
+	r.AngleIntersection = Params.AngleIntersection;
+	r.LeadingAngle = Params.LeadingAngle;
+	r.TrailingAngle = Params.TrailingAngle;
+	r.ShadowLead = r.ShadowTrail = 0.f;
+	r.Flags = TRAJ_PLAYING;
+	if (ShadowEdges(Params.AngleIntersection, Params.LeadingAngle, Params.TrailingAngle, r.CarDistance, &r.ShadowLead, &r.ShadowTrail))
+		r.Flags |= TRAJ_SHADOW;
+	if (BikeInShadow(Params.AngleIntersection, Params.LeadingAngle, Params.TrailingAngle, r.CarDistance, r.BikeDistance))
+		r.Flags |= TRAJ_HIDDEN;
+	RecorderPush(r);
+}
+
+//Distance between the bike and the car, as RelativeMotion( ) places them
+static float Separation( float carDistance, float bikeDistance )
+{
+	float iAngle = Params.AngleIntersection * MODEL_DEG_TO_RAD;
+	float right = bikeDistance * sinf(iAngle);
+	float ahead = carDistance - bikeDistance * cosf(iAngle);
+	return sqrtf(right * right + ahead * ahead);
+}
+
+//Start comparing steps from the current one
+static void ResetWatch( )
+{
+	float carDistance = (float)(Params.CarStart - SimCur.CarTravelled);
+	float bikeDistance = (float)(Params.BikeStart - SimCur.BikeTravelled);
+
+	//A run that starts hidden gets its start event on the first step
+	Watch.Hidden = SimCur.Time > 0. &&
+				   BikeInShadow(Params.AngleIntersection, Params.LeadingAngle, Params.TrailingAngle, carDistance, bikeDistance);
+	Watch.Closing = false;
+	Watch.CarDistance = carDistance;
+	Watch.Separation = Separation(carDistance, bikeDistance);
+	Watch.Time = (float)SimCur.Time;
+}
+
+//Emit the events that happened between the last step and this one
+static void EmitStepEvents( )
+{
+	if (!EventLogIsOpen())
+		return;
+
+	float carDistance = (float)(Params.CarStart - SimCur.CarTravelled);
+	float bikeDistance = (float)(Params.BikeStart - SimCur.BikeTravelled);
+	bool hidden = BikeInShadow(Params.AngleIntersection, Params.LeadingAngle, Params.TrailingAngle, carDistance, bikeDistance);
+	float separation = Separation(carDistance, bikeDistance);
+
+	EventRecord e;
+	e.Run = Run;
+	e.Source = EVS_SIMULATION;
+	e.Time = (float)SimCur.Time;
+	e.Value = 0.f;
+	if (hidden != Watch.Hidden)
+	{
+		e.Type = hidden ? EV_HIDDEN_START : EV_HIDDEN_END;
+		EventEmit(e);
+	}
+	if (carDistance <= 0.f && Watch.CarDistance > 0.f)
+	{
+		e.Type = EV_CAR_AT_INTERSECTION;
+		EventEmit(e);
+	}
+	if (separation < COLLISION_DISTANCE && Watch.Separation >= COLLISION_DISTANCE)
+	{
+		e.Type = EV_COLLISION;
+		e.Value = separation;
+		EventEmit(e);
+	}
+
+	//The closest approach was the last step if the separation has started to grow
+	if (Watch.Closing && separation > Watch.Separation &&
+		Watch.Separation >= COLLISION_DISTANCE && Watch.Separation < EVENT_NEAR_MISS_DISTANCE)
+	{
+		e.Type = EV_NEAR_MISS;
+		e.Time = Watch.Time;
+		e.Value = Watch.Separation;
+		EventEmit(e);
+	}
+
+	Watch.Hidden = hidden;
+	Watch.Closing = separation < Watch.Separation;
+	Watch.CarDistance = carDistance;
+	Watch.Separation = separation;
+	Watch.Time = (float)SimCur.Time;
+}
+
+//Advance the simulation by one fixed step
+static void StepSimulation( )
+{
+	SimPrev = SimCur;
+	SimCur.Time += SIM_STEP;
+	Steps++;
+
+	//A recording replays its own distances, only the clock moves
+	if (PlaybackOn)
+		return;
+
+	//Distance += DeltaTime * Speed
+	SimCur.CarTravelled += SIM_STEP * Params.CarSpeed;
+	SimCur.BikeTravelled += SIM_STEP * Params.BikeSpeed;
+	RecordStep();
+	EmitStepEvents();
+}
+
+//Put the simulation at time t using the closed form solution
+static void SetTime( float t )
+{
+	ScenarioState state = StateAtTime(Params, t);
+	SimCur.Time = t;
+	SimCur.CarTravelled = Params.CarStart - state.CarDistance;
+	SimCur.BikeTravelled = Params.BikeStart - state.BikeDistance;
+	SimPrev = SimCur;
+	SimAccumulator = 0.;
+	ResetWatch();
+}
+
+static void SetParam( int param, float value )
+{
+	switch (param)
+	{
+	case SIM_AOI:		Params.AngleIntersection = value;	break;
+	case SIM_LA:		Params.LeadingAngle = value;		break;
+	case SIM_TA:		Params.TrailingAngle = value;		break;
+	case SIM_CSTART:	Params.CarStart = value;			break;
+	case SIM_CSPEED:	Params.CarSpeed = value;			break;
+	case SIM_BSTART:	Params.BikeStart = value;			break;
+	case SIM_BSPEED:	Params.BikeSpeed = value;			break;
+	default:
+		fprintf(stderr, "Don't know what to do with simulation parameter %d\n", param);
+	}
+	ResetWatch();
+}
+
+//Apply every command the GUI has queued
+static void ApplyCommands( )
+{
+	unsigned int head = CommandHead.load(std::memory_order_relaxed);
+	unsigned int tail = CommandTail.load(std::memory_order_acquire);
+	for (; head != tail; head++)
+	{
+		const SimCommand &c = Commands[head % SIM_QUEUE_SIZE];
+		switch (c.Type)
+		{
+		case SIM_PARAM:
+			SetParam(c.Param, c.Value);
+			break;
+		case SIM_TIME_SCALE:
+			TimeScale = c.Value;
+			break;
+		case SIM_PLAY:
+			Playing = true;
+			break;
+		case SIM_PAUSE:
+			Playing = false;
+			break;
+		case SIM_RESTART:
+			Playing = false;
+			Steps = 0;
+			Run++;
+			SetTime(0.f);
+			break;
+		case SIM_SEEK:
+			SetTime(c.Value);
+			break;
+		case SIM_RECORD_START:
+			RecorderStart(c.Path);
+			break;
+		case SIM_RECORD_STOP:
+			RecorderStop();
+			break;
+		case SIM_PLAYBACK:
+			PlaybackOn = c.Value != 0.f;
+			break;
+		default:
+			fprintf(stderr, "Don't know what to do with simulation command %d\n", c.Type);
+		}
+		LastCommand = c.Sequence;
+	}
+	CommandHead.store(head, std::memory_order_release);
+}
+
+//Fill the back snapshot and swap it into the middle
+static void Publish( )
+{
+	SimSnapshot &s = Snapshots[BackSlot];
+
+	//Show the scene part way between the last two steps
+	double alpha = SimAccumulator / SIM_STEP;
+	double carTravelled = SimPrev.CarTravelled + alpha * (SimCur.CarTravelled - SimPrev.CarTravelled);
+	double bikeTravelled = SimPrev.BikeTravelled + alpha * (SimCur.BikeTravelled - SimPrev.BikeTravelled);
+
+	s.Sequence = ++Published;
+	s.LastCommand = LastCommand;
+	s.Params = Params;
+	s.Time = (float)(SimPrev.Time + alpha * (SimCur.Time - SimPrev.Time));
+	s.CarTravelled = (float)carTravelled;
+	s.BikeTravelled = (float)bikeTravelled;
+	s.CarDistance = (float)(Params.CarStart - carTravelled);
+	s.BikeDistance = (float)(Params.BikeStart - bikeTravelled);
+	s.Steps = Steps;
+	s.Playing = Playing;
+	s.Recording = RecorderIsRecording();
+
+	BackSlot = MiddleSlot.exchange(BackSlot | SNAPSHOT_FRESH, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+}
+
+static void SimLoop( )
+{
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	while (!SimStop.load(std::memory_order_acquire))
+	{
+		ApplyCommands();
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double wall = std::chrono::duration<double>(now - last).count();
+		last = now;
+
+		if (Playing)
+		{
+			//Run as many whole steps as the scaled wall clock allows
+			SimAccumulator += wall * TimeScale;
+			int steps = 0;
+			while (SimAccumulator >= SIM_STEP && steps < SIM_MAX_STEPS)
+			{
+				StepSimulation();
+				SimAccumulator -= SIM_STEP;
+				steps++;
+			}
+			if (steps == SIM_MAX_STEPS)
+				SimAccumulator = 0.;
+		}
+
+		Publish();
+		std::this_thread::sleep_for(std::chrono::milliseconds(SIM_SLEEP_MS));
+	}
+
+	RecorderStop();
+}
+
+
+//Start the simulation thread paused at t = 0
+void SimThreadStart( const Scenario &scn, float timeScale )
+{
+	Params = scn;
+	TimeScale = timeScale;
+	Playing = PlaybackOn = false;
+	Steps = Published = 0;
+	Run = 0;
+	SetTime(0.f);
+
+	//Both the renderer's and the middle snapshot start out valid
+	Publish();
+	Snapshots[FrontSlot] = Snapshots[MiddleSlot.load() & ~SNAPSHOT_FRESH];
+
+#ifdef WIN32
+	//Let the 1 ms sleep between updates really be 1 ms
+	timeBeginPeriod(1);
+#endif
+	SimStop.store(false);
+	SimThread = std::thread(SimLoop);
+}
+
+void SimThreadStop( )
+{
+	if (!SimThread.joinable())
+		return;
+
+	SimStop.store(true, std::memory_order_release);
+	SimThread.join();
+#ifdef WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+//Queue a command for the simulation thread
+//Returns its sequence number, which SimSnapshot.LastCommand reaches once it has been applied
+int SimSend( int type, int param, float value, const char *path )
+{
+	unsigned int tail = CommandTail.load(std::memory_order_relaxed);
+
+	//The simulation drains the queue every SIM_SLEEP_MS, so a full queue is very short lived
+	while (tail - CommandHead.load(std::memory_order_acquire) >= (unsigned int)SIM_QUEUE_SIZE)
+		std::this_thread::yield();
+
+	SimCommand &c = Commands[tail % SIM_QUEUE_SIZE];
+	c.Sequence = ++CommandSequence;
+	c.Type = type;
+	c.Param = param;
+	c.Value = value;
+	c.Path = path;
+	CommandTail.store(tail + 1, std::memory_order_release);
+	return c.Sequence;
+}
+
+//Newest published snapshot, never waits on the simulation
+const SimSnapshot &SimLatest( )
+{
+	if (MiddleSlot.load(std::memory_order_relaxed) & SNAPSHOT_FRESH)
+		FrontSlot = MiddleSlot.exchange(FrontSlot, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+	return Snapshots[FrontSlot];
+}
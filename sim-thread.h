@@ -0,0 +1,84 @@
+/*******************************************************
+------------------ Simulation Thread ------------------
+The fixed step simulation runs on its own thread so a slow
+frame never changes what is simulated.
+
+The simulation publishes immutable snapshots through a lock-free
+triple buffer; the renderer always picks up the newest one and
+never waits. Changes made in the GUI travel the other way as
+commands on a single producer / single consumer queue.
+*******************************************************/
+
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include "blindspot-model.h"
+
+//Length of one simulation step, in seconds
+const double SIM_STEP = 1. / 240.;
+
+//Most steps taken in one update before the simulation gives up catching up
+const int SIM_MAX_STEPS = 1 << 18;
+
+//Commands that can be waiting for the simulation thread
+const int SIM_QUEUE_SIZE = 256;
+
+//How long the simulation thread sleeps between updates, in milliseconds
+const int SIM_SLEEP_MS = 1;
+
+enum SimCommandType
+{
+	SIM_PARAM,			//set Scenario field Param to Value
+	SIM_TIME_SCALE,		//simulated seconds per wall clock second
+	SIM_PLAY,
+	SIM_PAUSE,
+	SIM_RESTART,		//back to t = 0, paused
+	SIM_SEEK,			//jump to time Value
+	SIM_RECORD_START,	//start recording to Path
+	SIM_RECORD_STOP,
+	SIM_PLAYBACK		//Value != 0 means a recording drives the scene, only the clock runs
+};
+
+//Scenario fields for SIM_PARAM
+enum SimParam
+{
+	SIM_AOI,
+	SIM_LA,
+	SIM_TA,
+	SIM_CSTART,
+	SIM_CSPEED,
+	SIM_BSTART,
+	SIM_BSPEED
+};
+
+struct SimCommand
+{
+	int				Sequence;
+	int				Type;
+	int				Param;
+	float			Value;
+	const char *	Path;
+};
+
+//Everything the renderer needs from one moment of the simulation
+struct SimSnapshot
+{
+	unsigned int	Sequence;		//snapshots published so far
+	int				LastCommand;	//sequence number of the last command applied
+	Scenario		Params;			//values the simulation is using
+	float			Time;
+	float			CarDistance;
+	float			BikeDistance;
+	float			CarTravelled;
+	float			BikeTravelled;
+	unsigned int	Steps;			//fixed steps since the last restart
+	bool			Playing;
+	bool			Recording;
+};
+
+void				SimThreadStart( const Scenario &, float );
+void				SimThreadStop( );
+int					SimSend( int, int = 0, float = 0.f, const char * = 0 );
+const SimSnapshot &	SimLatest( );
+
+#endif
@@ -0,0 +1,211 @@
+/*******************************************************
+--------------------- Startup ---------------------
+Options are taken out of argv in place; what is left, GLUT's own
+options among it, is packed down for glutInit( ). GLUT's options
+that take a value keep it with them.
+
+Headless mode touches nothing but the model and the scenario file,
+so it answers in about the time it takes to read the file. The
+run is printed as Name=value pairs, one line for the scenario, one
+for the whole run and one for the moment asked about, so scripts
+can pick out what they need.
+*******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scenario-file.h"
+#include "startup.h"
+
+//GLUT's command line options that take a value
+const char * const GLUT_VALUE_OPTIONS[] = { "-display", "-geometry" };
+const int GLUT_VALUE_OPTION_COUNT = sizeof(GLUT_VALUE_OPTIONS) / sizeof(GLUT_VALUE_OPTIONS[0]);
+
+
+void StartupOptionsDefault( StartupOptions *options )
+{
+	options->ScenarioName = NULL;
+	options->ScenarioPath = SCENARIO_FILE;
+	options->Mode = MODE_GUI;
+	options->View = VIEW_CAR;
+	options->Play = false;
+	options->RunSeconds = -1.f;
+}
+
+void StartupUsage( )
+{
+	fprintf(stderr, "Usage: cyclist-collider [options] [scenario [file]]\n\n");
+	fprintf(stderr, "  --scenario <name>                   scenario to start from\n");
+	fprintf(stderr, "  --file <file>                       scenario file (default %s)\n", SCENARIO_FILE);
+	fprintf(stderr, "  --mode <gui|offscreen|headless>     window, offscreen drawing, or no OpenGL at all\n");
+	fprintf(stderr, "  --view <car|intersection>\n");
+	fprintf(stderr, "  --play                              start playing\n");
+	fprintf(stderr, "  --run <seconds>                     play for this many simulated seconds, print the run and quit\n");
+	fprintf(stderr, "  --help\n");
+}
+
+//Index of name in names, -1 if it is not there
+static int FindName( const char *name, const char * const *names, int count )
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+bool ParseStartupOptions( int *argc, char *argv[ ], StartupOptions *options )
+{
+	int kept = 1, positional = 0;
+	for (int arg = 1; arg < *argc; arg++)
+	{
+		const char *option = argv[arg];
+		if (strcmp(option, "--help") == 0)
+		{
+			StartupUsage();
+			return false;
+		}
+		if (strcmp(option, "--play") == 0)
+		{
+			options->Play = true;
+			continue;
+		}
+
+		if (strncmp(option, "--", 2) == 0)
+		{
+			if (arg + 1 >= *argc)
+			{
+				fprintf(stderr, "%s needs a value\n", option);
+				StartupUsage();
+				return false;
+			}
+			const char *value = argv[++arg];
+
+			if (strcmp(option, "--scenario") == 0)
+			{
+				options->ScenarioName = value;
+			}
+			else if (strcmp(option, "--file") == 0)
+			{
+				options->ScenarioPath = value;
+			}
+			else if (strcmp(option, "--mode") == 0)
+			{
+				options->Mode = FindName(value, STARTUP_MODE_NAMES, MODE_COUNT);
+				if (options->Mode < 0)
+				{
+					fprintf(stderr, "Unknown mode '%s'\n", value);
+					return false;
+				}
+			}
+			else if (strcmp(option, "--view") == 0)
+			{
+				options->View = FindName(value, STARTUP_VIEW_NAMES, VIEW_COUNT);
+				if (options->View < 0)
+				{
+					fprintf(stderr, "Unknown view '%s'\n", value);
+					return false;
+				}
+			}
+			else if (strcmp(option, "--run") == 0)
+			{
+				char *end;
+				options->RunSeconds = (float)strtod(value, &end);
+				if (end == value || *end != '\0' || options->RunSeconds < 0.f)
+				{
+					fprintf(stderr, "Expected seconds for --run, not '%s'\n", value);
+					return false;
+				}
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option '%s'\n", option);
+				StartupUsage();
+				return false;
+			}
+			continue;
+		}
+
+		//Left for glutInit( ), with its value if it has one
+		if (option[0] == '-')
+		{
+			argv[kept++] = argv[arg];
+			if (FindName(option, GLUT_VALUE_OPTIONS, GLUT_VALUE_OPTION_COUNT) >= 0 && arg + 1 < *argc)
+				argv[kept++] = argv[++arg];
+			continue;
+		}
+
+		//cyclist-collider [scenario [file]]
+		if (positional == 0)
+			options->ScenarioName = option;
+		else if (positional == 1)
+			options->ScenarioPath = option;
+		else
+		{
+			fprintf(stderr, "Unexpected argument '%s'\n", option);
+			StartupUsage();
+			return false;
+		}
+		positional++;
+	}
+
+	*argc = kept;
+	argv[kept] = NULL;
+	return true;
+}
+
+bool LoadStartupScenario( const StartupOptions &options, Scenario *scn )
+{
+	SweepSpec spec;
+	SweepSpecDefault(&spec);
+	if (options.ScenarioName != NULL)
+	{
+		ScenarioFile file;
+		if (!ScenarioFileOpen(options.ScenarioPath, &file))
+			return false;
+
+		int index = ScenarioFind(file, options.ScenarioName);
+		if (index >= 0)
+			spec = file.Entries[index].Spec;
+		ScenarioFileClose(&file);
+		if (index < 0)
+		{
+			fprintf(stderr, "No scenario '%s' in %s\n", options.ScenarioName, options.ScenarioPath);
+			return false;
+		}
+		if (SweepRows(spec) > 1)
+			fprintf(stderr, "Scenario '%s' is a grid of %llu runs; starting from the first\n", options.ScenarioName, SweepRows(spec));
+	}
+	SweepScenario(spec, 0, scn);
+	return true;
+}
+
+void PrintRun( FILE *fp, const Scenario &scn, float t )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+		fprintf(fp, "%s%s=%g", i > 0 ? " " : "", SCENARIO_NAMES[i], GetScenarioField(scn, i));
+	fprintf(fp, "\n");
+
+	TrajectoryMetrics m;
+	ComputeTrajectoryMetrics(scn, &m);
+	fprintf(fp, "Duration=%.4f HiddenTime=%.4f HiddenStart=%.4f HiddenEnd=%.4f MinSeparation=%.4f MinSeparationTime=%.4f Collision=%d\n",
+			m.Duration, m.HiddenTime, m.HiddenStart, m.HiddenEnd, m.MinSeparation, m.MinSeparationTime, m.Collision ? 1 : 0);
+
+	ScenarioState state = StateAtTime(scn, t);
+	bool hidden = BikeInShadow(scn.AngleIntersection, scn.LeadingAngle, scn.TrailingAngle, state.CarDistance, state.BikeDistance);
+	fprintf(fp, "Time=%.4f CarDistance=%.4f BikeDistance=%.4f Hidden=%d TimeToCollision=%.4f\n",
+			t, state.CarDistance, state.BikeDistance, hidden ? 1 : 0, TimeToCollision(scn, t));
+}
+
+int RunHeadless( const StartupOptions &options )
+{
+	Scenario scn;
+	if (!LoadStartupScenario(options, &scn))
+		return 1;
+
+	//Without a time, the moment the run ends
+	PrintRun(stdout, scn, options.RunSeconds >= 0.f ? options.RunSeconds : RunDuration(scn));
+	return 0;
+}
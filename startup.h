@@ -0,0 +1,78 @@
+/*******************************************************
+--------------------- Startup ---------------------
+Command line of the simulation, so a session can start straight
+into a scenario and scripts can drive it:
+
+	cyclist-collider [options] [scenario [file]]
+
+	--scenario <name>		scenario to start from ( also the first plain argument )
+	--file <file>			scenario file, scenarios.txt unless given ( also the second )
+	--mode <gui|offscreen|headless>
+		gui			the window and its control panel ( the default )
+		offscreen	no window on screen and no panel; frames are drawn
+					into an offscreen framebuffer as fast as they come
+		headless	no OpenGL at all: the run is worked out from the
+					model and printed, and the program ends
+	--view <car|intersection>
+	--play					start playing instead of paused
+	--run <seconds>			play for this many simulated seconds, print the
+							run and quit; headless, print the state at that time
+	--help
+
+Options GLUT knows ( -display, -geometry and so on ) are left for
+glutInit( ).
+*******************************************************/
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdio.h>
+
+#include "blindspot-model.h"
+
+enum StartupMode
+{
+	MODE_GUI,
+	MODE_OFFSCREEN,
+	MODE_HEADLESS,
+	MODE_COUNT
+};
+
+enum StartupView
+{
+	VIEW_CAR,				//ViewType 0
+	VIEW_INTERSECTION,		//ViewType 1
+	VIEW_COUNT
+};
+
+const char * const STARTUP_MODE_NAMES[MODE_COUNT] = { "gui", "offscreen", "headless" };
+const char * const STARTUP_VIEW_NAMES[VIEW_COUNT] = { "car", "intersection" };
+
+struct StartupOptions
+{
+	const char *	ScenarioName;		//NULL for the simulation's starting values
+	const char *	ScenarioPath;
+	int				Mode;
+	int				View;
+	bool			Play;
+	float			RunSeconds;			//< 0 to keep going until quit
+};
+
+//The window, the starting values, the car view, paused, no time limit
+void	StartupOptionsDefault( StartupOptions * );
+
+//Take the options out of argv, leaving what glutInit( ) needs
+//Returns false, having said why, if the program should not start
+bool	ParseStartupOptions( int *argc, char *argv[ ], StartupOptions * );
+void	StartupUsage( );
+
+//The scenario the options name, or the starting values if none; a grid starts from its first run
+bool	LoadStartupScenario( const StartupOptions &, Scenario * );
+
+//Scenario, metrics of its whole run and where things are at time t
+void	PrintRun( FILE *, const Scenario &, float t );
+
+//Headless mode: everything main( ) does, with no OpenGL; returns the exit code
+int		RunHeadless( const StartupOptions & );
+
+#endif
@@ -0,0 +1,639 @@
+/*******************************************************
+---------------------- Surrogate ----------------------
+The tree does not work on the seven fields directly. Scaling
+every distance, or every speed, by the same factor leaves the
+geometry of a run alone: the hidden time scales with the run's
+time and the closest approach with its distances. So a run comes
+down to five features, the three angles plus
+	arrival = ( Tb - Tc ) / ( Tb + Tc )		Tc, Tb the times to the intersection
+	speed = ( Vb - Vc ) / ( Vb + Vc )
+both in [ -1, 1 ], and the tree fits the hidden time over
+Tc + Tb and the closest approach over CarStart + BikeStart. Only
+RUN_MARGIN, which is fixed in seconds, breaks the scaling, and only
+for closest approaches at the very end of a run; the runs held
+back to check the tree are drawn over the real fields, so any
+error from that shows up in the uncertainty.
+
+The tree is built a level at a time. Every cell of a level is
+fitted in parallel: SURROGATE_CELL_SAMPLES quasi-random runs in the
+cell, a least squares linear fit to them, and if the worst error
+is more than SURROGATE_REFINE of the tolerance, a trial of halving
+the cell along each field in turn. The field whose halves fit best
+is the one the cell is split along.
+
+Fits are done in the cell's own coordinates, [ -1, 1 ] along each
+feature, and turned into feature units when stored.
+
+The scaled outputs are fitted to SURROGATE_TOLERANCE divided by the
+longest time and distance any run in the ranges has, so a cell that
+fits well enough scaled is also inside the tolerance once the
+prediction is scaled back up, wherever in the ranges the run is.
+That is why the default ranges are the realistic ones and not the
+sliders': a car creeping along at the slowest slider speed makes a
+run so long that no fit could be fine enough for it.
+*******************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "job-system.h"
+#include "qmc.h"
+#include "surrogate.h"
+
+//Cells fitted by one job
+const int SURROGATE_GRAIN = 8;
+
+//A cell is halved while its worst error is more than this share of the tolerance
+const float SURROGATE_REFINE = 0.5f;
+
+//Realistic ranges of the default build, by Scenario field; the angles take the whole slider range
+const float SURROGATE_DEFAULT_LO[SCN_FIELDS] = { 0.f, 0.f, 0.f, 20.f, 5.f, 5.f, 2.f };
+const float SURROGATE_DEFAULT_HI[SCN_FIELDS] = { 180.f, 45.f, 45.f, 200.f, 25.f, 100.f, 10.f };
+
+//Linear fit unknowns: a constant and one slope per feature
+const int FIT_TERMS = SUR_FEATURES + 1;
+
+//Seconds from start to intersection of the runs cells are fitted to, Tc + Tb
+const float SURROGATE_FIT_TIME = 10.f;
+
+//Ranges of the features
+const float FEATURE_LO[SUR_FEATURES] = { 0.f, 0.f, 0.f, -1.f, -1.f };
+const float FEATURE_HI[SUR_FEATURES] = { 180.f, 45.f, 45.f, 1.f, 1.f };
+
+//One cell waiting to be fitted
+struct SurrogateCell
+{
+	float	Lo[SUR_FEATURES];
+	float	Hi[SUR_FEATURES];
+	int		Node;
+	int		Depth;
+};
+
+//What fitting a cell decided
+struct CellFit
+{
+	SurrogateLeaf	Leaf;
+	int				SplitDim;		//-1 to keep the cell whole
+};
+
+struct LevelBatch
+{
+	const std::vector<SurrogateCell> *	Cells;
+	std::vector<CellFit>				Fits;
+	float								FitTolerance[SUR_OUTPUTS];	//SURROGATE_TOLERANCE over the longest run
+};
+
+//Normal equations of a linear fit to both outputs
+struct LinearFit
+{
+	double	A[FIT_TERMS][FIT_TERMS];
+	double	B[SUR_OUTPUTS][FIT_TERMS];
+	int		Count;
+};
+
+struct ValidationBatch
+{
+	const Surrogate *	Model;
+	QmcSequence			Sequence;
+	std::vector<float>	Errors;			//SUR_OUTPUTS per run
+	std::vector<float>	Ratios;			//error over the leaf's fitting error
+};
+
+
+void SurrogateRangeDefault( float *lo, float *hi )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		lo[i] = SURROGATE_DEFAULT_LO[i];
+		hi[i] = SURROGATE_DEFAULT_HI[i];
+	}
+}
+
+void SurrogateExact( const Scenario &scn, float *values )
+{
+	TrajectoryMetrics m;
+	ComputeTrajectoryMetrics(scn, &m);
+	values[SUR_HIDDEN_TIME] = m.HiddenTime;
+	values[SUR_MARGIN] = m.MinSeparation - COLLISION_DISTANCE;
+}
+
+//Features of a run, and the time and distance its outputs scale with
+static void Features( const Scenario &scn, float *x, float *time, float *distance )
+{
+	float tc = scn.CarSpeed > 0.f ? scn.CarStart / scn.CarSpeed : 0.f;
+	float tb = scn.BikeSpeed > 0.f ? scn.BikeStart / scn.BikeSpeed : 0.f;
+	float speeds = scn.BikeSpeed + scn.CarSpeed;
+
+	x[SF_AOI] = scn.AngleIntersection;
+	x[SF_LA] = scn.LeadingAngle;
+	x[SF_TA] = scn.TrailingAngle;
+	x[SF_ARRIVAL] = tc + tb > 0.f ? (tb - tc) / (tb + tc) : 0.f;
+	x[SF_SPEED] = speeds > 0.f ? (scn.BikeSpeed - scn.CarSpeed) / speeds : 0.f;
+	*time = tc + tb;
+	*distance = scn.CarStart + scn.BikeStart;
+}
+
+//Scaled outputs of the run with these features that takes SURROGATE_FIT_TIME
+static void ScaledExact( const float *x, float *values )
+{
+	Scenario scn;
+	scn.AngleIntersection = x[SF_AOI];
+	scn.LeadingAngle = x[SF_LA];
+	scn.TrailingAngle = x[SF_TA];
+	scn.CarSpeed = 1.f - x[SF_SPEED];
+	scn.BikeSpeed = 1.f + x[SF_SPEED];
+	scn.CarStart = scn.CarSpeed * 0.5f * SURROGATE_FIT_TIME * (1.f - x[SF_ARRIVAL]);
+	scn.BikeStart = scn.BikeSpeed * 0.5f * SURROGATE_FIT_TIME * (1.f + x[SF_ARRIVAL]);
+
+	TrajectoryMetrics m;
+	ComputeTrajectoryMetrics(scn, &m);
+	float distance = scn.CarStart + scn.BikeStart;
+	values[SUR_HIDDEN_TIME] = m.HiddenTime / SURROGATE_FIT_TIME;
+	values[SUR_MARGIN] = distance > 0.f ? m.MinSeparation / distance : 0.f;
+}
+
+static void FitClear( LinearFit *fit )
+{
+	memset(fit, 0, sizeof(*fit));
+}
+
+static void FitAdd( LinearFit *fit, const float *x, const float *y )
+{
+	double phi[FIT_TERMS];
+	phi[0] = 1.;
+	for (int i = 0; i < SUR_FEATURES; i++)
+		phi[i + 1] = x[i];
+	for (int j = 0; j < FIT_TERMS; j++)
+	{
+		for (int k = 0; k <= j; k++)
+			fit->A[j][k] += phi[j] * phi[k];
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+			fit->B[o][j] += phi[j] * y[o];
+	}
+	fit->Count++;
+}
+
+//Least squares coefficients by Cholesky, with a little ridge for cells too flat to pin a slope down
+static void FitSolve( const LinearFit &fit, double coeff[SUR_OUTPUTS][FIT_TERMS] )
+{
+	double l[FIT_TERMS][FIT_TERMS];
+	for (int j = 0; j < FIT_TERMS; j++)
+	{
+		double d = fit.A[j][j] + 1e-6 * (fit.Count + 1);
+		for (int k = 0; k < j; k++)
+			d -= l[j][k] * l[j][k];
+		d = sqrt(d > 1e-12 ? d : 1e-12);
+		l[j][j] = d;
+		for (int i = j + 1; i < FIT_TERMS; i++)
+		{
+			double s = fit.A[i][j];
+			for (int k = 0; k < j; k++)
+				s -= l[i][k] * l[j][k];
+			l[i][j] = s / d;
+		}
+	}
+
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+	{
+		double y[FIT_TERMS];
+		for (int i = 0; i < FIT_TERMS; i++)
+		{
+			double s = fit.B[o][i];
+			for (int k = 0; k < i; k++)
+				s -= l[i][k] * y[k];
+			y[i] = s / l[i][i];
+		}
+		for (int i = FIT_TERMS - 1; i >= 0; i--)
+		{
+			double s = y[i];
+			for (int k = i + 1; k < FIT_TERMS; k++)
+				s -= l[k][i] * y[k];
+			y[i] = s / l[i][i];
+		}
+		for (int i = 0; i < FIT_TERMS; i++)
+			coeff[o][i] = y[i];
+	}
+}
+
+static double FitValue( const double *coeff, const float *x )
+{
+	double v = coeff[0];
+	for (int i = 0; i < SUR_FEATURES; i++)
+		v += coeff[i + 1] * x[i];
+	return v;
+}
+
+//Worst error of the fit over the runs whose x[ dim ] is on the given side of 0, in tolerances
+//dim < 0 takes every run
+static float FitWorst( const double coeff[SUR_OUTPUTS][FIT_TERMS], const float *x, const float *y, int dim, bool upper,
+					  const float *tolerance, float *worst )
+{
+	float score = 0.f;
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+		worst[o] = 0.f;
+	for (int n = 0; n < SURROGATE_CELL_SAMPLES; n++)
+	{
+		const float *xn = x + n * SUR_FEATURES;
+		if (dim >= 0 && (xn[dim] >= 0.f) != upper)
+			continue;
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+		{
+			float e = fabsf((float)FitValue(coeff[o], xn) - y[n * SUR_OUTPUTS + o]);
+			if (e > worst[o])
+				worst[o] = e;
+			if (e / tolerance[o] > score)
+				score = e / tolerance[o];
+		}
+	}
+	return score;
+}
+
+static void FitCells( void *data, int begin, int end )
+{
+	LevelBatch *batch = (LevelBatch *)data;
+	float u[SURROGATE_CELL_SAMPLES * SUR_FEATURES];
+	float x[SURROGATE_CELL_SAMPLES * SUR_FEATURES];
+	float y[SURROGATE_CELL_SAMPLES * SUR_OUTPUTS];
+
+	for (int c = begin; c < end; c++)
+	{
+		const SurrogateCell &cell = (*batch->Cells)[c];
+		CellFit &result = batch->Fits[c];
+
+		QmcSequence seq;
+		QmcInit(&seq, QMC_SOBOL, SUR_FEATURES, true, (unsigned int)cell.Node);
+		QmcGenerate(seq, 0, SURROGATE_CELL_SAMPLES, u);
+
+		LinearFit fit;
+		FitClear(&fit);
+		for (int n = 0; n < SURROGATE_CELL_SAMPLES; n++)
+		{
+			float features[SUR_FEATURES];
+			for (int i = 0; i < SUR_FEATURES; i++)
+			{
+				x[n * SUR_FEATURES + i] = 2.f * u[n * SUR_FEATURES + i] - 1.f;
+				features[i] = cell.Lo[i] + u[n * SUR_FEATURES + i] * (cell.Hi[i] - cell.Lo[i]);
+			}
+			ScaledExact(features, &y[n * SUR_OUTPUTS]);
+			FitAdd(&fit, &x[n * SUR_FEATURES], &y[n * SUR_OUTPUTS]);
+		}
+
+		double coeff[SUR_OUTPUTS][FIT_TERMS];
+		FitSolve(fit, coeff);
+		float score = FitWorst(coeff, x, y, -1, false, batch->FitTolerance, result.Leaf.Error);
+
+		//Feature units: x_i = ( feature - mid ) / half
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+		{
+			double c0 = coeff[o][0];
+			for (int i = 0; i < SUR_FEATURES; i++)
+			{
+				double half = 0.5 * (cell.Hi[i] - cell.Lo[i]);
+				double mid = 0.5 * (cell.Hi[i] + cell.Lo[i]);
+				double slope = half > 0. ? coeff[o][i + 1] / half : 0.;
+				result.Leaf.Coeff[o][i + 1] = (float)slope;
+				c0 -= slope * mid;
+			}
+			result.Leaf.Coeff[o][0] = (float)c0;
+		}
+
+		//Try halving along each feature and keep the best
+		result.SplitDim = -1;
+		if (score <= SURROGATE_REFINE || cell.Depth >= SURROGATE_MAX_DEPTH)
+			continue;
+		float best = score;
+		for (int d = 0; d < SUR_FEATURES; d++)
+		{
+			if (!(cell.Hi[d] > cell.Lo[d]))
+				continue;
+			float trial = 0.f;
+			for (int side = 0; side < 2; side++)
+			{
+				LinearFit half;
+				FitClear(&half);
+				for (int n = 0; n < SURROGATE_CELL_SAMPLES; n++)
+				{
+					if ((x[n * SUR_FEATURES + d] >= 0.f) == (side != 0))
+						FitAdd(&half, &x[n * SUR_FEATURES], &y[n * SUR_OUTPUTS]);
+				}
+				double halfCoeff[SUR_OUTPUTS][FIT_TERMS];
+				FitSolve(half, halfCoeff);
+				float worst[SUR_OUTPUTS];
+				float s = FitWorst(halfCoeff, x, y, d, side != 0, batch->FitTolerance, worst);
+				if (s > trial)
+					trial = s;
+			}
+			if (result.SplitDim < 0 || trial < best)
+			{
+				best = trial;
+				result.SplitDim = d;
+			}
+		}
+	}
+}
+
+//Leaf the scenario falls in, or -1 outside the fitted ranges
+static int FindLeaf( const Surrogate &model, const Scenario &scn, float *x, float *time, float *distance )
+{
+	const SurrogateHeader &h = model.Header;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		float v = GetScenarioField(scn, i);
+		if (v < h.Lo[i] || v > h.Hi[i])
+			return -1;
+	}
+	Features(scn, x, time, distance);
+
+	const SurrogateNode *node = &model.Nodes[0];
+	while (node->Dim >= 0)
+		node = &model.Nodes[node->Child + (x[node->Dim] >= node->Split ? 1 : 0)];
+	return node->Child;
+}
+
+static void PredictWith( const Surrogate &, const Scenario &, const float *, SurrogatePrediction * );
+
+static void ValidateChunk( void *data, int begin, int end )
+{
+	ValidationBatch *batch = (ValidationBatch *)data;
+	const Surrogate &model = *batch->Model;
+	const SurrogateHeader &h = model.Header;
+	std::vector<float> u((end - begin) * SCN_FIELDS);
+	QmcGenerate(batch->Sequence, begin, end - begin, &u[0]);
+	const float unscaled[SUR_OUTPUTS] = { 1.f, 1.f };
+
+	for (int n = begin; n < end; n++)
+	{
+		Scenario scn;
+		for (int i = 0; i < SCN_FIELDS; i++)
+			SetScenarioField(&scn, i, h.Lo[i] + u[(n - begin) * SCN_FIELDS + i] * (h.Hi[i] - h.Lo[i]));
+
+		//Coverage 1 makes the uncertainty the leaf's own fitting error, scaled
+		SurrogatePrediction p;
+		float exact[SUR_OUTPUTS];
+		PredictWith(model, scn, unscaled, &p);
+		SurrogateExact(scn, exact);
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+		{
+			float e = fabsf(p.Value[o] - exact[o]);
+			float floor = 1e-3f * SURROGATE_TOLERANCE[o];
+			batch->Errors[n * SUR_OUTPUTS + o] = e;
+			batch->Ratios[n * SUR_OUTPUTS + o] = e / (p.Uncertainty[o] > floor ? p.Uncertainty[o] : floor);
+		}
+	}
+}
+
+
+bool SurrogateBuild( const char *path, const float *lo, const float *hi, int leaves )
+{
+	if (leaves < 1)
+	{
+		fprintf(stderr, "A surrogate needs at least one cell\n");
+		return false;
+	}
+	if (!(lo[SCN_CSPEED] > 0.f && lo[SCN_BSPEED] > 0.f))
+	{
+		fprintf(stderr, "A surrogate needs CarSpeed and BikeSpeed kept above 0\n");
+		return false;
+	}
+
+	//The predictions are the scaled fits times the run's time or distance, at most these
+	float longest[SUR_OUTPUTS];
+	longest[SUR_HIDDEN_TIME] = hi[SCN_CSTART] / lo[SCN_CSPEED] + hi[SCN_BSTART] / lo[SCN_BSPEED];
+	longest[SUR_MARGIN] = hi[SCN_CSTART] + hi[SCN_BSTART];
+
+	Surrogate model;
+	SurrogateHeader &h = model.Header;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.Magic, SURROGATE_MAGIC, sizeof(h.Magic));
+	h.Version = SURROGATE_VERSION;
+	h.Outputs = SUR_OUTPUTS;
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		h.Lo[i] = lo[i];
+		h.Hi[i] = hi[i];
+	}
+
+	//The angle features only need to cover the angle ranges
+	std::vector<SurrogateCell> level(1);
+	memcpy(level[0].Lo, FEATURE_LO, sizeof(level[0].Lo));
+	memcpy(level[0].Hi, FEATURE_HI, sizeof(level[0].Hi));
+	for (int i = SF_AOI; i <= SF_TA; i++)
+	{
+		level[0].Lo[i] = lo[SCN_AOI + i - SF_AOI];
+		level[0].Hi[i] = hi[SCN_AOI + i - SF_AOI];
+	}
+	level[0].Node = 0;
+	level[0].Depth = 0;
+	SurrogateNode root = { -1, 0.f, -1 };
+	model.Nodes.push_back(root);
+
+	//Cells that will end up leaves if nothing more is split
+	int pending = 1;
+	while (!level.empty())
+	{
+		LevelBatch batch;
+		batch.Cells = &level;
+		batch.Fits.resize(level.size());
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+			batch.FitTolerance[o] = SURROGATE_TOLERANCE[o] / (longest[o] > 1.f ? longest[o] : 1.f);
+		ParallelFor(0, (int)level.size(), SURROGATE_GRAIN, FitCells, &batch);
+
+		std::vector<SurrogateCell> next;
+		for (size_t c = 0; c < level.size(); c++)
+		{
+			const SurrogateCell &cell = level[c];
+			const CellFit &fit = batch.Fits[c];
+			SurrogateNode &node = model.Nodes[cell.Node];
+			if (fit.SplitDim >= 0 && pending < leaves)
+			{
+				int d = fit.SplitDim;
+				node.Dim = d;
+				node.Split = 0.5f * (cell.Lo[d] + cell.Hi[d]);
+				node.Child = (int)model.Nodes.size();
+				pending++;
+				for (int side = 0; side < 2; side++)
+				{
+					SurrogateCell child = cell;
+					if (side == 0)
+						child.Hi[d] = node.Split;
+					else
+						child.Lo[d] = node.Split;
+					child.Node = node.Child + side;
+					child.Depth = cell.Depth + 1;
+					next.push_back(child);
+				}
+				SurrogateNode leaf = { -1, 0.f, -1 };
+				model.Nodes.push_back(leaf);
+				model.Nodes.push_back(leaf);
+			}
+			else
+			{
+				node.Dim = -1;
+				node.Child = (int)model.Leaves.size();
+				model.Leaves.push_back(fit.Leaf);
+			}
+		}
+		level.swap(next);
+		fprintf(stderr, "\r%d cells", pending);
+	}
+	fprintf(stderr, "\n");
+	h.Nodes = (unsigned int)model.Nodes.size();
+	h.Leaves = (unsigned int)model.Leaves.size();
+
+	//Held back runs from another scramble: error statistics and the coverage scale
+	int held = SURROGATE_VALIDATION_SAMPLES;
+	ValidationBatch check;
+	check.Model = &model;
+	QmcInit(&check.Sequence, QMC_SOBOL, SCN_FIELDS, true, 0xffffffffu);
+	check.Errors.resize((size_t)held * SUR_OUTPUTS);
+	check.Ratios.resize((size_t)held * SUR_OUTPUTS);
+	ParallelFor(0, held, 1024, ValidateChunk, &check);
+
+	std::vector<float> ratio(held);
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+	{
+		double sum2 = 0.;
+		float worst = 0.f;
+		for (int n = 0; n < held; n++)
+		{
+			float e = check.Errors[n * SUR_OUTPUTS + o];
+			sum2 += (double)e * e;
+			if (e > worst)
+				worst = e;
+			ratio[n] = check.Ratios[n * SUR_OUTPUTS + o];
+		}
+		h.RmsError[o] = (float)sqrt(sum2 / held);
+		h.MaxError[o] = worst;
+
+		//Never shrink a leaf's own fitting error
+		int k = (int)ceilf(SURROGATE_COVERAGE * (held - 1));
+		std::nth_element(ratio.begin(), ratio.begin() + k, ratio.end());
+		h.Coverage[o] = ratio[k] > 1.f ? ratio[k] : 1.f;
+	}
+
+	//Share the default tolerances would send to the exact model
+	int over = 0;
+	for (int n = 0; n < held; n++)
+	{
+		Scenario scn;
+		float u[SCN_FIELDS];
+		QmcGenerate(check.Sequence, n, 1, u);
+		for (int i = 0; i < SCN_FIELDS; i++)
+			SetScenarioField(&scn, i, lo[i] + u[i] * (hi[i] - lo[i]));
+		SurrogatePrediction p;
+		SurrogatePredict(model, scn, &p);
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+		{
+			if (p.Uncertainty[o] > SURROGATE_TOLERANCE[o])
+			{
+				over++;
+				break;
+			}
+		}
+	}
+	h.Fallback = (float)over / held;
+
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Unable to write surrogate '%s'\n", path);
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+			  fwrite(&model.Nodes[0], sizeof(SurrogateNode), h.Nodes, fp) == h.Nodes &&
+			  fwrite(&model.Leaves[0], sizeof(SurrogateLeaf), h.Leaves, fp) == h.Leaves;
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "Error writing surrogate '%s'\n", path);
+	return ok;
+}
+
+bool SurrogateLoad( const char *path, Surrogate *model )
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Unable to open surrogate '%s'\n", path);
+		return false;
+	}
+
+	SurrogateHeader &h = model->Header;
+	bool ok = fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.Magic, SURROGATE_MAGIC, sizeof(h.Magic)) == 0 &&
+			  h.Version == SURROGATE_VERSION && h.Outputs == SUR_OUTPUTS && h.Nodes > 0 && h.Leaves > 0;
+	if (ok)
+	{
+		model->Nodes.resize(h.Nodes);
+		model->Leaves.resize(h.Leaves);
+		ok = fread(&model->Nodes[0], sizeof(SurrogateNode), h.Nodes, fp) == h.Nodes &&
+			 fread(&model->Leaves[0], sizeof(SurrogateLeaf), h.Leaves, fp) == h.Leaves;
+	}
+	fclose(fp);
+
+	//Every link has to stay inside the file
+	for (unsigned int n = 0; ok && n < h.Nodes; n++)
+	{
+		const SurrogateNode &node = model->Nodes[n];
+		if (node.Dim < 0)
+			ok = node.Child >= 0 && (unsigned int)node.Child < h.Leaves;
+		else
+			ok = node.Dim < SUR_FEATURES && node.Child > (int)n && (unsigned int)node.Child + 1 < h.Nodes;
+	}
+
+	if (!ok)
+		fprintf(stderr, "'%s' is not a complete version %u surrogate\n", path, SURROGATE_VERSION);
+	return ok;
+}
+
+//Prediction with the given scale from fitting error to uncertainty
+static void PredictWith( const Surrogate &model, const Scenario &scn, const float *coverage, SurrogatePrediction *p )
+{
+	float x[SUR_FEATURES], time, distance;
+	int leaf = FindLeaf(model, scn, x, &time, &distance);
+	p->Exact = false;
+	if (leaf < 0)
+	{
+		for (int o = 0; o < SUR_OUTPUTS; o++)
+		{
+			p->Value[o] = 0.f;
+			p->Uncertainty[o] = HUGE_VALF;
+		}
+		return;
+	}
+
+	const SurrogateLeaf &l = model.Leaves[leaf];
+	const float scale[SUR_OUTPUTS] = { time, distance };
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+	{
+		float v = l.Coeff[o][0];
+		for (int i = 0; i < SUR_FEATURES; i++)
+			v += l.Coeff[o][i + 1] * x[i];
+		p->Value[o] = scale[o] * v;
+		p->Uncertainty[o] = scale[o] * coverage[o] * l.Error[o];
+	}
+	p->Value[SUR_MARGIN] -= COLLISION_DISTANCE;
+}
+
+void SurrogatePredict( const Surrogate &model, const Scenario &scn, SurrogatePrediction *p )
+{
+	PredictWith(model, scn, model.Header.Coverage, p);
+}
+
+bool SurrogateEval( const Surrogate &model, const Scenario &scn, const float *tolerance, SurrogatePrediction *p )
+{
+	SurrogatePredict(model, scn, p);
+	for (int o = 0; o < SUR_OUTPUTS; o++)
+	{
+		if (p->Uncertainty[o] > tolerance[o])
+		{
+			SurrogateExact(scn, p->Value);
+			for (int k = 0; k < SUR_OUTPUTS; k++)
+				p->Uncertainty[k] = 0.f;
+			p->Exact = true;
+			break;
+		}
+	}
+	return p->Exact;
+}
@@ -0,0 +1,129 @@
+/*******************************************************
+---------------------- Surrogate ----------------------
+A fast stand-in for the model behind the risk meter, fitted
+offline to runs of the exact model over realistic ranges. It
+predicts the hidden time and the collision margin by walking a
+k-d tree of cells down to one linear function, which takes the
+same few hundred nanoseconds however costly the model it was
+fitted to.
+
+Cells are halved wherever a linear fit is not good enough, so the
+tree is fine around the places the outputs bend (the bike slipping
+into the shadow, closest approach at the ends of a run) and coarse
+elsewhere. Every cell carries the worst error its fit made, scaled
+on held back runs so that 95% of errors fall inside it. That is the
+uncertainty of a prediction; where it is more than the caller will
+accept, or the scenario is outside the fitted ranges, the exact
+model is run instead.
+*******************************************************/
+
+#ifndef SURROGATE_H
+#define SURROGATE_H
+
+#include <vector>
+
+#include "blindspot-model.h"
+
+//File layout: one SurrogateHeader, then Nodes SurrogateNodes and Leaves SurrogateLeafs
+const char SURROGATE_MAGIC[8] = { 'C', 'C', 'V', 'S', 'U', 'R', 'R', '1' };
+const unsigned int SURROGATE_VERSION = 1;
+
+//Largest tree the default build makes, and how deep it may go
+const int SURROGATE_DEFAULT_LEAVES = 1 << 16;
+const int SURROGATE_MAX_DEPTH = 28;
+
+//Runs of the exact model fitted in each cell, and runs held back to scale the uncertainty
+const int SURROGATE_CELL_SAMPLES = 128;
+const int SURROGATE_VALIDATION_SAMPLES = 1 << 15;
+
+//Share of the held back errors the scaled uncertainty covers
+const float SURROGATE_COVERAGE = 0.95f;
+
+enum SurrogateOutput
+{
+	SUR_HIDDEN_TIME,		//seconds
+	SUR_MARGIN,				//MinSeparation - COLLISION_DISTANCE, meters; below 0 is a collision
+	SUR_OUTPUTS
+};
+
+//What the tree splits on: the three angles, and how the run's timing and speeds
+//are shared between car and bike, each from -1 ( all car ) to 1 ( all bike )
+enum SurrogateFeature
+{
+	SF_AOI,
+	SF_LA,
+	SF_TA,
+	SF_ARRIVAL,
+	SF_SPEED,
+	SUR_FEATURES
+};
+
+//Largest uncertainty taken from the surrogate before the exact model is run, by SurrogateOutput
+//Building halves cells until their fits are well inside these
+const float SURROGATE_TOLERANCE[SUR_OUTPUTS] = { 0.25f, 0.5f };
+
+struct SurrogateHeader
+{
+	char			Magic[8];
+	unsigned int	Version;
+	unsigned int	Outputs;				//SUR_OUTPUTS
+	unsigned int	Nodes;
+	unsigned int	Leaves;
+	float			Lo[SCN_FIELDS];			//field ranges the tree covers
+	float			Hi[SCN_FIELDS];
+	float			Coverage[SUR_OUTPUTS];	//scale from a leaf's worst fitting error to the uncertainty
+	float			RmsError[SUR_OUTPUTS];	//of the held back runs
+	float			MaxError[SUR_OUTPUTS];
+	float			Fallback;				//share of held back runs over SURROGATE_TOLERANCE
+};
+
+//Dim < 0 is a leaf, SurrogateLeaf number Child
+//Otherwise Child is below Split along feature Dim and Child + 1 at or above it
+struct SurrogateNode
+{
+	int		Dim;
+	float	Split;
+	int		Child;
+};
+
+//Output o, over the run's time or distance, is Coeff[ o ][ 0 ] + sum of Coeff[ o ][ 1 + i ] * feature i
+struct SurrogateLeaf
+{
+	float	Coeff[SUR_OUTPUTS][SUR_FEATURES + 1];
+	float	Error[SUR_OUTPUTS];			//worst error of the fit in the cell, in the same units
+};
+
+struct Surrogate
+{
+	SurrogateHeader				Header;
+	std::vector<SurrogateNode>	Nodes;
+	std::vector<SurrogateLeaf>	Leaves;
+};
+
+struct SurrogatePrediction
+{
+	float	Value[SUR_OUTPUTS];
+	float	Uncertainty[SUR_OUTPUTS];		//0 when Exact
+	bool	Exact;							//the exact model was run
+};
+
+//Realistic ranges: the whole angle sliders, CarStart 20-200 m, CarSpeed 5-25 m/s,
+//BikeStart 5-100 m and BikeSpeed 2-10 m/s
+void	SurrogateRangeDefault( float *lo, float *hi );
+
+//Fit a tree of at most leaves cells over the ranges and write it to path
+bool	SurrogateBuild( const char *, const float *lo, const float *hi, int leaves );
+
+bool	SurrogateLoad( const char *, Surrogate * );
+
+//Prediction alone; uncertainty is infinite outside the fitted ranges
+void	SurrogatePredict( const Surrogate &, const Scenario &, SurrogatePrediction * );
+
+//Prediction, or the exact values if any uncertainty is over its tolerance
+//tolerance is indexed by SurrogateOutput; returns true if the exact model was run
+bool	SurrogateEval( const Surrogate &, const Scenario &, const float *tolerance, SurrogatePrediction * );
+
+//The exact values, for fitting and falling back to
+void	SurrogateExact( const Scenario &, float * );
+
+#endif
@@ -0,0 +1,398 @@
+/*******************************************************
+--------------------- Sweep ---------------------
+Rows are evaluated a chunk at a time on the job system and handed
+to the result writer, which encodes and writes them while the
+memory held stays at a few chunks however large the grid is.
+
+A checkpoint is only taken between whole chunks, once the result
+file has been synced, so the chunks it counts are on disk. It is
+written to <file>.ckpt.tmp, synced, then renamed over <file>.ckpt;
+a process killed at any point leaves either the old checkpoint or
+the new one, never half of one. Resuming cuts the result file back
+to the checkpoint's length and evaluates the rows after it, which
+are the same rows in the same chunks, and the summary totals are
+added up in row order whatever the number of threads, so nothing
+differs from a run that was never stopped.
+
+Shards split the chunks, not the rows, so every chunk a shard
+writes is exactly a chunk of the unsplit sweep and merging is a
+copy. The .done manifest is written the same way as a checkpoint,
+after the shard's result file is closed, so a manifest always means
+a whole shard.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "event-log.h"
+#include "job-system.h"
+#include "result-store.h"
+#include "sweep.h"
+
+//Rows evaluated by one job
+const int SWEEP_GRAIN = 1024;
+
+//Starting slider values of the simulation
+const float SWEEP_DEFAULTS[SCN_FIELDS] = { 69.f, 19.4f, 27.1f, 100.f, 18.f, 39.f, 7.f };
+
+const char SWEEP_CHECKPOINT_MAGIC[8] = { 'C', 'C', 'V', 'C', 'K', 'P', 'T', '2' };
+const char SWEEP_MANIFEST_MAGIC[8] = { 'C', 'C', 'V', 'S', 'H', 'R', 'D', '1' };
+
+//Checkpoint file: this, then Chunks 64 bit offsets of the result file's chunks
+struct SweepCheckpoint
+{
+	char				Magic[8];
+	SweepSpec			Spec;
+	unsigned long long	FirstRow, EndRow;	//of the shard
+	SweepSummary		Summary;			//Summary.Rows rows from FirstRow are done
+	unsigned long long	Offset;				//bytes of the result file they fill
+	unsigned long long	Chunks;
+};
+
+//What a finished shard wrote
+struct SweepManifest
+{
+	char				Magic[8];
+	SweepSpec			Spec;
+	int					Shard, Shards;
+	unsigned long long	FirstRow, EndRow;
+	SweepSummary		Summary;
+};
+
+struct SweepBatch
+{
+	const SweepSpec *		Spec;
+	unsigned long long		First;
+	std::vector<ResultRow>	Rows;
+	std::vector<SweepSummary>	Partial;	//one per job
+};
+
+
+void SweepSpecDefault( SweepSpec *spec )
+{
+	memset(spec, 0, sizeof(*spec));
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		spec->Lo[i] = spec->Hi[i] = SWEEP_DEFAULTS[i];
+		spec->Steps[i] = 1;
+	}
+}
+
+void SweepOptionsDefault( SweepOptions *options )
+{
+	options->Shard = 0;
+	options->Shards = 1;
+	options->CheckpointSeconds = SWEEP_CHECKPOINT_SECONDS;
+	options->Resume = false;
+}
+
+unsigned long long SweepRows( const SweepSpec &spec )
+{
+	unsigned long long rows = 1;
+	for (int i = 0; i < SCN_FIELDS; i++)
+		rows *= (unsigned long long)spec.Steps[i];
+	return rows;
+}
+
+void SweepScenario( const SweepSpec &spec, unsigned long long row, Scenario *scn )
+{
+	for (int i = SCN_FIELDS - 1; i >= 0; i--)
+	{
+		int steps = spec.Steps[i];
+		int k = (int)(row % (unsigned long long)steps);
+		row /= (unsigned long long)steps;
+		float t = steps > 1 ? (float)k / (float)(steps - 1) : 0.f;
+		SetScenarioField(scn, i, spec.Lo[i] + t * (spec.Hi[i] - spec.Lo[i]));
+	}
+}
+
+void SweepShardRows( const SweepSpec &spec, int shard, int shards, unsigned long long *first, unsigned long long *end )
+{
+	unsigned long long rows = SweepRows(spec);
+	unsigned long long chunks = (rows + RESULT_CHUNK_ROWS - 1) / RESULT_CHUNK_ROWS;
+	*first = chunks * shard / shards * RESULT_CHUNK_ROWS;
+	*end = chunks * (shard + 1) / shards * RESULT_CHUNK_ROWS;
+	*first = *first < rows ? *first : rows;
+	*end = *end < rows ? *end : rows;
+}
+
+std::string SweepOutputPath( const char *path, const SweepOptions &options )
+{
+	if (options.Shards <= 1)
+		return path;
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".shard-%d-of-%d", options.Shard, options.Shards);
+	return std::string(path) + suffix;
+}
+
+static void AddSummary( SweepSummary *total, const SweepSummary &part )
+{
+	total->Rows += part.Rows;
+	total->Collisions += part.Collisions;
+	total->HiddenSum += part.HiddenSum;
+	if (part.HiddenMax > total->HiddenMax)
+		total->HiddenMax = part.HiddenMax;
+}
+
+static void EvaluateRows( void *data, int begin, int end )
+{
+	SweepBatch *batch = (SweepBatch *)data;
+	SweepSummary sum = { 0, 0, 0., 0.f };
+	for (int i = begin; i < end; i++)
+	{
+		Scenario scn;
+		SweepScenario(*batch->Spec, batch->First + i, &scn);
+		TrajectoryMetrics m;
+		ComputeTrajectoryMetrics(scn, &m);
+		ResultRowOf(scn, m, &batch->Rows[i]);
+		EmitRunEvents(batch->First + i, EVS_SWEEP, scn, m);
+
+		sum.Rows++;
+		sum.Collisions += m.Collision ? 1 : 0;
+		sum.HiddenSum += m.HiddenTime;
+		if (m.HiddenTime > sum.HiddenMax)
+			sum.HiddenMax = m.HiddenTime;
+	}
+	batch->Partial[begin / SWEEP_GRAIN] = sum;
+}
+
+//Rename from over to, replacing it if it exists
+static bool MoveOver( const std::string &from, const std::string &to )
+{
+#ifdef WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+//Replace path with a + b all at once: written beside it, synced, then renamed over it
+static bool WriteAtomically( const std::string &path, const void *a, size_t aBytes, const void *b, size_t bBytes )
+{
+	std::string tmp = path + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "Unable to create '%s'\n", tmp.c_str());
+		return false;
+	}
+	bool ok = fwrite(a, 1, aBytes, f) == aBytes && (bBytes == 0 || fwrite(b, 1, bBytes, f) == bBytes) && fflush(f) == 0;
+#ifdef WIN32
+	ok = ok && _commit(_fileno(f)) == 0;
+#else
+	ok = ok && fsync(fileno(f)) == 0;
+#endif
+	ok = fclose(f) == 0 && ok;
+	ok = ok && MoveOver(tmp, path);
+	if (!ok)
+		fprintf(stderr, "Unable to write '%s'\n", path.c_str());
+	return ok;
+}
+
+//Write the checkpoint for everything the writer has synced
+static bool SaveCheckpoint( const std::string &path, const SweepSpec &spec, unsigned long long firstRow, unsigned long long endRow,
+							const SweepSummary &summary, const ResultWriter &w )
+{
+	SweepCheckpoint cp;
+	memset(&cp, 0, sizeof(cp));
+	memcpy(cp.Magic, SWEEP_CHECKPOINT_MAGIC, sizeof(cp.Magic));
+	cp.Spec = spec;
+	cp.FirstRow = firstRow;
+	cp.EndRow = endRow;
+	cp.Summary = summary;
+	cp.Offset = w.Offset;
+	cp.Chunks = w.ChunkOffsets.size();
+	return WriteAtomically(path, &cp, sizeof(cp), cp.Chunks > 0 ? &w.ChunkOffsets[0] : NULL, (size_t)cp.Chunks * sizeof(unsigned long long));
+}
+
+//Checkpoint of the same spec and shard; false if there is none to resume from
+static bool LoadCheckpoint( const std::string &path, const SweepSpec &spec, unsigned long long firstRow, unsigned long long endRow,
+							SweepCheckpoint *cp, std::vector<unsigned long long> *chunkOffsets )
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	bool ok = fread(cp, sizeof(*cp), 1, f) == 1 && memcmp(cp->Magic, SWEEP_CHECKPOINT_MAGIC, sizeof(cp->Magic)) == 0;
+	if (ok && (memcmp(&cp->Spec, &spec, sizeof(spec)) != 0 || cp->FirstRow != firstRow || cp->EndRow != endRow))
+	{
+		fprintf(stderr, "Checkpoint '%s' is for a different sweep, starting again\n", path.c_str());
+		ok = false;
+	}
+	if (ok)
+	{
+		chunkOffsets->resize((size_t)cp->Chunks);
+		ok = cp->Chunks == 0 || fread(&(*chunkOffsets)[0], sizeof(unsigned long long), (size_t)cp->Chunks, f) == cp->Chunks;
+	}
+	fclose(f);
+	return ok;
+}
+
+bool RunSweep( const SweepSpec &spec, const char *path, const SweepOptions &options, SweepSummary *summary )
+{
+	for (int i = 0; i < SCN_FIELDS; i++)
+	{
+		if (spec.Steps[i] < 1)
+		{
+			fprintf(stderr, "%s needs at least one step\n", SCENARIO_NAMES[i]);
+			return false;
+		}
+	}
+	if (options.Shards < 1 || options.Shard < 0 || options.Shard >= options.Shards)
+	{
+		fprintf(stderr, "There is no shard %d of %d\n", options.Shard, options.Shards);
+		return false;
+	}
+
+	std::string output = SweepOutputPath(path, options);
+	std::string checkpoint = output + ".ckpt";
+	SweepSummary empty = { 0, 0, 0., 0.f };
+	*summary = empty;
+
+	unsigned long long firstRow, endRow;
+	SweepShardRows(spec, options.Shard, options.Shards, &firstRow, &endRow);
+
+	ResultWriter writer;
+	SweepCheckpoint cp;
+	std::vector<unsigned long long> chunkOffsets;
+	if (options.Resume && LoadCheckpoint(checkpoint, spec, firstRow, endRow, &cp, &chunkOffsets))
+	{
+		if (!ResultWriterReopen(output.c_str(), cp.Offset, cp.Summary.Rows, chunkOffsets, &writer))
+			return false;
+		*summary = cp.Summary;
+		fprintf(stderr, "Resuming '%s' at row %llu\n", output.c_str(), firstRow + cp.Summary.Rows);
+	}
+	else if (!ResultWriterOpen(output.c_str(), &writer))
+		return false;
+
+	SweepBatch batch;
+	batch.Spec = &spec;
+	batch.Rows.resize(RESULT_CHUNK_ROWS);
+	batch.Partial.resize((RESULT_CHUNK_ROWS + SWEEP_GRAIN - 1) / SWEEP_GRAIN);
+	time_t lastCheckpoint = time(NULL);
+	bool ok = true;
+	for (batch.First = firstRow + summary->Rows; batch.First < endRow && ok; batch.First += RESULT_CHUNK_ROWS)
+	{
+		int count = endRow - batch.First < (unsigned long long)RESULT_CHUNK_ROWS ? (int)(endRow - batch.First) : RESULT_CHUNK_ROWS;
+		ParallelFor(0, count, SWEEP_GRAIN, EvaluateRows, &batch);
+		ok = ResultWriterAppend(&writer, &batch.Rows[0], count);
+		for (int p = 0; p < (count + SWEEP_GRAIN - 1) / SWEEP_GRAIN; p++)
+			AddSummary(summary, batch.Partial[p]);
+
+		//Only whole chunks are ever pending here, so a sync leaves nothing unwritten
+		if (ok && count == RESULT_CHUNK_ROWS && difftime(time(NULL), lastCheckpoint) >= options.CheckpointSeconds)
+		{
+			ok = ResultWriterSync(&writer) && SaveCheckpoint(checkpoint, spec, firstRow, endRow, *summary, writer);
+			lastCheckpoint = time(NULL);
+		}
+	}
+
+	ok = ResultWriterClose(&writer) && ok;
+	if (ok && options.Shards > 1)
+	{
+		SweepManifest manifest;
+		memset(&manifest, 0, sizeof(manifest));
+		memcpy(manifest.Magic, SWEEP_MANIFEST_MAGIC, sizeof(manifest.Magic));
+		manifest.Spec = spec;
+		manifest.Shard = options.Shard;
+		manifest.Shards = options.Shards;
+		manifest.FirstRow = firstRow;
+		manifest.EndRow = endRow;
+		manifest.Summary = *summary;
+		ok = WriteAtomically(output + ".done", &manifest, sizeof(manifest), NULL, 0);
+	}
+	if (ok)
+		remove(checkpoint.c_str());
+	return ok;
+}
+
+bool MergeSweep( const char *path, int shards, SweepSummary *summary )
+{
+	SweepSummary empty = { 0, 0, 0., 0.f };
+	*summary = empty;
+	if (shards < 1)
+	{
+		fprintf(stderr, "There must be at least one shard\n");
+		return false;
+	}
+
+	//Every manifest must be there and agree with the first
+	SweepOptions options;
+	SweepOptionsDefault(&options);
+	options.Shards = shards;
+	std::vector<SweepManifest> manifests(shards);
+	int missing = 0;
+	for (options.Shard = 0; options.Shard < shards; options.Shard++)
+	{
+		std::string done = SweepOutputPath(path, options) + ".done";
+		SweepManifest &m = manifests[options.Shard];
+		FILE *f = fopen(done.c_str(), "rb");
+		bool ok = f != NULL && fread(&m, sizeof(m), 1, f) == 1 && memcmp(m.Magic, SWEEP_MANIFEST_MAGIC, sizeof(m.Magic)) == 0 &&
+				  m.Shard == options.Shard && m.Shards == shards;
+		if (f != NULL)
+			fclose(f);
+		if (!ok)
+		{
+			fprintf(stderr, "Shard %d of %d is not finished: no '%s'\n", options.Shard, shards, done.c_str());
+			missing++;
+			continue;
+		}
+
+		unsigned long long first, end;
+		SweepShardRows(m.Spec, m.Shard, shards, &first, &end);
+		if (memcmp(&m.Spec, &manifests[0].Spec, sizeof(m.Spec)) != 0 || m.FirstRow != first || m.EndRow != end)
+		{
+			fprintf(stderr, "Shard %d of %d was run with a different sweep\n", options.Shard, shards);
+			return false;
+		}
+	}
+	if (missing > 0)
+		return false;
+
+	std::string tmp = std::string(path) + ".tmp";
+	ResultWriter writer;
+	if (!ResultWriterOpen(tmp.c_str(), &writer))
+		return false;
+
+	bool ok = true;
+	for (options.Shard = 0; options.Shard < shards && ok; options.Shard++)
+	{
+		const SweepManifest &m = manifests[options.Shard];
+		std::string shardPath = SweepOutputPath(path, options);
+		ResultFile rf;
+		if (!ResultFileOpen(shardPath.c_str(), &rf))
+		{
+			ok = false;
+			break;
+		}
+		if (rf.Rows != m.EndRow - m.FirstRow || rf.Rows != m.Summary.Rows)
+		{
+			fprintf(stderr, "'%s' has %llu rows, its manifest %llu\n", shardPath.c_str(), rf.Rows, m.EndRow - m.FirstRow);
+			ok = false;
+		}
+		for (size_t c = 0; c < rf.Chunks.size() && ok; c++)
+			ok = ResultWriterAppendChunk(&writer, rf.Chunks[c]);
+		ResultFileClose(&rf);
+		AddSummary(summary, m.Summary);
+	}
+
+	ok = ResultWriterClose(&writer) && ok;
+	ok = ok && MoveOver(tmp, path);
+	if (!ok)
+	{
+		fprintf(stderr, "Unable to merge the shards into '%s'\n", path);
+		remove(tmp.c_str());
+	}
+	return ok;
+}
@@ -0,0 +1,85 @@
+/*******************************************************
+--------------------- Sweep ---------------------
+Evaluates every scenario of a grid and stores the rows in a result
+file. Each field is either held at one value or stepped evenly
+between a min and a max; the rows run through the grid with
+AngleIntersection changing slowest and BikeSpeed fastest.
+
+A long sweep checkpoints as it goes to a file next to its output,
+<file>.ckpt, and a sweep started with resume carries on from the
+last checkpoint instead of from the first row. The result file and
+summary come out byte for byte the same as an uninterrupted run.
+
+A sweep too big for one machine is split into shards, each run as
+its own process with the same spec and a shard index. Shard i of n
+takes a fixed run of whole chunks and writes <file>.shard-i-of-n,
+then a <file>.shard-i-of-n.done manifest once it is complete. All
+they share is a directory, so any batch scheduler can start them.
+Merging checks every manifest and copies the shards' chunks, still
+encoded, into <file> in shard order; the result is the same file a
+single process would have written.
+
+While an event log is open every row's events go to it, with the
+row as the run. Rows evaluated again after a resume emit theirs
+again.
+*******************************************************/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+
+#include "blindspot-model.h"
+
+//Seconds between checkpoints unless told otherwise
+const int SWEEP_CHECKPOINT_SECONDS = 60;
+
+struct SweepSpec
+{
+	float	Lo[SCN_FIELDS];
+	float	Hi[SCN_FIELDS];
+	int		Steps[SCN_FIELDS];		//1 holds the field at Lo
+};
+
+struct SweepOptions
+{
+	int		Shard;					//0 to Shards - 1
+	int		Shards;					//1 for a sweep that is not split
+	int		CheckpointSeconds;
+	bool	Resume;
+};
+
+//Totals over the rows of a sweep
+struct SweepSummary
+{
+	unsigned long long	Rows;
+	unsigned long long	Collisions;
+	double				HiddenSum;		//seconds
+	float				HiddenMax;
+};
+
+//Every field held at the simulation's starting values
+void				SweepSpecDefault( SweepSpec * );
+//One process, checkpoint every SWEEP_CHECKPOINT_SECONDS, no resume
+void				SweepOptionsDefault( SweepOptions * );
+
+unsigned long long	SweepRows( const SweepSpec & );
+
+//Scenario of one row of the sweep
+void				SweepScenario( const SweepSpec &, unsigned long long row, Scenario * );
+
+//Rows [ first, end ) of one shard
+void				SweepShardRows( const SweepSpec &, int shard, int shards, unsigned long long *first, unsigned long long *end );
+
+//Result file a sweep of path writes: path itself, or its shard's file
+std::string			SweepOutputPath( const char *path, const SweepOptions & );
+
+//Evaluate every row, or every row of one shard, into a result file
+//With Resume the sweep continues from its checkpoint if it has one for this spec and shard
+bool				RunSweep( const SweepSpec &, const char *path, const SweepOptions &, SweepSummary * );
+
+//Combine the shards of path into one result file at path, with the totals of them all
+//Fails, naming them, if any shard is missing or unfinished
+bool				MergeSweep( const char *path, int shards, SweepSummary * );
+
+#endif
@@ -0,0 +1,184 @@
+/*******************************************************
+----------------- Trajectory Recorder -----------------
+Single producer (the animation) / single consumer (the writer
+thread) ring buffer. The producer only ever does two atomic
+loads, a copy and an atomic store. When the ring is full the
+step is dropped and counted instead of waiting.
+*******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "trajectory-recorder.h"
+
+//How long the writer sleeps when there is nothing to write
+const int TRAJECTORY_WRITER_SLEEP_MS = 2;
+
+static TrajectoryRecord			Ring[TRAJECTORY_RING_SIZE];
+static std::atomic<unsigned int>	RingHead(0);		//next record to write, owned by the writer
+static std::atomic<unsigned int>	RingTail(0);		//next free slot, owned by the producer
+static std::atomic<bool>			WriterStop(false);
+static std::thread					Writer;
+static FILE *						RecordFile = NULL;
+static unsigned int					Dropped;
+
+
+//Background thread: drain the ring into the file in large writes
+static void WriterLoop( )
+{
+	for (;;)
+	{
+		unsigned int head = RingHead.load(std::memory_order_relaxed);
+		unsigned int tail = RingTail.load(std::memory_order_acquire);
+		if (head == tail)
+		{
+			if (WriterStop.load(std::memory_order_acquire))
+			{
+				//Producer has stopped, so one more look at the tail is final
+				if (RingTail.load(std::memory_order_acquire) == head)
+					break;
+				continue;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(TRAJECTORY_WRITER_SLEEP_MS));
+			continue;
+		}
+
+		//Write up to the end of the ring, the wrapped part goes next time around
+		unsigned int start = head % TRAJECTORY_RING_SIZE;
+		unsigned int count = tail - head;
+		if (start + count > (unsigned int)TRAJECTORY_RING_SIZE)
+			count = TRAJECTORY_RING_SIZE - start;
+		fwrite(&Ring[start], sizeof(TrajectoryRecord), count, RecordFile);
+		RingHead.store(head + count, std::memory_order_release);
+	}
+	fflush(RecordFile);
+}
+
+
+//Open a recording and start the writer thread
+bool RecorderStart( const char *path )
+{
+	RecorderStop();
+
+	RecordFile = fopen(path, "wb");
+	if (RecordFile == NULL)
+	{
+		fprintf(stderr, "Unable to open trajectory recording '%s'\n", path);
+		return false;
+	}
+
+	TrajectoryHeader header;
+	memcpy(header.Magic, TRAJECTORY_MAGIC, sizeof(header.Magic));
+	header.Version = TRAJECTORY_VERSION;
+	header.RecordSize = sizeof(TrajectoryRecord);
+	fwrite(&header, sizeof(header), 1, RecordFile);
+
+	RingHead.store(0);
+	RingTail.store(0);
+	WriterStop.store(false);
+	Dropped = 0;
+	Writer = std::thread(WriterLoop);
+	return true;
+}
+
+bool RecorderIsRecording( )
+{
+	return RecordFile != NULL;
+}
+
+//Queue one step for writing, never blocks
+//Returns false if the step had to be dropped
+bool RecorderPush( const TrajectoryRecord &record )
+{
+	if (RecordFile == NULL)
+		return false;
+
+	unsigned int tail = RingTail.load(std::memory_order_relaxed);
+	unsigned int head = RingHead.load(std::memory_order_acquire);
+	if (tail - head >= (unsigned int)TRAJECTORY_RING_SIZE)
+	{
+		Dropped++;
+		return false;
+	}
+
+	Ring[tail % TRAJECTORY_RING_SIZE] = record;
+	RingTail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+//Flush what is queued and close the recording
+void RecorderStop( )
+{
+	if (RecordFile == NULL)
+		return;
+
+	WriterStop.store(true, std::memory_order_release);
+	Writer.join();
+	fclose(RecordFile);
+	RecordFile = NULL;
+
+	if (Dropped != 0)
+		fprintf(stderr, "Trajectory recording dropped %u steps\n", Dropped);
+}
+
+
+//Map a recording for replay
+bool TrajectoryOpen( const char *path, Trajectory *traj )
+{
+	traj->Records = NULL;
+	traj->Count = 0;
+	if (!MapFile(path, &traj->File))
+	{
+		fprintf(stderr, "Unable to open trajectory recording '%s'\n", path);
+		return false;
+	}
+
+	const TrajectoryHeader *header = (const TrajectoryHeader *)traj->File.Data;
+	if (traj->File.Size < sizeof(TrajectoryHeader) ||
+		memcmp(header->Magic, TRAJECTORY_MAGIC, sizeof(header->Magic)) != 0 ||
+		header->Version != TRAJECTORY_VERSION ||
+		header->RecordSize != sizeof(TrajectoryRecord))
+	{
+		fprintf(stderr, "'%s' is not a version %u trajectory recording\n", path, TRAJECTORY_VERSION);
+		UnmapFile(&traj->File);
+		return false;
+	}
+
+	traj->Records = (const TrajectoryRecord *)(traj->File.Data + sizeof(TrajectoryHeader));
+	traj->Count = (int)((traj->File.Size - sizeof(TrajectoryHeader)) / sizeof(TrajectoryRecord));
+	return true;
+}
+
+void TrajectoryClose( Trajectory *traj )
+{
+	if (traj->Records == NULL)
+		return;
+
+	UnmapFile(&traj->File);
+	traj->Records = NULL;
+	traj->Count = 0;
+}
+
+//Index of the last record at or before time t (records are in time order)
+int TrajectoryFind( const Trajectory &traj, float t )
+{
+	int lo = 0, hi = traj.Count;
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if (traj.Records[mid].Time <= t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 ? lo - 1 : 0;
+}
+
+float TrajectoryDuration( const Trajectory &traj )
+{
+	return traj.Count > 0 ? traj.Records[traj.Count - 1].Time : 0.f;
+}
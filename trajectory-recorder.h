@@ -0,0 +1,69 @@
+/*******************************************************
+----------------- Trajectory Recorder -----------------
+Fixed size binary records of the simulation state, one per
+animation step. Steps are handed to a background writer through
+a ring buffer so recording never waits on the disk.
+
+Recordings are replayed by memory mapping the file and looking
+records up by time, so any point of a long run is available
+instantly without simulating up to it.
+*******************************************************/
+
+#ifndef TRAJECTORY_RECORDER_H
+#define TRAJECTORY_RECORDER_H
+
+#include "mapped-file.h"
+
+//File layout: one TrajectoryHeader followed by TrajectoryRecords
+const char TRAJECTORY_MAGIC[8]	= { 'C', 'C', 'V', 'T', 'R', 'A', 'J', '1' };
+const unsigned int TRAJECTORY_VERSION = 1;
+
+//Steps the ring buffer can hold before the writer falls behind and steps are dropped
+const int TRAJECTORY_RING_SIZE = 1 << 14;
+
+//TrajectoryRecord.Flags
+const unsigned int TRAJ_SHADOW	= 0x1;		//ShadowLead / ShadowTrail are valid
+const unsigned int TRAJ_HIDDEN	= 0x2;		//bike inside the blindspot wedge
+const unsigned int TRAJ_PLAYING	= 0x4;		//animation was running
+
+struct TrajectoryHeader
+{
+	char			Magic[8];
+	unsigned int	Version;
+	unsigned int	RecordSize;
+};
+
+struct TrajectoryRecord
+{
+	unsigned int	Step;
+	float			Time;
+	float			CarDistance;
+	float			BikeDistance;
+	float			AngleIntersection;
+	float			LeadingAngle;
+	float			TrailingAngle;
+	float			ShadowLead;
+	float			ShadowTrail;
+	unsigned int	Flags;
+};
+
+//Writing
+bool	RecorderStart( const char * );
+bool	RecorderIsRecording( );
+bool	RecorderPush( const TrajectoryRecord & );
+void	RecorderStop( );
+
+//Replay
+struct Trajectory
+{
+	MappedFile					File;
+	const TrajectoryRecord *	Records;
+	int							Count;
+};
+
+bool	TrajectoryOpen( const char *, Trajectory * );
+void	TrajectoryClose( Trajectory * );
+int		TrajectoryFind( const Trajectory &, float );
+float	TrajectoryDuration( const Trajectory & );
+
+#endif
@@ -0,0 +1,433 @@
+/*******************************************************
+------------- Software Visibility Raster ---------------
+The driver view is rebuilt from the same numbers Display( ) uses:
+	gluLookAt( 0, EYE_HEIGHT, CarDistance, ... ) looking down -Z
+	gluPerspective( Fov, 1., 0.1, 1000. )
+
+The bike is drawn first into its own depth buffer. Only the
+screen rectangle the bike covers is then filled with the car
+body, so most frames touch a few hundred pixels at most.
+Pixels are processed four at a time with SSE2 when available.
+*******************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "visibility-raster.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+//Same clipping values as the gluPerspective( ) call in Display( )
+const float RASTER_NEAR = 0.1f;
+const float RASTER_FAR  = 1000.f;
+
+//Depth value used for "nothing drawn here" (NDC depth is always <= 1)
+const float RASTER_CLEAR_DEPTH = 2.f;
+
+//Largest number of triangles in either pass
+const int RASTER_MAX_TRIS = 32;
+
+struct RasterVec
+{
+	float x, y, z;
+};
+
+struct RasterTri
+{
+	RasterVec v[3];
+};
+
+struct ClipVert
+{
+	float x, y, z, w;
+};
+
+struct ScreenVert
+{
+	float x, y, z;
+};
+
+//Screen rectangle, [X0, X1) x [Y0, Y1)
+struct RasterRect
+{
+	int X0, Y0, X1, Y1;
+};
+
+//Number of set bits in a 4 bit movemask
+static const int BitCount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+
+//Add a 4 vertex triangle strip as two triangles
+static void AddStrip( RasterTri *tris, int *count, RasterVec a, RasterVec b, RasterVec c, RasterVec d )
+{
+	RasterTri t0 = { { a, b, c } };
+	RasterTri t1 = { { c, b, d } };
+	tris[(*count)++] = t0;
+	tris[(*count)++] = t1;
+}
+
+static RasterVec Vec( float x, float y, float z )
+{
+	RasterVec v = { x, y, z };
+	return v;
+}
+
+//Car body in world space, following DrawCar( ) strip for strip
+static int BuildCarTris( const DriverView &view, RasterTri *tris )
+{
+	const float DEG_TO_RAD = (float)M_PI / 180.f;
+	float lAngle = view.LeadingAngle * DEG_TO_RAD;
+	float tAngle = view.TrailingAngle * DEG_TO_RAD;
+	float leadX = sinf(lAngle) * CAR_BLINDER_DISTANCE, leadZ = (-cosf(lAngle) * CAR_BLINDER_DISTANCE);
+	float trailX = sinf(tAngle) * CAR_BLINDER_DISTANCE, trailZ = (-cosf(tAngle) * CAR_BLINDER_DISTANCE);
+
+	float height = CAR_HEIGHT;
+	float dash_height = height / 2.f;
+	float z = view.CarDistance;
+	float back = leadZ + CAR_LENGTH;
+
+	int count = 0;
+
+	//Blinders
+	AddStrip(tris, &count, Vec(leadX, 0.f, leadZ + z), Vec(leadX, height, leadZ + z), Vec(trailX, 0.f, trailZ + z), Vec(trailX, height, trailZ + z));
+	AddStrip(tris, &count, Vec(-leadX, 0.f, leadZ + z), Vec(-leadX, height, leadZ + z), Vec(-trailX, 0.f, trailZ + z), Vec(-trailX, height, trailZ + z));
+
+	//Roof and seats
+	AddStrip(tris, &count, Vec(trailX, height, leadZ + z), Vec(trailX, height, back + z), Vec(-trailX, height, leadZ + z), Vec(-trailX, height, back + z));
+	AddStrip(tris, &count, Vec(trailX, dash_height, leadZ + z), Vec(trailX, dash_height, back + z), Vec(-trailX, dash_height, leadZ + z), Vec(-trailX, dash_height, back + z));
+
+	//Right, left, front and back of the bottom of the car
+	AddStrip(tris, &count, Vec(trailX, 0.f, leadZ + z), Vec(trailX, dash_height, leadZ + z), Vec(trailX, 0.f, back + z), Vec(trailX, dash_height, back + z));
+	AddStrip(tris, &count, Vec(-trailX, 0.f, leadZ + z), Vec(-trailX, dash_height, leadZ + z), Vec(-trailX, 0.f, back + z), Vec(-trailX, dash_height, back + z));
+	AddStrip(tris, &count, Vec(trailX, 0.f, leadZ + z), Vec(trailX, dash_height, leadZ + z), Vec(-trailX, 0.f, leadZ + z), Vec(-trailX, dash_height, leadZ + z));
+	AddStrip(tris, &count, Vec(trailX, 0.f, back + z), Vec(trailX, height, back + z), Vec(-trailX, 0.f, back + z), Vec(-trailX, height, back + z));
+
+	return count;
+}
+
+//Bike in world space: BikeList rotated by AngleIntersection and moved BikeDistance down its road
+static int BuildBikeTris( const DriverView &view, RasterTri *tris )
+{
+	float a = view.AngleIntersection * (float)M_PI / 180.f;
+	float c = cosf(a), s = sinf(a);
+	float b = view.BikeDistance;
+
+	//Local corners (x, z) of the bike box, z already offset by BikeDistance
+	RasterVec p[8];
+	const float xs[2] = { 0.25f, -0.25f };
+	const float zs[2] = { 1.f, -1.f };
+	for (int i = 0; i < 8; i++)
+	{
+		float x = xs[(i >> 2) & 1];
+		float y = (float)((i >> 1) & 1);
+		float z = zs[i & 1] + b;
+
+		//glRotatef( AngleIntersection, 0, 1, 0 )
+		p[i] = Vec(x * c + z * s, y, -x * s + z * c);
+	}
+
+	//Index bits: 4 = left side, 2 = top, 1 = back
+	int count = 0;
+	AddStrip(tris, &count, p[2], p[3], p[6], p[7]);	//Top
+	AddStrip(tris, &count, p[6], p[4], p[7], p[5]);	//Left
+	AddStrip(tris, &count, p[2], p[0], p[3], p[1]);	//Right
+	return count;
+}
+
+//Clip a polygon against w >= RASTER_NEAR and w <= RASTER_FAR
+static int ClipPolygon( ClipVert *poly, int n, ClipVert *scratch )
+{
+	for (int plane = 0; plane < 2; plane++)
+	{
+		int m = 0;
+		for (int i = 0; i < n; i++)
+		{
+			const ClipVert &a = poly[i];
+			const ClipVert &b = poly[(i + 1) % n];
+			float da = plane == 0 ? a.w - RASTER_NEAR : RASTER_FAR - a.w;
+			float db = plane == 0 ? b.w - RASTER_NEAR : RASTER_FAR - b.w;
+
+			if (da >= 0.f)
+				scratch[m++] = a;
+			if ((da >= 0.f) != (db >= 0.f))
+			{
+				float t = da / (da - db);
+				ClipVert v;
+				v.x = a.x + t * (b.x - a.x);
+				v.y = a.y + t * (b.y - a.y);
+				v.z = a.z + t * (b.z - a.z);
+				v.w = a.w + t * (b.w - a.w);
+				scratch[m++] = v;
+			}
+		}
+		memcpy(poly, scratch, m * sizeof(ClipVert));
+		n = m;
+		if (n < 3)
+			return 0;
+	}
+	return n;
+}
+
+//Fill one screen triangle into a depth buffer, keeping the nearest depth
+//Returns false if nothing inside the scissor rectangle was touched
+static bool FillTriangle( ScreenVert a, ScreenVert b, ScreenVert c, float *depth, int stride, const RasterRect &scissor, RasterRect *touched )
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (fabsf(area) < 1e-8f)
+		return false;
+	if (area < 0.f)
+	{
+		ScreenVert t = b; b = c; c = t;
+		area = -area;
+	}
+
+	int x0 = (int)floorf(fminf(a.x, fminf(b.x, c.x)));
+	int x1 = (int)ceilf(fmaxf(a.x, fmaxf(b.x, c.x)));
+	int y0 = (int)floorf(fminf(a.y, fminf(b.y, c.y)));
+	int y1 = (int)ceilf(fmaxf(a.y, fmaxf(b.y, c.y)));
+	if (x0 < scissor.X0) x0 = scissor.X0;
+	if (y0 < scissor.Y0) y0 = scissor.Y0;
+	if (x1 > scissor.X1) x1 = scissor.X1;
+	if (y1 > scissor.Y1) y1 = scissor.Y1;
+	if (x0 >= x1 || y0 >= y1)
+		return false;
+
+	//Edge functions E(p) = A*px + B*py + C, all >= 0 inside
+	float A0 = -(c.y - b.y), B0 = c.x - b.x, C0 = -(A0 * b.x + B0 * b.y);	//weight of a
+	float A1 = -(a.y - c.y), B1 = a.x - c.x, C1 = -(A1 * c.x + B1 * c.y);	//weight of b
+	float A2 = -(b.y - a.y), B2 = b.x - a.x, C2 = -(A2 * a.x + B2 * a.y);	//weight of c
+
+	//Depth plane z(p) = zA*px + zB*py + zC
+	float inv = 1.f / area;
+	float zA = (A0 * a.z + A1 * b.z + A2 * c.z) * inv;
+	float zB = (B0 * a.z + B1 * b.z + B2 * c.z) * inv;
+	float zC = (C0 * a.z + C1 * b.z + C2 * c.z) * inv;
+
+	int xStart = x0 & ~3;
+	float xMin = (float)x0, xMax = (float)x1;
+
+#ifdef RASTER_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 four = _mm_set1_ps(4.f);
+	const __m128 vxMin = _mm_set1_ps(xMin), vxMax = _mm_set1_ps(xMax);
+	for (int y = y0; y < y1; y++)
+	{
+		float py = (float)y + 0.5f;
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)xStart), lane);
+		float *row = depth + y * stride;
+		for (int x = xStart; x < x1; x += 4)
+		{
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A0), px), _mm_set1_ps(B0 * py + C0));
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A1), px), _mm_set1_ps(B1 * py + C1));
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A2), px), _mm_set1_ps(B2 * py + C2));
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(px, vxMin), _mm_cmplt_ps(px, vxMax)));
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+			__m128 d = _mm_loadu_ps(row + x);
+			__m128 m = _mm_and_ps(inside, _mm_cmplt_ps(z, d));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(m, z), _mm_andnot_ps(m, d)));
+
+			px = _mm_add_ps(px, four);
+		}
+	}
+#else
+	for (int y = y0; y < y1; y++)
+	{
+		float py = (float)y + 0.5f;
+		float *row = depth + y * stride;
+		for (int x = x0; x < x1; x++)
+		{
+			float px = (float)x + 0.5f;
+			if (A0 * px + B0 * py + C0 < 0.f || A1 * px + B1 * py + C1 < 0.f || A2 * px + B2 * py + C2 < 0.f)
+				continue;
+			float z = zA * px + zB * py + zC;
+			if (z < row[x])
+				row[x] = z;
+		}
+	}
+	(void)xStart; (void)xMin; (void)xMax;
+#endif
+
+	if (touched != NULL)
+	{
+		if (x0 < touched->X0) touched->X0 = x0;
+		if (y0 < touched->Y0) touched->Y0 = y0;
+		if (x1 > touched->X1) touched->X1 = x1;
+		if (y1 > touched->Y1) touched->Y1 = y1;
+	}
+	return true;
+}
+
+//Transform, clip, project and fill a list of world space triangles
+static void DrawTris( const RasterTri *tris, int count, const DriverView &view, float f, int res, float *depth, int stride, const RasterRect &scissor, RasterRect *touched )
+{
+	//Projection terms from gluPerspective( )
+	const float pz = (RASTER_FAR + RASTER_NEAR) / (RASTER_NEAR - RASTER_FAR);
+	const float pw = (2.f * RASTER_FAR * RASTER_NEAR) / (RASTER_NEAR - RASTER_FAR);
+	float half = 0.5f * (float)res;
+
+	for (int t = 0; t < count; t++)
+	{
+		ClipVert poly[8], scratch[8];
+		for (int i = 0; i < 3; i++)
+		{
+			//View space: the eye sits at ( 0, EYE_HEIGHT, CarDistance ) looking down -Z
+			float xv = tris[t].v[i].x;
+			float yv = tris[t].v[i].y - EYE_HEIGHT;
+			float zv = tris[t].v[i].z - view.CarDistance;
+			poly[i].x = f * xv;
+			poly[i].y = f * yv;
+			poly[i].z = pz * zv + pw;
+			poly[i].w = -zv;
+		}
+
+		int n = ClipPolygon(poly, 3, scratch);
+		if (n == 0)
+			continue;
+
+		ScreenVert s[8];
+		for (int i = 0; i < n; i++)
+		{
+			float iw = 1.f / poly[i].w;
+			s[i].x = (poly[i].x * iw + 1.f) * half;
+			s[i].y = (poly[i].y * iw + 1.f) * half;
+			s[i].z = poly[i].z * iw;
+		}
+
+		//Clipped polygon is convex, so fan it out
+		for (int i = 1; i < n - 1; i++)
+			FillTriangle(s[0], s[i], s[i + 1], depth, stride, scissor, touched);
+	}
+}
+
+static void ClearRect( float *depth, int stride, const RasterRect &r )
+{
+	for (int y = r.Y0; y < r.Y1; y++)
+	{
+		float *row = depth + y * stride;
+		for (int x = r.X0 & ~3; x < r.X1; x++)
+			row[x] = RASTER_CLEAR_DEPTH;
+	}
+}
+
+
+//Allocate the depth buffers for a res x res raster
+bool RasterTargetInit( RasterTarget *target, int res )
+{
+	if (res < 4)
+		res = 4;
+	if (res > RASTER_MAX_RES)
+		res = RASTER_MAX_RES;
+
+	target->Res = res;
+	target->Stride = (res + 3) & ~3;
+	size_t size = (size_t)target->Stride * res * sizeof(float);
+	target->OccluderDepth = (float *)malloc(size);
+	target->BikeDepth = (float *)malloc(size);
+	if (target->OccluderDepth == NULL || target->BikeDepth == NULL)
+	{
+		RasterTargetFree(target);
+		return false;
+	}
+
+	RasterRect all = { 0, 0, target->Stride, res };
+	ClearRect(target->OccluderDepth, target->Stride, all);
+	ClearRect(target->BikeDepth, target->Stride, all);
+	return true;
+}
+
+void RasterTargetFree( RasterTarget *target )
+{
+	free(target->OccluderDepth);
+	free(target->BikeDepth);
+	target->OccluderDepth = NULL;
+	target->BikeDepth = NULL;
+	target->Res = target->Stride = 0;
+}
+
+
+//Render the car interior view and count visible bike pixels
+void RasterizeDriverView( const DriverView &view, RasterTarget *target, RasterVisibility *result )
+{
+	result->BikePixels = 0;
+	result->VisiblePixels = 0;
+	result->VisibleFraction = 1.f;
+
+	//A zero or 180 degree field of view has no usable projection
+	if (view.Fov <= 0.f || view.Fov >= 180.f || target->BikeDepth == NULL)
+		return;
+
+	int res = target->Res;
+	int stride = target->Stride;
+	float f = 1.f / tanf(0.5f * view.Fov * (float)M_PI / 180.f);
+
+	RasterTri tris[RASTER_MAX_TRIS];
+	RasterRect screen = { 0, 0, res, res };
+
+	//Bike pass: the buffer is left cleared outside of what was touched last frame
+	RasterRect bike = { res, res, 0, 0 };
+	int count = BuildBikeTris(view, tris);
+	DrawTris(tris, count, view, f, res, target->BikeDepth, stride, screen, &bike);
+	if (bike.X0 >= bike.X1)
+		return;
+
+	//Occluder pass, limited to the pixels the bike could cover
+	ClearRect(target->OccluderDepth, stride, bike);
+	count = BuildCarTris(view, tris);
+	DrawTris(tris, count, view, f, res, target->OccluderDepth, stride, bike, NULL);
+
+	int covered = 0, visible = 0;
+	int xStart = bike.X0 & ~3;
+#ifdef RASTER_SSE2
+	const __m128 clear = _mm_set1_ps(RASTER_CLEAR_DEPTH);
+	const __m128 lane = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+	const __m128 vxMin = _mm_set1_ps((float)bike.X0), vxMax = _mm_set1_ps((float)bike.X1);
+	for (int y = bike.Y0; y < bike.Y1; y++)
+	{
+		float *brow = target->BikeDepth + y * stride;
+		float *orow = target->OccluderDepth + y * stride;
+		for (int x = xStart; x < bike.X1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+			__m128 inRect = _mm_and_ps(_mm_cmpge_ps(px, vxMin), _mm_cmplt_ps(px, vxMax));
+			__m128 b = _mm_loadu_ps(brow + x);
+			__m128 o = _mm_loadu_ps(orow + x);
+			__m128 cov = _mm_and_ps(inRect, _mm_cmplt_ps(b, clear));
+			covered += BitCount4[_mm_movemask_ps(cov)];
+			visible += BitCount4[_mm_movemask_ps(_mm_and_ps(cov, _mm_cmplt_ps(b, o)))];
+
+			//Leave the bike buffer cleared for the next frame
+			_mm_storeu_ps(brow + x, _mm_or_ps(_mm_and_ps(inRect, clear), _mm_andnot_ps(inRect, b)));
+		}
+	}
+#else
+	for (int y = bike.Y0; y < bike.Y1; y++)
+	{
+		float *brow = target->BikeDepth + y * stride;
+		float *orow = target->OccluderDepth + y * stride;
+		for (int x = bike.X0; x < bike.X1; x++)
+		{
+			if (brow[x] < RASTER_CLEAR_DEPTH)
+			{
+				covered++;
+				if (brow[x] < orow[x])
+					visible++;
+			}
+			brow[x] = RASTER_CLEAR_DEPTH;
+		}
+	}
+	(void)xStart;
+#endif
+
+	result->BikePixels = covered;
+	result->VisiblePixels = visible;
+	result->VisibleFraction = covered > 0 ? (float)visible / (float)covered : 1.f;
+}
@@ -0,0 +1,57 @@
+/*******************************************************
+------------- Software Visibility Raster ---------------
+A small depth-only rasterizer that redraws the car interior view
+from Display( ) on the CPU at a low resolution and counts how many
+of the bike's pixels are not hidden behind the car body.
+
+No OpenGL context is needed so the same measurement can be used
+by the GUI and by anything that evaluates scenarios in bulk.
+*******************************************************/
+
+#ifndef VISIBILITY_RASTER_H
+#define VISIBILITY_RASTER_H
+
+//Car geometry shared with DrawCar( ) and the eye placement in Display( )
+const float CAR_BLINDER_DISTANCE	= 2.195f;	//distance from the eye to the blinders
+const float CAR_LENGTH				= 4.f;
+const float CAR_HEIGHT				= 2.f;
+const float EYE_HEIGHT				= 1.6f;
+
+//Raster resolution limits (pixels along each side of the square viewport)
+const int RASTER_DEFAULT_RES	= 64;
+const int RASTER_MAX_RES		= 512;
+
+//Everything the car interior view depends on
+struct DriverView
+{
+	float	Fov;
+	float	AngleIntersection;
+	float	LeadingAngle;
+	float	TrailingAngle;
+	float	CarDistance;
+	float	BikeDistance;
+};
+
+//Result of one rasterized frame
+struct RasterVisibility
+{
+	int		BikePixels;			//pixels covered by the bike if the car were not there
+	int		VisiblePixels;		//bike pixels in front of the car body
+	float	VisibleFraction;	//VisiblePixels / BikePixels (1 when the bike is off screen)
+};
+
+//Scratch buffers for one rasterizing thread
+struct RasterTarget
+{
+	int		Res;
+	int		Stride;				//row length in floats, padded to a multiple of 4
+	float *	OccluderDepth;
+	float *	BikeDepth;
+};
+
+bool	RasterTargetInit( RasterTarget *, int );
+void	RasterTargetFree( RasterTarget * );
+
+void	RasterizeDriverView( const DriverView &, RasterTarget *, RasterVisibility * );
+
+#endif